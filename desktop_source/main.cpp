@@ -32,6 +32,10 @@ struct SourceAppData {
     std::unique_ptr<ConnmanClient> connman;
 
     int port;
+    MiracEncoderProfile::Preset encoder_preset;
+    gboolean batched_send;
+    gint max_bitrate;
+    gint max_latency;
 };
 
 static gboolean _sig_handler (gpointer data_ptr)
@@ -91,7 +95,8 @@ static gboolean create_source (gpointer data_ptr)
     SourceAppData* data = static_cast<SourceAppData*>(data_ptr);
 
     try {
-        data->source.reset(new MiracSource (data->port));
+        data->source.reset(new MiracSource (data->port, data->encoder_preset, data->batched_send));
+        data->source->set_video_budget(data->max_bitrate, data->max_latency);
         std::cout << "Running source on port "<< data->source->get_host_port() << std::endl;
         return true;
     } catch (const std::exception &x) {
@@ -104,10 +109,19 @@ int main (int argc, char *argv[])
 {
     SourceAppData data;
     data.port = 7236;
+    data.encoder_preset = MiracEncoderProfile::BALANCED;
+    data.batched_send = FALSE;
+    data.max_bitrate = MiracSource::default_max_bitrate;
+    data.max_latency = MiracSource::default_max_latency;
+    gchar* encoder_option = NULL;
 
     GOptionEntry main_entries[] =
     {
         { "rtsp_port", 0, 0, G_OPTION_ARG_INT, &(data.port), "Specify optional RTSP port number, 7236 by default", "rtsp_port"},
+        { "encoder", 0, 0, G_OPTION_ARG_STRING, &encoder_option, "Specify the encoder preset, balanced by default", "(lowest-latency|balanced|max-quality)"},
+        { "max-bitrate", 0, 0, G_OPTION_ARG_INT, &(data.max_bitrate), "Specify the video bitrate budget in kbit/s, 20000 by default, 0 for no limit", "kbps"},
+        { "max-latency", 0, 0, G_OPTION_ARG_INT, &(data.max_latency), "Specify the sink decoder latency budget in ms, 100 by default, 0 for no limit", "ms"},
+        { "batched-send", 0, 0, G_OPTION_ARG_NONE, &(data.batched_send), "Send the RTP packets of a frame in batches instead of with udpsink", NULL},
         { NULL }
     };
 
@@ -123,6 +137,18 @@ int main (int argc, char *argv[])
     }
     g_option_context_free(context);
 
+    if (encoder_option &&
+        !MiracEncoderProfile::ParsePreset(encoder_option, data.encoder_preset)) {
+        g_print ("unknown encoder preset: %s\n", encoder_option);
+        exit (1);
+    }
+    g_free(encoder_option);
+
+    if (data.max_bitrate < 0 || data.max_latency < 0) {
+        g_print ("the budget cannot be negative\n");
+        exit (1);
+    }
+
     GMainLoop *main_loop =  g_main_loop_new(NULL, TRUE);
     g_unix_signal_add(SIGINT, _sig_handler, main_loop);
     g_unix_signal_add(SIGTERM, _sig_handler, main_loop);
@@ -154,6 +180,9 @@ int main (int argc, char *argv[])
 
     g_main_loop_unref (main_loop);
 
+    if (data.source)
+        data.source->print_statistics (std::cout);
+
     return 0;
 }
 
@@ -22,7 +22,6 @@
 
 #include <memory>
 #include <algorithm>
-#include <assert.h>
 
 #include "mirac-desktop-source.hpp"
 #include "reply.h"
@@ -44,13 +43,50 @@
 #include "standbyresumecapability.h"
 #include "getparameter.h"
 #include "setparameter.h"
+#include "capabilitynegotiator.h"
+#include "videomodes.h"
+
+const MiracSource::StateMachine::Transition MiracSource::transitions[] = {
+    { CAPABILITY_NEGOTIATION, CAPABILITY_NEGOTIATION, StateMachine::OPTIONS,
+      &MiracSource::handle_m2_options },
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::GET_PARAMETER,
+      &MiracSource::handle_get_parameter },
+    // triggers are ours to send, a sink's one is just acknowledged
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::SET_PARAMETER,
+      &MiracSource::handle_set_parameter },
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::TRIGGER_SETUP,
+      &MiracSource::handle_set_parameter },
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::TRIGGER_PLAY,
+      &MiracSource::handle_set_parameter },
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::TRIGGER_PAUSE,
+      &MiracSource::handle_set_parameter },
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::TRIGGER_TEARDOWN,
+      &MiracSource::handle_set_parameter },
+    { RTSP_SESSION_ESTABLISHMENT, RTSP_SESSION_ESTABLISHMENT, StateMachine::SETUP,
+      &MiracSource::handle_m6_setup },
+    { RTSP_SESSION_ESTABLISHMENT, WFD_SESSION_PAUSED, StateMachine::PLAY,
+      &MiracSource::handle_m7_play },
+    { RTSP_SESSION_ESTABLISHMENT, WFD_SESSION_PAUSED, StateMachine::PAUSE,
+      &MiracSource::handle_m9_pause },
+    { RTSP_SESSION_ESTABLISHMENT, WFD_SESSION_PAUSED, StateMachine::TEARDOWN,
+      &MiracSource::handle_m8_teardown },
+    // answered in every state, the encoder only acts on it while playing
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::IDR_REQUEST,
+      &MiracSource::handle_m13_idr_request },
+};
+
+const char* const MiracSource::state_names[] = {
+    "INIT",
+    "CAPABILITY_NEGOTIATION",
+    "RTSP_SESSION_ESTABLISHMENT",
+    "WFD_SESSION_ESTABLISHMENT",
+    "WFD_SESSION_PLAYING",
+    "WFD_SESSION_PAUSED",
+};
 
 void MiracSource::set_state(MiracSource::State state)
 {
     state_ = state;
-    if (state == INIT) {
-        send_cseq_ = 1;
-    }
     std::cout << "** State "<< state_ << std::endl;
 }
 
@@ -85,24 +121,21 @@ void MiracSource::handle_m2_options (std::shared_ptr<WFD::Message> message)
     send (reply);
 
     // Send M3 GET_PARAMETER
-    expected_reply_ = WFD::Method::GET_PARAMETER;
     WFD::GetParameter m3("rtsp://localhost/wfd1.0");
-    m3.header().set_cseq (send_cseq_++);
 
     m3.payload().add_get_parameter_property(WFD::WFD_AUDIO_CODECS);
     m3.payload().add_get_parameter_property(WFD::WFD_VIDEO_FORMATS);
     m3.payload().add_get_parameter_property(WFD::WFD_CLIENT_RTP_PORTS);
 
-    send (m3);
+    send_request (m3, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m3_get_parameters_reply (reply);
+    });
 }
 
 void MiracSource::handle_m1_options_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    // not expecting anything
-    expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
-
     // Ensure M1 OPTIONS reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     auto methods = reply->header().supported_methods();
@@ -118,8 +151,13 @@ void MiracSource::handle_m1_options_reply (std::shared_ptr<WFD::Reply> reply)
 
 void MiracSource::handle_m3_get_parameters_reply (std::shared_ptr<WFD::Reply> reply)
 {
+    if (state_ != CAPABILITY_NEGOTIATION) {
+        std::cout << "** Unexpected reply" << std::endl;
+        return;
+    }
+
     // Ensure M3 GET_PARAMETERS reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     auto video_formats = std::static_pointer_cast<WFD::VideoFormats>(reply->payload().get_property (WFD::PropertyType::WFD_VIDEO_FORMATS));
@@ -127,9 +165,21 @@ void MiracSource::handle_m3_get_parameters_reply (std::shared_ptr<WFD::Reply> re
         std::cout << "** GET_PARAMETER: missing wfd_video_formats in response" << std::endl;
         return;
     }
-    // technically, we're suppposed to pick and set a video format here,
-    // but the task seems so insanely tedious that for now let's just skip it, and
-    // hope that sinks don't care (our sink doesn't)
+
+    // x264enc handles both profiles, all levels and every resolution
+    WFD::H264Codecs encoder_codecs;
+    encoder_codecs.push_back(WFD::H264Codec(WFD::CBP | WFD::CHP, 0x1f,
+                                            0x1ffff, 0x1fffffff, 0xfff,
+                                            0, 0, 0, 0, -1, -1));
+    WFD::CapabilityNegotiator negotiator(encoder_codecs,
+                                         std::vector<WFD::AudioCodec>());
+    negotiator.set_max_bitrate(max_bitrate_);
+    negotiator.set_max_latency(max_latency_);
+    auto video_format = negotiator.select_video_format(*video_formats);
+    if (video_format == NULL) {
+        std::cout << "** GET_PARAMETER: no common video format within the budget" << std::endl;
+        return;
+    }
 
     auto audio_codecs = std::static_pointer_cast<WFD::AudioCodecs>(reply->payload().get_property (WFD::PropertyType::WFD_AUDIO_CODECS));
     if (audio_codecs == NULL) {
@@ -139,43 +189,50 @@ void MiracSource::handle_m3_get_parameters_reply (std::shared_ptr<WFD::Reply> re
     // we can ignore the audio codecs because our stream is video-only
 
     auto rtp_ports = std::static_pointer_cast<WFD::ClientRtpPorts>(reply->payload().get_property (WFD::PropertyType::WFD_CLIENT_RTP_PORTS));
-    if (audio_codecs == NULL) {
+    if (rtp_ports == NULL) {
         std::cout << "** GET_PARAMETER: missing wfd_client_rtp_ports in response" << std::endl;
         return;
     }
     set_rtp_ports(rtp_ports->rtp_port_0(), rtp_ports->rtp_port_1());
+    encoder_profile_.SetCodec(video_format->h264_codecs()[0]);
 
     // Send M4 SET_PARAMETER
-    expected_reply_ = WFD::Method::SET_PARAMETER;
     WFD::SetParameter m4("rtsp://localhost/wfd1.0");
-    m4.header().set_cseq (send_cseq_++);
 
+    m4.payload().add_property(video_format);
     std::shared_ptr<WFD::Property> rtp_ports_set(new WFD::ClientRtpPorts(rtp_ports->rtp_port_0(), rtp_ports->rtp_port_1()));
     m4.payload().add_property(rtp_ports_set);
     // hopefully no one cares about the IP address; they shouldn't
     std::shared_ptr<WFD::Property> presentation_url_set(new WFD::PresentationUrl("rtsp://127.0.0.1/wfd1.0/streamid=0",""));
     m4.payload().add_property(presentation_url_set);
 
-    send (m4);
+    send_request (m4, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m4_set_parameters_reply (reply);
+    });
 
 }
 
 void MiracSource::send_wfd_trigger_method(WFD::TriggerMethod::Method method)
 {
-    expected_reply_ = WFD::Method::SET_PARAMETER;
     WFD::SetParameter m5("rtsp://localhost/wfd1.0");
-    m5.header().set_cseq (send_cseq_++);
 
     std::shared_ptr<WFD::Property> wfd_trigger_method(new WFD::TriggerMethod(method));
     m5.payload().add_property(wfd_trigger_method);
 
-    send(m5);
+    send_request(m5, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m5_set_parameters_reply (reply);
+    });
 }
 
 void MiracSource::handle_m4_set_parameters_reply (std::shared_ptr<WFD::Reply> reply)
 {
+    if (state_ != CAPABILITY_NEGOTIATION) {
+        std::cout << "** Unexpected reply" << std::endl;
+        return;
+    }
+
     // Ensure M4 SET_PARAMETERS reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     // send M5 wfd_trigger_method: SETUP
@@ -186,11 +243,8 @@ void MiracSource::handle_m4_set_parameters_reply (std::shared_ptr<WFD::Reply> re
 
 void MiracSource::handle_m5_set_parameters_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    // not expecting anything
-    expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
-
     // Ensure M5 SET_PARAMETERS reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     // otherwise do nothing; the sink will send a SETUP/PLAY/PAUSE/TEARDOWN command
@@ -201,7 +255,8 @@ void MiracSource::handle_m6_setup (std::shared_ptr<WFD::Message> message)
     unsigned int client_port = message->header().transport().client_port();
 
     // set up gstreamer pipeline with client_port, but do not play yet
-    gst_pipeline.reset(new MiracGstTestSource(WFD_DESKTOP, get_peer_address(), client_port));
+    gst_pipeline.reset(new MiracGstTestSource(WFD_DESKTOP, get_peer_address(), client_port, encoder_profile_,
+                                              batched_send_));
     gst_pipeline->SetState(GST_STATE_READY);
 
     // also get the source udp port from gstreamer
@@ -260,39 +315,36 @@ void MiracSource::handle_m8_teardown (std::shared_ptr<WFD::Message> message)
     set_state (INIT);
 }
 
+void MiracSource::handle_m13_idr_request (std::shared_ptr<WFD::Message> message)
+{
+    WFD::Reply reply(200);
+    reply.header().set_cseq (message->header().cseq());
+
+    send (reply);
+
+    if (state_ != WFD_SESSION_PLAYING)
+        return;
+
+    // the sink lost part of a frame, start over from an IDR frame
+    // instead of leaving it to wait for the next periodic one
+    if (gst_pipeline && !gst_pipeline->RequestKeyFrame())
+        std::cout << "** IDR request not passed to the encoder" << std::endl;
+}
+
+// Replies are matched to their requests by the broker, requests may
+// arrive while our own ones are still in flight.
 bool MiracSource::validate_message_sequence(std::shared_ptr<WFD::Message> message) const
 {
-    if (message->type() == WFD::Message::MessageTypeReply) {
-        // Ensure sent message sequence
-        if (message->header().cseq() != send_cseq_ - 1) {
-            std::cout << "** Out-of-order reply CSeq, dropping reply" << std::endl;
-            return false;
-        }
-        if (expected_reply_ == WFD::Method::ORG_WFA_WFD_1_0) {
-            std::cout << "** Not expecting reply, dropping reply" << std::endl;
-            return false;
-        }
-    } else {
-        // Ensure received message sequence
-        if (message->type() != WFD::Message::MessageTypeOptions &&
-            message->header().cseq() != receive_cseq_ + 1) {
-
-            WFD::Reply reply(400);
-            reply.header().set_cseq (message->header().cseq());
-            send (reply);
-
-            std::cout << "** Out-of-order message CSeq " << message->header().cseq() << std::endl;
-            return false;
-        }
-
-        if (expected_reply_ != WFD::Method::ORG_WFA_WFD_1_0) {
-            WFD::Reply reply(400);
-            reply.header().set_cseq (message->header().cseq());
-            send (reply);
-
-            std::cout << "** Expected a reply";
-            return false;
-        }
+    // Ensure received message sequence
+    if (message->type() != WFD::Message::MessageTypeOptions &&
+        message->header().cseq() != receive_cseq_ + 1) {
+
+        WFD::Reply reply(400);
+        reply.header().set_cseq (message->header().cseq());
+        send (reply);
+
+        std::cout << "** Out-of-order message CSeq " << message->header().cseq() << std::endl;
+        return false;
     }
 
     return true;
@@ -321,107 +373,38 @@ void MiracSource::got_message(std::shared_ptr<WFD::Message> message)
 
     if (message->type() == WFD::Message::MessageTypeOptions)
         receive_cseq_ = message->header().cseq();
-    else if (message->type() != WFD::Message::MessageTypeReply)
+    else
         receive_cseq_++;
 
-    switch (message->type()) {
-        case WFD::Message::MessageTypeOptions:
-            if (state_ == CAPABILITY_NEGOTIATION)
-                handle_m2_options(message);
-            else 
-                std::cout << "** Unexpected OPTIONS" << std::endl;
-            break;
-        case WFD::Message::MessageTypeGetParameter:
-            if (state_ >= CAPABILITY_NEGOTIATION)
-                handle_get_parameter(message);
-            else 
-                std::cout << "** Unexpected GET_PARAMETER" << std::endl;
-            break;
-        case WFD::Message::MessageTypeSetParameter:
-        {
-            auto set_param = std::static_pointer_cast<WFD::SetParameter>(message);
-            if (state_ >= CAPABILITY_NEGOTIATION ) {
-                handle_set_parameter (message);
-            } else {
-                std::cout << "** Unexpected SET_PARAMETER" << std::endl;
-            }
-            break;
-        }
-        case WFD::Message::MessageTypeSetup:
-        {
-            if (state_ == RTSP_SESSION_ESTABLISHMENT) {
-                handle_m6_setup (message);
-            } else {
-                std::cout << "** Unexpected SETUP" << std::endl;
-            }
-            break;
-        }
-        case WFD::Message::MessageTypePlay:
-        {
-            if (state_ >= RTSP_SESSION_ESTABLISHMENT) {
-                handle_m7_play (message);
-            } else {
-                std::cout << "** Unexpected PLAY" << std::endl;
-            }
-            break;
-        }
-        case WFD::Message::MessageTypePause:
-        {
-            if (state_ >= RTSP_SESSION_ESTABLISHMENT) {
-                handle_m9_pause (message);
-            } else {
-                std::cout << "** Unexpected PAUSE" << std::endl;
-            }
-            break;
-        }
-        case WFD::Message::MessageTypeTeardown:
-        {
-            if (state_ >= RTSP_SESSION_ESTABLISHMENT) {
-                handle_m8_teardown (message);
-            } else {
-                std::cout << "** Unexpected TEARDOWN" << std::endl;
-            }
-            break;
-        }
-        case WFD::Message::MessageTypeReply:
-            if (state_ == CAPABILITY_NEGOTIATION &&
-                expected_reply_ == WFD::Method::OPTIONS) {
-                handle_m1_options_reply(std::static_pointer_cast<WFD::Reply>(message));
-            } else if (state_ == CAPABILITY_NEGOTIATION &&
-                expected_reply_ == WFD::Method::GET_PARAMETER) {
-                handle_m3_get_parameters_reply(std::static_pointer_cast<WFD::Reply>(message));
-            } else if (state_ == CAPABILITY_NEGOTIATION &&
-                expected_reply_ == WFD::Method::SET_PARAMETER) {
-                handle_m4_set_parameters_reply(std::static_pointer_cast<WFD::Reply>(message));
-            } else if (state_ >= RTSP_SESSION_ESTABLISHMENT &&
-                expected_reply_ == WFD::Method::SET_PARAMETER) {
-                handle_m5_set_parameters_reply(std::static_pointer_cast<WFD::Reply>(message));
-            } else {
-                std::cout << "** Unexpected reply" << std::endl;
-            }
-            break;
-        default:
-            std::cout << "** Method not implemented" << std::endl;
-            break;
-    }
+    if (!state_machine_.Dispatch (this, state_, message))
+        std::cout << "** Unexpected " << StateMachine::KindName (StateMachine::Classify (*message))
+                  << " in state " << state_names[state_] << std::endl;
 }
 
 void MiracSource::on_connected()
 {
     set_state (CAPABILITY_NEGOTIATION);
+    state_machine_.Restart();
 
     // Send M1 OPTIONS
-    expected_reply_ = WFD::Method::OPTIONS;
     WFD::Options m1("*");
-    m1.header().set_cseq (send_cseq_++);
     m1.header().set_require_wfd_support (true);
-    send (m1);
+    send_request (m1, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m1_options_reply (reply);
+    });
 }
 
-MiracSource::MiracSource(int rtsp_port)
-    : MiracBroker(std::to_string(rtsp_port)),
-      send_cseq_(0),
-      receive_cseq_(0) {
+MiracSource::MiracSource(int rtsp_port, MiracEncoderProfile::Preset encoder_preset,
+                         bool batched_send)
+    : MiracBroker(std::to_string(rtsp_port), NULL, 1, false,
+                  MiracNetwork::Options::ControlChannel()),
+      state_(INIT),
+      state_machine_(transitions),
+      receive_cseq_(0),
+      encoder_profile_(encoder_preset),
+      batched_send_(batched_send),
+      max_bitrate_(default_max_bitrate),
+      max_latency_(default_max_latency) {
 
 }
 
@@ -429,6 +412,17 @@ MiracSource::~MiracSource()
 {
 }
 
+void MiracSource::print_statistics(std::ostream& out) const
+{
+    state_machine_.PrintStatistics (out, state_names);
+}
+
+void MiracSource::set_video_budget(unsigned int max_bitrate, unsigned int max_latency)
+{
+    max_bitrate_ = max_bitrate;
+    max_latency_ = max_latency;
+}
+
 void MiracSource::Teardown() {
     std::cout << "** teardown" << std::endl;
 
@@ -28,6 +28,7 @@
 #include <memory>
 
 #include "mirac-broker.hpp"
+#include "mirac-state-machine.hpp"
 #include "reply.h"
 #include "setparameter.h"
 #include "mirac-gst-test-source.hpp"
@@ -35,7 +36,9 @@
 class MiracSource: public MiracBroker
 {
     public:
-        MiracSource(int rtsp_port);
+        MiracSource(int rtsp_port,
+                    MiracEncoderProfile::Preset encoder_preset = MiracEncoderProfile::BALANCED,
+                    bool batched_send = false);
         ~MiracSource();
 
         typedef void (MiracSource::*TriggeredCommand)();
@@ -44,6 +47,17 @@ class MiracSource: public MiracBroker
         void Play();
         void Pause();
 
+        // time taken by each transition of the sessions so far
+        void print_statistics(std::ostream& out) const;
+
+        // limits for the video format chosen in M4: the estimated bitrate
+        // in kbit/s and the decoder latency the sink reports in ms, 0 for
+        // no limit
+        void set_video_budget(unsigned int max_bitrate, unsigned int max_latency);
+        // up to 1080p60, which a Wi-Fi Direct link carries comfortably
+        static const unsigned int default_max_bitrate = 20000;
+        static const unsigned int default_max_latency = 100;
+
     private:
         enum State {
             INIT,
@@ -52,17 +66,12 @@ class MiracSource: public MiracBroker
             WFD_SESSION_ESTABLISHMENT, // RSTP SESSION OK
             WFD_SESSION_PLAYING,
             WFD_SESSION_PAUSED,
+            STATE_COUNT
         };
 
-        enum SetParameterType {
-            M4,
-            M5_TRIGGER_SETUP,
-            M5_TRIGGER_PLAY,
-            M5_TRIGGER_PAUSE,
-            M5_TRIGGER_TEARDOWN,
-        };
-
-        static SetParameterType get_method(std::shared_ptr<WFD::SetParameter> set_param);
+        typedef MiracStateMachine<MiracSource, STATE_COUNT> StateMachine;
+        static const StateMachine::Transition transitions[];
+        static const char* const state_names[];
 
         void got_message(std::shared_ptr<WFD::Message> message);
         void on_connected();
@@ -79,6 +88,7 @@ class MiracSource: public MiracBroker
         void handle_m7_play(std::shared_ptr<WFD::Message>);
         void handle_m9_pause(std::shared_ptr<WFD::Message>);
         void handle_m8_teardown(std::shared_ptr<WFD::Message>);
+        void handle_m13_idr_request(std::shared_ptr<WFD::Message>);
         void handle_get_parameter(std::shared_ptr<WFD::Message>);
         void handle_set_parameter(std::shared_ptr<WFD::Message>);
 
@@ -87,15 +97,18 @@ class MiracSource: public MiracBroker
         void set_rtp_ports(unsigned short port_0, unsigned short port_1);
 
         MiracSource::State state_;
+        StateMachine state_machine_;
         std::string presentation_url_;
         std::string session_;
 
-        WFD::Method expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
-
-        int send_cseq_;
         int receive_cseq_;
         unsigned short rtp_port_0_;
         unsigned short rtp_port_1_;
+        // set up from the video format sent in M4
+        MiracEncoderProfile encoder_profile_;
+        bool batched_send_;
+        unsigned int max_bitrate_;
+        unsigned int max_latency_;
 
         std::unique_ptr<MiracGstTestSource> gst_pipeline;
 };
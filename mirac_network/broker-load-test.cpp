@@ -0,0 +1,213 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <glib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mirac-broker.hpp"
+#include "mirac-epoll-reactor.hpp"
+#include "mirac-reactor-pool.hpp"
+#include "reply.h"
+
+/* Opens N sessions against one listening broker and runs a number of
+ * OPTIONS round trips on each of them concurrently. With a shard count
+ * the sessions are served by that many MiracReactorPool threads, each
+ * with its own broker on the shared port, instead of by a broker on the
+ * clients' own reactor. */
+
+typedef std::chrono::steady_clock Clock;
+
+class LoadSource : public MiracBroker
+{
+    public:
+        LoadSource (MiracReactor *reactor, const std::string &port,
+                    int backlog, bool reuse_port, size_t *connected) :
+            MiracBroker(port, reactor, backlog, reuse_port),
+            connected(connected)
+            { set_max_sessions(0); }
+
+    private:
+        void got_message (std::shared_ptr<WFD::Message> message) override
+            {
+                WFD::Reply reply(200);
+                reply.header().set_cseq(message->header().cseq());
+                send(reply);
+            }
+        void on_connected () override
+            { (*connected)++; }
+
+        size_t *connected;
+};
+
+struct LoadClient
+{
+    std::unique_ptr<MiracNetwork> network;
+    bool connected;
+    int cseq;
+    Clock::time_point sent_at;
+};
+
+static std::string options_request (int cseq)
+{
+    return "OPTIONS * RTSP/1.0\r\n"
+           "CSeq: " + std::to_string(cseq) + "\r\n"
+           "Require: org.wfa.wfd1.0\r\n\r\n";
+}
+
+int main (int argc, char *argv[])
+{
+    int sessions = argc > 1 ? atoi(argv[1]) : 100;
+    int rounds = argc > 2 ? atoi(argv[2]) : 10;
+    int shards = argc > 3 ? atoi(argv[3]) : 0;
+    if (sessions <= 0 || rounds <= 0 || shards < 0)
+    {
+        fprintf(stderr, "usage: %s [sessions] [rounds] [shards]\n", argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        MiracEpollReactor reactor;
+        std::unique_ptr<LoadSource> source;
+        std::unique_ptr<MiracReactorPool> pool;
+        /* written by one thread each, read after Stop() */
+        std::vector<size_t> connected(std::max(shards, 1), 0);
+        std::string port("0");
+
+        if (shards == 0)
+        {
+            source.reset(new LoadSource(&reactor, port, sessions, false,
+                &connected[0]));
+            port = std::to_string(source->get_host_port());
+        }
+        else
+        {
+            /* shards start one by one, the first picks the port */
+            pool.reset(new MiracReactorPool(shards));
+            pool->Start([&] (MiracReactor *shard_reactor, unsigned int shard) {
+                auto shard_source = std::make_shared<LoadSource>(shard_reactor,
+                    port, sessions, true, &connected[shard]);
+                port = std::to_string(shard_source->get_host_port());
+                return shard_source;
+            });
+        }
+
+        std::vector<LoadClient> clients(sessions);
+        std::vector<double> latencies;
+        latencies.reserve(sessions * rounds);
+        int finished = 0;
+        bool timed_out = false;
+
+        auto start = Clock::now();
+        for (auto &client : clients)
+        {
+            LoadClient *c = &client;
+            c->network.reset(new MiracNetwork);
+            c->cseq = 0;
+            c->connected = c->network->Connect("127.0.0.1", port.c_str());
+            if (c->connected)
+            {
+                c->sent_at = Clock::now();
+                c->network->Send(options_request(++c->cseq));
+            }
+
+            reactor.AddWatch(c->network->GetHandle(),
+                MiracReactor::READABLE | MiracReactor::WRITABLE,
+                [&, c] (int, unsigned int events) {
+                    if (!c->connected)
+                    {
+                        if (!(events & MiracReactor::WRITABLE) ||
+                            !c->network->Connect(NULL, NULL))
+                            return true;
+                        c->connected = true;
+                        c->sent_at = Clock::now();
+                        c->network->Send(options_request(++c->cseq));
+                    }
+                    if (events & MiracReactor::WRITABLE)
+                        c->network->Send();
+
+                    const char *msg;
+                    size_t length;
+                    while (c->network->Receive(&msg, &length))
+                    {
+                        std::chrono::duration<double, std::micro> elapsed =
+                            Clock::now() - c->sent_at;
+                        latencies.push_back(elapsed.count());
+                        if (c->cseq == rounds)
+                        {
+                            if (++finished == sessions)
+                                reactor.Quit();
+                            return false;
+                        }
+                        c->sent_at = Clock::now();
+                        c->network->Send(options_request(++c->cseq));
+                    }
+                    return true;
+                });
+        }
+
+        reactor.AddTimeout(30000, [&] () {
+            timed_out = true;
+            reactor.Quit();
+            return false;
+        });
+        reactor.Run();
+        std::chrono::duration<double, std::milli> total = Clock::now() - start;
+
+        if (pool)
+            pool->Stop();
+        size_t served = 0;
+        for (size_t count : connected)
+            served += count;
+
+        if (timed_out)
+        {
+            g_warning("timed out: %zu sessions connected, %d finished",
+                served, finished);
+            return 1;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0;
+        for (double latency : latencies)
+            sum += latency;
+        printf("%d sessions x %d round trips in %.1f ms (%zu served by %d shards)\n",
+            sessions, rounds, total.count(), served, std::max(shards, 1));
+        printf("latency mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            sum / latencies.size(), latencies[latencies.size() / 2],
+            latencies[latencies.size() * 99 / 100], latencies.back());
+
+        return served == static_cast<size_t>(sessions) ? 0 : 1;
+    }
+    catch (std::exception &x)
+    {
+        g_warning("exception: %s", x.what());
+    }
+    return 1;
+}
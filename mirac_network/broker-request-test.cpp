@@ -0,0 +1,286 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <glib.h>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mirac-broker.hpp"
+#include "mirac-epoll-reactor.hpp"
+#include "options.h"
+#include "reply.h"
+
+/* Runs a source and a sink broker against each other on one reactor
+ * and checks how requests and their replies are matched up. */
+
+class TestSource : public MiracBroker
+{
+    public:
+        TestSource (MiracReactor *reactor) :
+            MiracBroker("0", reactor) {}
+
+        /* what a keep-alive or trigger timer does, the sink does not
+         * answer it */
+        void SendUnsolicited ()
+            {
+                WFD::Options request("*");
+                request.header().set_cseq(1000);
+                send(request);
+            }
+
+        void Reply (int cseq, int response_code)
+            {
+                WFD::Reply reply(response_code);
+                reply.header().set_cseq(cseq);
+                send(reply);
+            }
+
+        /* when set, requests are passed here instead of being answered
+         * right away */
+        std::function<void (int cseq)> hold;
+
+    private:
+        void got_message (std::shared_ptr<WFD::Message> message) override
+            {
+                if (hold)
+                    hold(message->header().cseq());
+                else
+                    Reply(message->header().cseq(), 200);
+            }
+};
+
+class TestSink : public MiracBroker
+{
+    public:
+        TestSink (MiracReactor *reactor, const std::string &port,
+                  const std::function<void ()> &connected) :
+            MiracBroker("127.0.0.1", port, reactor),
+            messages(0),
+            connected(connected) {}
+
+        void Request (const ReplyHandler &handler, unsigned int timeout_ms)
+            {
+                WFD::Options request("*");
+                send_request(request, handler, timeout_ms);
+            }
+
+        size_t Pending () const
+            { return pending_requests(); }
+
+        /* messages that reached got_message() */
+        int messages;
+        std::function<void ()> disconnected;
+
+    private:
+        void got_message (std::shared_ptr<WFD::Message>) override
+            { messages++; }
+        void on_connected () override
+            { connected(); }
+        void on_disconnected () override
+            {
+                if (disconnected)
+                    disconnected();
+            }
+
+        std::function<void ()> connected;
+};
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (0)
+
+/* the source sends from a timer while the sink's request is on its way;
+ * with a completion based transport that send must not swallow the
+ * wakeup for the request */
+static bool test_send_from_timer ()
+{
+    MiracEpollReactor reactor;
+    TestSource source(&reactor);
+    std::unique_ptr<TestSink> sink;
+    std::vector<int> replies;
+    const size_t rounds = 50;
+
+    std::function<void ()> next = [&] () {
+        reactor.AddTimeout(1, [&] () {
+            sink->Request([&] (std::shared_ptr<WFD::Reply> reply) {
+                replies.push_back(reply ? reply->response_code() : 0);
+                if (!reply || replies.size() == rounds)
+                    reactor.Quit();
+                else
+                    next();
+            }, 1000);
+            source.SendUnsolicited();
+            return false;
+        });
+    };
+
+    sink.reset(new TestSink(&reactor, std::to_string(source.get_host_port()),
+                            next));
+    reactor.AddTimeout(10000, [&] () {
+        reactor.Quit();
+        return false;
+    });
+    reactor.Run();
+
+    CHECK(replies.size() == rounds);
+    for (int code : replies)
+        CHECK(code == 200);
+    return true;
+}
+
+/* replies arrive out of order and with an unknown CSeq, and the last
+ * request is never answered */
+static bool test_reply_order ()
+{
+    MiracEpollReactor reactor;
+    TestSource source(&reactor);
+    std::unique_ptr<TestSink> sink;
+    /* request number and the response code its handler got */
+    std::vector<std::pair<int, int>> replies;
+    std::vector<int> held;
+
+    auto handler = [&] (int request) {
+        return [&, request] (std::shared_ptr<WFD::Reply> reply) {
+            replies.push_back(std::make_pair(request,
+                                             reply ? reply->response_code() : 0));
+            if (!reply)
+                reactor.Quit();
+        };
+    };
+
+    source.hold = [&] (int cseq) {
+        held.push_back(cseq);
+        if (held.size() < 3)
+            return;
+        source.Reply(held[2] + 100, 500);
+        source.Reply(held[1], 202);
+        source.Reply(held[0], 201);
+    };
+    sink.reset(new TestSink(&reactor, std::to_string(source.get_host_port()),
+                            [&] () {
+        sink->Request(handler(1), 1000);
+        sink->Request(handler(2), 1000);
+        sink->Request(handler(3), 100);
+    }));
+    reactor.AddTimeout(10000, [&] () {
+        reactor.Quit();
+        return false;
+    });
+    reactor.Run();
+
+    CHECK(held.size() == 3);
+    CHECK(replies.size() == 3);
+    CHECK(replies[0] == std::make_pair(2, 202));
+    CHECK(replies[1] == std::make_pair(1, 201));
+    CHECK(replies[2] == std::make_pair(3, 0));
+    CHECK(sink->Pending() == 0);
+    /* the stray reply is dropped, not passed on */
+    CHECK(sink->messages == 0);
+    return true;
+}
+
+/* losing the connection drops the requests in flight without calling
+ * their handlers, not even once their timeouts would have expired */
+static bool test_close_drops_pending ()
+{
+    MiracEpollReactor reactor;
+    std::unique_ptr<TestSource> source(new TestSource(&reactor));
+    std::unique_ptr<TestSink> sink;
+    int replies = 0;
+    int held = 0;
+    size_t pending = 0;
+    bool disconnected = false;
+
+    source->hold = [&] (int) {
+        if (++held < 2)
+            return;
+        pending = sink->Pending();
+        /* not from within the source's own callback */
+        reactor.AddTimeout(1, [&] () {
+            source.reset();
+            return false;
+        });
+    };
+    sink.reset(new TestSink(&reactor, std::to_string(source->get_host_port()),
+                            [&] () {
+        for (int i = 0; i < 2; i++)
+            sink->Request([&] (std::shared_ptr<WFD::Reply>) {
+                replies++;
+            }, 100);
+    }));
+    sink->disconnected = [&] () {
+        disconnected = true;
+        reactor.AddTimeout(300, [&] () {
+            reactor.Quit();
+            return false;
+        });
+    };
+    reactor.AddTimeout(10000, [&] () {
+        reactor.Quit();
+        return false;
+    });
+    reactor.Run();
+
+    CHECK(pending == 2);
+    CHECK(disconnected);
+    CHECK(sink->Pending() == 0);
+    CHECK(replies == 0);
+    return true;
+}
+
+int main ()
+{
+    typedef bool (*Test)();
+    const struct {
+        const char *name;
+        Test test;
+    } tests[] = {
+        { "send_from_timer", test_send_from_timer },
+        { "reply_order", test_reply_order },
+        { "close_drops_pending", test_close_drops_pending },
+    };
+
+    int failed = 0;
+    for (const auto &test : tests)
+    {
+        try
+        {
+            bool passed = test.test();
+            printf("%s: %s\n", test.name, passed ? "passed" : "FAILED");
+            failed += !passed;
+        }
+        catch (std::exception &x)
+        {
+            printf("%s: exception %s\n", test.name, x.what());
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
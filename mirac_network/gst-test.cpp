@@ -23,8 +23,12 @@
 
 
 #include <glib.h>
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <glib-unix.h>
 
@@ -40,6 +44,115 @@ static gboolean _sig_handler (gpointer data_ptr)
     return G_SOURCE_CONTINUE;
 }
 
+/* Capture to render latency of a local videotestsrc streamed through the
+ * sink pipeline over loopback. Frames are matched by PTS: the encoder
+ * input and the decoder output differ by a constant offset, which is
+ * taken from the first decoded frame. */
+struct LatencyProbe
+{
+    static const int frame_rate = 30;
+
+    std::mutex mutex;
+    std::map<guint64, gint64> captured;
+    std::vector<gint64> samples;
+    bool have_first;
+    GstClockTime first_pts;
+    guint64 first_index;
+    guint64 total;
+
+    LatencyProbe () : have_first(false), first_pts(0), first_index(0), total(0) {}
+
+    static GstClockTime frame_duration ()
+        { return GST_SECOND / frame_rate; }
+
+    void Captured (GstClockTime pts)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        captured[pts / frame_duration()] = g_get_monotonic_time();
+    }
+
+    void Rendered (GstClockTime pts)
+    {
+        gint64 now = g_get_monotonic_time();
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!have_first) {
+            if (captured.empty())
+                return;
+            have_first = true;
+            first_pts = pts;
+            first_index = captured.begin()->first;
+        }
+        if (pts < first_pts)
+            return;
+
+        guint64 index = first_index + (pts - first_pts + frame_duration() / 2) / frame_duration();
+        auto frame = captured.find(index);
+        if (frame == captured.end())
+            return;
+
+        samples.push_back(now - frame->second);
+        total++;
+        captured.erase(captured.begin(), ++frame);
+    }
+
+    void Report ()
+    {
+        std::vector<gint64> sorted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted.swap(samples);
+        }
+        if (sorted.empty()) {
+            g_print("Latency: no frames rendered yet\n");
+            return;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        g_print("Latency over %zu frames (%" G_GUINT64_FORMAT " total): p50 %.1f ms, p95 %.1f ms, max %.1f ms\n",
+                sorted.size(), total,
+                sorted[sorted.size() / 2] / 1000.0,
+                sorted[sorted.size() * 95 / 100] / 1000.0,
+                sorted.back() / 1000.0);
+    }
+};
+
+static GstPadProbeReturn _capture_probe (GstPad *pad, GstPadProbeInfo *info, gpointer data_ptr)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (buffer && GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)))
+        static_cast<LatencyProbe*>(data_ptr)->Captured(GST_BUFFER_PTS(buffer));
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean _report_latency (gpointer data_ptr)
+{
+    static_cast<LatencyProbe*>(data_ptr)->Report();
+
+    return G_SOURCE_CONTINUE;
+}
+
+static GstElement* _latency_source (int port, LatencyProbe *probe)
+{
+    std::string gst_pipeline =
+        "videotestsrc is-live=true ! video/x-raw,width=1280,height=720,framerate=" +
+        std::to_string(LatencyProbe::frame_rate) + "/1 ! identity name=capture"
+        " ! x264enc tune=zerolatency speed-preset=ultrafast ! mpegtsmux"
+        " ! rtpmp2tpay ! udpsink host=127.0.0.1 port=" + std::to_string(port);
+
+    GstElement *pipeline = gst_parse_launch(gst_pipeline.c_str(), NULL);
+    if (pipeline == NULL)
+        return NULL;
+
+    GstElement *capture = gst_bin_get_by_name(GST_BIN(pipeline), "capture");
+    GstPad *pad = gst_element_get_static_pad(capture, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, _capture_probe, probe, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(capture);
+
+    return pipeline;
+}
+
 
 int main (int argc, char *argv[])
 {
@@ -51,17 +164,33 @@ int main (int argc, char *argv[])
     gchar* wfd_stream_option = NULL;
     gchar* hostname_option = NULL;
     gint port = 0;
+    gboolean playbin = FALSE;
+    gint jitter_latency = -1;
+    gboolean no_drop = FALSE;
+    gboolean sync = FALSE;
+    gint decoder_threads = -1;
+    gint report_interval = 5;
+    gchar* encoder_option = NULL;
+    gboolean batched_send = FALSE;
     
     GOptionEntry main_entries[] =
     {
-        { "device", 0, 0, G_OPTION_ARG_STRING, &wfd_device_option, "Specify WFD device type: testsource or sink", "(testsource|sink)"},
+        { "device", 0, 0, G_OPTION_ARG_STRING, &wfd_device_option, "Specify WFD device type: testsource, sink or latency (local source streamed to a sink)", "(testsource|sink|latency)"},
         { "stream", 0, 0, G_OPTION_ARG_STRING, &wfd_stream_option, "Specify WFD stream type for testsource: audio, video, both or desktop capture", "(audio|video|both|desktop)"},
         { "hostname", 0, 0, G_OPTION_ARG_STRING, &hostname_option, "Specify optional hostname or ip address to stream to or listen on", "host"},
         { "port", 0, 0, G_OPTION_ARG_INT, &port, "Specify optional UDP port number to stream to or listen on", "port"},
+        { "playbin", 0, 0, G_OPTION_ARG_NONE, &playbin, "Use playbin in the sink instead of the low latency pipeline", NULL},
+        { "latency", 0, 0, G_OPTION_ARG_INT, &jitter_latency, "Sink jitter buffer latency", "ms"},
+        { "no-drop", 0, 0, G_OPTION_ARG_NONE, &no_drop, "Keep packets that arrive later than the sink latency", NULL},
+        { "sync", 0, 0, G_OPTION_ARG_NONE, &sync, "Render frames on the pipeline clock in the sink", NULL},
+        { "decoder-threads", 0, 0, G_OPTION_ARG_INT, &decoder_threads, "Sink decoder threads, 0 for automatic", "n"},
+        { "encoder", 0, 0, G_OPTION_ARG_STRING, &encoder_option, "Specify the encoder preset of the desktop stream", "(lowest-latency|balanced|max-quality)"},
+        { "batched-send", 0, 0, G_OPTION_ARG_NONE, &batched_send, "Send the testsource RTP packets of a frame in batches instead of with udpsink", NULL},
+        { "report", 0, 0, G_OPTION_ARG_INT, &report_interval, "Seconds between latency reports", "s"},
         { NULL }
     };
 
-    context = g_option_context_new ("- WFD source/sink demo application\n\nExample:\ngst-test --device=testsource --stream=both --hostname=127.0.0.1 --port=5000\ngst-test --device=sink --port=5000");
+    context = g_option_context_new ("- WFD source/sink demo application\n\nExample:\ngst-test --device=testsource --stream=both --hostname=127.0.0.1 --port=5000\ngst-test --device=sink --port=5000\ngst-test --device=latency --latency=20");
     g_option_context_add_main_entries (context, main_entries, NULL);
     
    if (!g_option_context_parse (context, &argc, &argv, &error)) {
@@ -81,6 +210,14 @@ int main (int argc, char *argv[])
     else if (g_strcmp0(wfd_stream_option, "desktop") == 0)
         wfd_stream = WFD_DESKTOP;
 
+    MiracEncoderProfile::Preset encoder_preset = MiracEncoderProfile::BALANCED;
+    if (encoder_option &&
+        !MiracEncoderProfile::ParsePreset(encoder_option, encoder_preset)) {
+        g_print ("unknown encoder preset: %s\n", encoder_option);
+        exit (1);
+    }
+    g_free(encoder_option);
+
     std::string hostname;
     if (hostname_option)
         hostname = hostname_option;
@@ -88,18 +225,45 @@ int main (int argc, char *argv[])
     g_free(wfd_stream_option);
     g_free(hostname_option);
 
+    MiracGstSink::Options sink_options;
+    sink_options.low_latency = !playbin;
+    if (jitter_latency >= 0)
+        sink_options.latency_ms = jitter_latency;
+    sink_options.drop_on_latency = !no_drop;
+    sink_options.sync = sync;
+    if (decoder_threads >= 0)
+        sink_options.decoder_threads = decoder_threads;
+
     gst_init (&argc, &argv);
 
     std::unique_ptr<MiracGstSink> sink_pipeline;
     std::unique_ptr<MiracGstTestSource> source_pipeline;
+    LatencyProbe latency_probe;
+    GstElement *latency_source = NULL;
 
     if (g_strcmp0(wfd_device_option, "testsource") == 0) {
-        source_pipeline.reset(new MiracGstTestSource(wfd_stream, hostname, port));
+        source_pipeline.reset(new MiracGstTestSource(wfd_stream, hostname, port,
+                                                     MiracEncoderProfile(encoder_preset),
+                                                     batched_send));
         source_pipeline->SetState(GST_STATE_PLAYING);
         g_print("Source UDP port: %d\n", source_pipeline->UdpSourcePort());
     } else if (g_strcmp0(wfd_device_option, "sink") == 0) {
-        sink_pipeline.reset(new MiracGstSink(hostname, port));
+        sink_pipeline.reset(new MiracGstSink(hostname, port, sink_options));
         g_print("Listening on port %d\n", sink_pipeline->sink_udp_port());
+    } else if (g_strcmp0(wfd_device_option, "latency") == 0) {
+        sink_pipeline.reset(new MiracGstSink("127.0.0.1", port, sink_options));
+        LatencyProbe *probe = &latency_probe;
+        if (!sink_pipeline->set_frame_callback([probe] (GstClockTime pts) { probe->Rendered(pts); })) {
+            g_print("Latency report needs the low latency sink pipeline\n");
+            exit (1);
+        }
+        latency_source = _latency_source(sink_pipeline->sink_udp_port(), probe);
+        if (latency_source == NULL) {
+            g_print("Failed to create the latency test source\n");
+            exit (1);
+        }
+        gst_element_set_state(latency_source, GST_STATE_PLAYING);
+        g_timeout_add_seconds(std::max(report_interval, 1), _report_latency, probe);
     }
 
     g_free(wfd_device_option);
@@ -111,6 +275,12 @@ int main (int argc, char *argv[])
     g_main_loop_run(ml);
 
     g_main_loop_unref(ml);
+
+    if (latency_source) {
+        gst_element_set_state(latency_source, GST_STATE_NULL);
+        gst_object_unref(latency_source);
+        latency_probe.Report();
+    }
     
     return 0;
 }
@@ -21,163 +21,357 @@
  * 02110-1301 USA
  */
 
-#include <glib-unix.h>
+#include <glib.h>
 
 #include "mirac-broker.hpp"
 
-/* static C callback wrapper */
-gboolean MiracBroker::send_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+MiracBroker::Session *MiracBroker::find_session(SessionId id) const
 {
-    auto broker = reinterpret_cast<MiracBroker*> (data_ptr);
-    return broker->send_cb(fd, condition);
+    auto it = sessions_.find(id);
+    return it == sessions_.end() ? NULL : it->second.get();
 }
 
-/* static C callback wrapper */
-gboolean MiracBroker::receive_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+bool MiracBroker::send_cb (SessionId id)
 {
-    auto broker = reinterpret_cast<MiracBroker*> (data_ptr);
-    return broker->receive_cb(fd, condition);
-}
+    Session *session = find_session(id);
+    if (!session)
+        return false;
 
-/* static C callback wrapper */
-gboolean MiracBroker::listen_cb (gint fd, GIOCondition condition, gpointer data_ptr)
-{
-    auto broker = reinterpret_cast<MiracBroker*> (data_ptr);
-    return broker->listen_cb(fd, condition);
-}
-
-/* static C callback wrapper */
-gboolean MiracBroker::connect_cb (gint fd, GIOCondition condition, gpointer data_ptr)
-{
-    auto broker = reinterpret_cast<MiracBroker*> (data_ptr);
-    return broker->connect_cb(fd, condition);
-}
-
-gboolean MiracBroker::send_cb (gint fd, GIOCondition condition)
-{
     try {
-        return connection_->Send() ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+        if (!session->connection->Send())
+            return true;
     } catch (std::exception &x) {
         g_warning("exception: %s", x.what());
     }
-    return G_SOURCE_REMOVE;
+    session->send_watch = 0;
+    return false;
 }
 
 
-gboolean MiracBroker::receive_cb (gint fd, GIOCondition condition)
+bool MiracBroker::receive_cb (SessionId id)
 {
+    Session *session = find_session(id);
+    if (!session)
+        return false;
+
     try
     {
-        std::string msg;
-        if (message_ && message_->header().content_length() > 0)
-            handle_body(msg);
-        else
-            handle_header(msg);
+        /* still waiting for the rest of the payload */
+        if (session->message && !handle_body(session))
+            return true;
+        /* with an edge-triggered reactor there is no further wakeup for
+         * data that is already buffered, so always drain it */
+        handle_header(session);
 
     } catch (std::exception &x) {
         g_warning("exception: %s", x.what());
         /* Is this correct for both connection lost and recv() errors? */
-        return G_SOURCE_REMOVE;
+        session->receive_watch = 0;
+        close_session(id);
+        return false;
     }
-    return G_SOURCE_CONTINUE;
+    return true;
 }
 
-void MiracBroker::handle_header(std::string msg)
+void MiracBroker::dispatch(Session *session, std::shared_ptr<WFD::Message> message)
 {
-    while (connection_->Receive(msg)) {
-        try {
-            driver_.parse_header(msg);
-            message_ = driver_.parsed_message();
-            if (message_ && message_->header().content_length() == 0)
-                got_message (message_);
-            if (message_ && message_->header().content_length())
-                handle_body(msg);
-        } catch (std::exception &x) {
-            g_message("Failed to parse received header: %s\n%s", x.what(), msg.c_str());
-        }
+    current_session_ = session->id;
+    if (message->type() != WFD::Message::MessageTypeReply) {
+        got_message(message);
+        return;
+    }
+
+    auto it = session->pending.find(message->header().cseq());
+    if (it == session->pending.end()) {
+        g_message("Dropping reply with unexpected CSeq %d", message->header().cseq());
+        return;
     }
+    /* the handler may send the next request or close the session */
+    ReplyHandler handler = it->second.handler;
+    reactor_->Remove(it->second.timeout);
+    session->pending.erase(it);
+    handler(std::static_pointer_cast<WFD::Reply>(message));
 }
 
-void MiracBroker::handle_body(std::string msg)
+void MiracBroker::request_timeout_cb(SessionId id, int cseq)
 {
-    if (connection_->Receive(msg, message_->header().content_length())) {
+    Session *session = find_session(id);
+    if (!session)
+        return;
+    auto it = session->pending.find(cseq);
+    if (it == session->pending.end())
+        return;
+
+    g_message("No reply to request with CSeq %d", cseq);
+    ReplyHandler handler = it->second.handler;
+    session->pending.erase(it);
+    current_session_ = id;
+    handler(NULL);
+}
+
+void MiracBroker::handle_header(Session *session)
+{
+    const char *msg;
+    size_t length;
+
+    while (session->connection->Receive(&msg, &length)) {
         try {
-            driver_.parse_payload(msg);
-            got_message (driver_.parsed_message());
+            session->driver.parse_header(msg, length);
         } catch (std::exception &x) {
-            g_message("Failed to parse received payload\n%s", msg.c_str());
+            g_message("Failed to parse received header: %s\n%.*s", x.what(),
+                      static_cast<int>(length), msg);
+            continue;
         }
 
-        message_ = NULL;
+        /* msg is only valid until the next Receive() or ReceiveBody(),
+         * which handle_body() may already do */
+        try {
+            auto message = session->driver.parsed_message();
+            if (message && message->header().content_length() == 0)
+                dispatch (session, message);
+            else if (message) {
+                session->message = message;
+                /* the rest of the payload has not arrived yet */
+                if (!handle_body(session))
+                    break;
+            }
+        } catch (std::exception &x) {
+            session->message = NULL;
+            g_message("Failed to handle received message: %s", x.what());
+        }
     }
 }
 
-gboolean MiracBroker::listen_cb (gint fd, GIOCondition condition)
+/* returns false while the payload is incomplete */
+bool MiracBroker::handle_body(Session *session)
 {
+    const char *msg;
+    size_t length = session->message->header().content_length();
+
+    if (!session->connection->ReceiveBody(&msg, length))
+        return false;
+
+    session->message = NULL;
     try {
-        connection_.reset(network_->Accept());
-        g_message("connection from: %s", connection_->GetPeerAddress().c_str());
-        g_unix_fd_add(connection_->GetHandle(), G_IO_IN, receive_cb, this);
-        on_connected();
+        session->driver.parse_payload(msg, length);
     } catch (std::exception &x) {
-        g_warning("exception: %s", x.what());
+        g_message("Failed to parse received payload\n%.*s",
+                  static_cast<int>(length), msg);
+        return true;
     }
+    dispatch (session, session->driver.parsed_message());
+    return true;
+}
+
+void MiracBroker::add_session(MiracNetwork *connection)
+{
+    std::unique_ptr<Session> session(new Session);
+    SessionId id = next_session_++;
+
+    session->id = id;
+    session->connection.reset(connection);
+    session->send_watch = 0;
+    session->send_cseq = 1;
+    session->receive_watch = reactor_->AddWatch(connection->GetPollHandle(),
+                                                MiracReactor::READABLE,
+                                                [this, id] (int, unsigned int) {
+                                                    return receive_cb(id);
+                                                });
+    sessions_[id] = std::move(session);
 
-    return G_SOURCE_CONTINUE;
+    current_session_ = id;
+    on_connected();
 }
 
-gboolean MiracBroker::connect_cb (gint fd, GIOCondition condition)
+/* requests in flight are dropped without calling their handlers */
+void MiracBroker::remove_watches(Session *session)
+{
+    if (session->receive_watch)
+        reactor_->Remove(session->receive_watch);
+    if (session->send_watch)
+        reactor_->Remove(session->send_watch);
+    for (auto &it : session->pending)
+        reactor_->Remove(it.second.timeout);
+    session->receive_watch = 0;
+    session->send_watch = 0;
+    session->pending.clear();
+}
+
+void MiracBroker::close_session(SessionId id)
+{
+    auto it = sessions_.find(id);
+    if (it == sessions_.end())
+        return;
+
+    /* watches go before the connection's fd is closed */
+    remove_watches(it->second.get());
+
+    current_session_ = id;
+    on_disconnected();
+    sessions_.erase(it);
+
+    if (connector_ && sessions_.empty())
+        connector_->Start();
+}
+
+bool MiracBroker::listen_cb ()
+{
+    /* drain the backlog, an edge-triggered reactor reports it once */
+    for (;;) {
+        try {
+            MiracNetwork *connection = network_->Accept();
+            if (!connection)
+                break;
+            g_message("connection from: %s", connection->GetPeerAddress().c_str());
+
+            if (max_sessions_ && sessions_.size() >= max_sessions_) {
+                /* ids only grow, so the smallest one is the oldest */
+                auto oldest = sessions_.begin();
+                for (auto it = sessions_.begin(); it != sessions_.end(); ++it)
+                    if (it->first < oldest->first)
+                        oldest = it;
+                close_session(oldest->first);
+            }
+            add_session(connection);
+        } catch (std::exception &x) {
+            g_warning("exception: %s", x.what());
+            break;
+        }
+    }
+
+    return true;
+}
+
+void MiracBroker::connected_cb (MiracNetwork *connection)
 {
     try {
-        if (!network_->Connect(NULL, NULL))
-            return G_SOURCE_CONTINUE;
-        g_message("connection success to: %s", network_->GetPeerAddress().c_str());
-        connection_.reset(network_.release());
-        g_unix_fd_add(connection_->GetHandle(), G_IO_IN, receive_cb, this);
-        on_connected();
+        g_message("connection success to: %s", connection->GetPeerAddress().c_str());
     } catch (std::exception &x) {
         g_warning("exception: %s", x.what());
     }
-    return G_SOURCE_REMOVE;
+    add_session(connection);
 }
 
 void MiracBroker::send(WFD::Message& message) const
 {
-     if (connection_ && !connection_->Send(message.to_string()))
-         g_unix_fd_add(connection_->GetHandle(), G_IO_OUT, send_cb, (void*)this);
+    send(current_session_, message);
+}
+
+void MiracBroker::send(SessionId id, WFD::Message& message) const
+{
+     Session *session = find_session(id);
+     if (!session)
+         return;
+
+     std::string header;
+     std::string payload;
+     message.serialize(header, payload);
+     /* the queued data is flushed by a single write watch, a slow peer
+      * must not stack one up per message */
+     if (!session->connection->Send(std::move(header), std::move(payload)) &&
+         !session->send_watch) {
+         auto broker = const_cast<MiracBroker*>(this);
+         /* completion based transports signal finished sends as
+          * readable */
+         unsigned int events = session->connection->IsCompletionBased() ?
+             MiracReactor::READABLE : MiracReactor::WRITABLE;
+         session->send_watch = reactor_->AddWatch(session->connection->GetPollHandle(),
+                                                  events,
+                                                  [broker, id] (int, unsigned int) {
+                                                      return broker->send_cb(id);
+                                                  });
+     }
+}
+
+void MiracBroker::send_request(WFD::Message& request, const ReplyHandler& handler,
+                               unsigned int timeout_ms)
+{
+    Session *session = find_session(current_session_);
+    if (!session)
+        return;
+
+    SessionId id = session->id;
+    int cseq = session->send_cseq++;
+    request.header().set_cseq(cseq);
+
+    PendingRequest& pending = session->pending[cseq];
+    pending.handler = handler;
+    pending.timeout = reactor_->AddTimeout(timeout_ms,
+                                           [this, id, cseq] () {
+                                               request_timeout_cb(id, cseq);
+                                               return false;
+                                           });
+    send(id, request);
+}
+
+size_t MiracBroker::pending_requests() const
+{
+    Session *session = find_session(current_session_);
+    return session ? session->pending.size() : 0;
 }
 
 unsigned short MiracBroker::get_host_port() const
 {
-    return network_->GetHostPort();
+    if (network_)
+        return network_->GetHostPort();
+    Session *session = find_session(current_session_);
+    return session ? session->connection->GetHostPort() : 0;
 }
 
 std::string MiracBroker::get_peer_address() const
 {
-    return connection_->GetPeerAddress();
+    Session *session = find_session(current_session_);
+    return session ? session->connection->GetPeerAddress() : std::string();
+}
+
+void MiracBroker::set_max_sessions(size_t max_sessions)
+{
+    max_sessions_ = max_sessions;
 }
 
-MiracBroker::MiracBroker (const std::string& listen_port)
+MiracBroker::MiracBroker (const std::string& listen_port,
+                          MiracReactor *reactor, int backlog,
+                          bool reuse_port,
+                          const MiracNetwork::Options& socket_options) :
+    current_session_(0),
+    next_session_(1),
+    max_sessions_(1),
+    reactor_(reactor ? reactor : MiracReactor::Default()),
+    network_watch_(0)
 {
     network_.reset (new MiracNetwork());
+    network_->SetOptions(socket_options);
 
-    network_->Bind(NULL, listen_port.c_str());
-    g_unix_fd_add(network_->GetHandle(), G_IO_IN,
-                  MiracBroker::listen_cb, this);
+    network_->Bind(NULL, listen_port.c_str(), backlog, reuse_port);
+    network_watch_ = reactor_->AddWatch(network_->GetHandle(),
+                                        MiracReactor::READABLE,
+                                        [this] (int, unsigned int) {
+                                            return listen_cb();
+                                        });
 }
 
-MiracBroker::MiracBroker(const std::string& peer_address, const std::string& peer_port)
+MiracBroker::MiracBroker(const std::string& peer_address, const std::string& peer_port,
+                         MiracReactor *reactor,
+                         const MiracConnector::Options& options) :
+    current_session_(0),
+    next_session_(1),
+    max_sessions_(1),
+    reactor_(reactor ? reactor : MiracReactor::Default()),
+    network_watch_(0)
 {
-    network_.reset(new MiracNetwork());
-
-    if (network_->Connect(peer_address.c_str(), peer_port.c_str())) {
-        g_unix_fd_add(network_->GetHandle(), G_IO_OUT, MiracBroker::send_cb, this);
-    } else {
-        g_unix_fd_add(network_->GetHandle(), G_IO_OUT, MiracBroker::connect_cb, this);
-    }
+    connector_.reset(new MiracConnector(reactor_, peer_address, peer_port,
+                                        [this] (MiracNetwork *connection) {
+                                            connected_cb(connection);
+                                        },
+                                        options));
+    connector_->Start();
 }
 
 MiracBroker::~MiracBroker ()
 {
+    if (network_watch_)
+        reactor_->Remove(network_watch_);
+    /* subclasses are already gone, so no on_disconnected() */
+    for (auto &it : sessions_)
+        remove_watches(it.second.get());
 }
-
@@ -25,11 +25,16 @@
 #ifndef MIRAC_BROKER_HPP
 #define MIRAC_BROKER_HPP
 
-#include <glib.h>
+#include <functional>
+#include <map>
 #include <memory>
+#include <unordered_map>
 
+#include "mirac-connector.hpp"
 #include "mirac-network.hpp"
+#include "mirac-reactor.hpp"
 #include "driver.h"
+#include "reply.h"
 
 class MiracBrokerObserver
 {
@@ -40,38 +45,98 @@ class MiracBrokerObserver
 class MiracBroker
 {
     public:
-        MiracBroker (const std::string& listen_port);
-        MiracBroker(const std::string& peer_address, const std::string& peer_port);
+        typedef unsigned int SessionId;
+        /* gets the reply to a request, or NULL when none arrived in
+         * time */
+        typedef std::function<void (std::shared_ptr<WFD::Reply> reply)> ReplyHandler;
+
+        /* reactor defaults to MiracReactor::Default() and must outlive
+         * the broker, backlog is the listen() queue length; reuse_port
+         * lets one broker per MiracReactorPool shard share the port;
+         * socket_options apply to every accepted connection */
+        MiracBroker (const std::string& listen_port,
+                     MiracReactor *reactor = NULL, int backlog = 1,
+                     bool reuse_port = false,
+                     const MiracNetwork::Options& socket_options = MiracNetwork::Options());
+        /* keeps connecting until the peer accepts, and again whenever
+         * the connection is lost */
+        MiracBroker(const std::string& peer_address, const std::string& peer_port,
+                    MiracReactor *reactor = NULL,
+                    const MiracConnector::Options& options = MiracConnector::Options());
         virtual ~MiracBroker ();
         unsigned short get_host_port() const;
         std::string get_peer_address() const;
 
+        /* number of peers a listening broker serves at once, 0 for no
+         * limit; when full the oldest session makes room for a new
+         * connection. The default of 1 keeps only the latest peer. */
+        void set_max_sessions(size_t max_sessions);
+        size_t session_count() const { return sessions_.size(); }
+
     protected:
         virtual void got_message(std::shared_ptr<WFD::Message> message) = 0;
+        /* sends to current_session() */
         void send(WFD::Message& message) const;
+        void send(SessionId session, WFD::Message& message) const;
+        /* sends request to current_session() with the session's next
+         * CSeq and passes the reply with that CSeq to handler instead of
+         * got_message(); any number of requests may be in flight */
+        void send_request(WFD::Message& request, const ReplyHandler& handler,
+                          unsigned int timeout_ms = 5000);
+        /* requests of current_session() still waiting for a reply */
+        size_t pending_requests() const;
         virtual void on_connected() {};
+        virtual void on_disconnected() {};
+
+        /* the session got_message(), on_connected() and
+         * on_disconnected() are called for, afterwards the one that
+         * was last active */
+        SessionId current_session() const { return current_session_; }
 
     private:
-        static gboolean send_cb (gint fd, GIOCondition condition, gpointer data_ptr);
-        static gboolean receive_cb (gint fd, GIOCondition condition, gpointer data_ptr);
-        static gboolean listen_cb (gint fd, GIOCondition condition, gpointer data_ptr);
-        static gboolean connect_cb (gint fd, GIOCondition condition, gpointer data_ptr);
+        struct PendingRequest {
+            ReplyHandler handler;
+            MiracReactor::Id timeout;
+        };
 
-        gboolean send_cb (gint fd, GIOCondition condition);
-        gboolean receive_cb (gint fd, GIOCondition condition);
-        gboolean listen_cb (gint fd, GIOCondition condition);
-        gboolean connect_cb (gint fd, GIOCondition condition);
+        struct Session {
+            SessionId id;
+            std::unique_ptr<MiracNetwork> connection;
+            /* each session has its own parser state */
+            WFD::Driver driver;
+            std::shared_ptr<WFD::Message> message;
+            MiracReactor::Id receive_watch;
+            /* at most one write watch, however many sends are queued */
+            MiracReactor::Id send_watch;
+            /* CSeq of the next request, and the requests in flight */
+            int send_cseq;
+            std::map<int, PendingRequest> pending;
+        };
 
-        void handle_body(const std::string msg);
-        void handle_header(const std::string msg);
+        bool send_cb (SessionId id);
+        bool receive_cb (SessionId id);
+        bool listen_cb ();
+        void request_timeout_cb (SessionId id, int cseq);
+        void connected_cb (MiracNetwork *connection);
 
-        WFD::Driver driver_;
-        std::shared_ptr<WFD::Message> message_;
+        Session *find_session(SessionId id) const;
+        void add_session(MiracNetwork *connection);
+        void close_session(SessionId id);
+        void remove_watches(Session *session);
+        void dispatch(Session *session, std::shared_ptr<WFD::Message> message);
+        bool handle_body(Session *session);
+        void handle_header(Session *session);
 
         std::unique_ptr<MiracNetwork> network_;
-        std::unique_ptr<MiracNetwork> connection_;
+        std::unique_ptr<MiracConnector> connector_;
+        std::unordered_map<SessionId, std::unique_ptr<Session>> sessions_;
+        SessionId current_session_;
+        SessionId next_session_;
+        size_t max_sessions_;
+
+        MiracReactor *reactor_;
+        MiracReactor::Id network_watch_;
 };
 
 
 #endif  /* MIRAC_BROKER_HPP */
-
@@ -0,0 +1,263 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <cstring>
+#include <algorithm>
+
+#include <netdb.h>
+
+#include "mirac-connector.hpp"
+
+MiracConnector::MiracConnector (MiracReactor *reactor,
+                                const std::string &address,
+                                const std::string &service,
+                                const ConnectedCallback &callback,
+                                const Options &options) :
+    reactor(reactor),
+    address(address),
+    service(service),
+    callback(callback),
+    options(options),
+    next_address(0),
+    next_attempt(1),
+    delay_timer(0),
+    retry_timer(0),
+    backoff(options.initial_backoff),
+    random(std::random_device()())
+{
+}
+
+MiracConnector::~MiracConnector ()
+{
+    Cancel();
+}
+
+void MiracConnector::Start ()
+{
+    Cancel();
+    backoff = options.initial_backoff;
+    StartRound();
+}
+
+void MiracConnector::Stop ()
+{
+    Cancel();
+}
+
+bool MiracConnector::IsRunning () const
+{
+    return !attempts.empty() || delay_timer || retry_timer;
+}
+
+/* note, getaddrinfo() blocks while a name is looked up, numeric
+ * addresses as used for Wi-Fi Display peers resolve at once */
+void MiracConnector::Resolve ()
+{
+    struct addrinfo addr_hint;
+    struct addrinfo *addr_res = NULL;
+
+    addresses.clear();
+    next_address = 0;
+
+    memset(&addr_hint, 0x00, sizeof(addr_hint));
+    addr_hint.ai_socktype = SOCK_STREAM;
+    /* a name that does not resolve yet counts as a failed round */
+    if (getaddrinfo(address.c_str(), service.c_str(), &addr_hint, &addr_res))
+        return;
+
+    /* alternate between the address families, so that e.g. an
+     * unreachable IPv6 peer delays IPv4 by attempt_delay at most */
+    std::vector<Address> preferred;
+    std::vector<Address> other;
+    for (struct addrinfo *ai = addr_res; ai; ai = ai->ai_next)
+    {
+        Address addr;
+        if (ai->ai_addrlen > sizeof(addr.storage))
+            continue;
+        memcpy(&addr.storage, ai->ai_addr, ai->ai_addrlen);
+        addr.length = ai->ai_addrlen;
+        if (ai->ai_family == addr_res->ai_family)
+            preferred.push_back(addr);
+        else
+            other.push_back(addr);
+    }
+    freeaddrinfo(addr_res);
+
+    for (size_t i = 0; i < std::max(preferred.size(), other.size()); i++)
+    {
+        if (i < preferred.size())
+            addresses.push_back(preferred[i]);
+        if (i < other.size())
+            addresses.push_back(other[i]);
+    }
+}
+
+void MiracConnector::StartRound ()
+{
+    Resolve();
+    StartAttempt();
+}
+
+void MiracConnector::StartAttempt ()
+{
+    while (next_address < addresses.size())
+    {
+        const Address &addr = addresses[next_address++];
+        std::unique_ptr<MiracNetwork> connection(new MiracNetwork());
+        connection->SetOptions(options.socket);
+
+        /* a connect that completed at once is reported through the
+         * watch as well, so the callback always runs from the reactor */
+        try
+        {
+            connection->ConnectAddress(
+                reinterpret_cast<const struct sockaddr *> (&addr.storage),
+                addr.length);
+        }
+        catch (std::exception &x)
+        {
+            continue;
+        }
+
+        AttemptId id = next_attempt++;
+        std::unique_ptr<Attempt> attempt(new Attempt);
+        attempt->watch = reactor->AddWatch(connection->GetHandle(),
+                                           MiracReactor::WRITABLE,
+                                           [this, id] (int, unsigned int) {
+                                               return AttemptCb(id);
+                                           });
+        attempt->timeout = reactor->AddTimeout(options.attempt_timeout,
+                                               [this, id] () {
+                                                   attempts[id]->timeout = 0;
+                                                   FailAttempt(id);
+                                                   return false;
+                                               });
+        attempt->connection = std::move(connection);
+        attempts[id] = std::move(attempt);
+
+        if (next_address < addresses.size())
+            delay_timer = reactor->AddTimeout(options.attempt_delay,
+                                              [this] () {
+                                                  delay_timer = 0;
+                                                  StartAttempt();
+                                                  return false;
+                                              });
+        return;
+    }
+
+    if (attempts.empty())
+        Retry();
+}
+
+bool MiracConnector::AttemptCb (AttemptId id)
+{
+    auto it = attempts.find(id);
+    if (it == attempts.end())
+        return false;
+
+    Attempt *attempt = it->second.get();
+    try
+    {
+        if (!attempt->connection->FinishConnect())
+            return true;
+    }
+    catch (std::exception &x)
+    {
+        attempt->watch = 0;
+        FailAttempt(id);
+        return false;
+    }
+
+    attempt->watch = 0;
+    Connected(attempt->connection.release());
+    return false;
+}
+
+void MiracConnector::FailAttempt (AttemptId id)
+{
+    RemoveAttempt(id);
+
+    /* no need to wait for the delay once an attempt failed */
+    if (next_address < addresses.size())
+    {
+        if (delay_timer)
+            reactor->Remove(delay_timer);
+        delay_timer = 0;
+        StartAttempt();
+    }
+    else if (attempts.empty())
+    {
+        Retry();
+    }
+}
+
+void MiracConnector::RemoveAttempt (AttemptId id)
+{
+    auto it = attempts.find(id);
+    if (it == attempts.end())
+        return;
+
+    /* watches go before the attempt's socket is closed */
+    if (it->second->watch)
+        reactor->Remove(it->second->watch);
+    if (it->second->timeout)
+        reactor->Remove(it->second->timeout);
+    attempts.erase(it);
+}
+
+void MiracConnector::Connected (MiracNetwork *connection)
+{
+    /* the callback may Start() again or destroy the connector, so it
+     * goes last */
+    Cancel();
+    backoff = options.initial_backoff;
+    callback(connection);
+}
+
+void MiracConnector::Retry ()
+{
+    /* half of the backoff is random, so that sinks which lost the same
+     * source do not come back in lockstep */
+    unsigned int delay = backoff / 2 +
+        std::uniform_int_distribution<unsigned int>(0, backoff - backoff / 2)(random);
+    backoff = std::max(options.initial_backoff,
+                       std::min(backoff * 2, options.max_backoff));
+
+    retry_timer = reactor->AddTimeout(delay,
+                                      [this] () {
+                                          retry_timer = 0;
+                                          StartRound();
+                                          return false;
+                                      });
+}
+
+void MiracConnector::Cancel ()
+{
+    while (!attempts.empty())
+        RemoveAttempt(attempts.begin()->first);
+    if (delay_timer)
+        reactor->Remove(delay_timer);
+    if (retry_timer)
+        reactor->Remove(retry_timer);
+    delay_timer = 0;
+    retry_timer = 0;
+}
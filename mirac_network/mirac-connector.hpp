@@ -0,0 +1,130 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_CONNECTOR_HPP
+#define MIRAC_CONNECTOR_HPP
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "mirac-network.hpp"
+#include "mirac-reactor.hpp"
+
+/* Connects to a peer that may not be there yet. The resolved addresses
+ * are tried in parallel, a new attempt starting whenever the previous
+ * one failed or has not completed within attempt_delay (the "happy
+ * eyeballs" scheme of RFC 8305). When every address failed, the next
+ * round waits for a randomised, exponentially growing backoff. */
+class MiracConnector
+{
+    public:
+        /* takes ownership of the connected socket */
+        typedef std::function<void (MiracNetwork *connection)> ConnectedCallback;
+
+        /* all times are in milliseconds */
+        struct Options {
+            Options () :
+                attempt_timeout(3000),
+                attempt_delay(250),
+                initial_backoff(10),
+                max_backoff(250)
+                { }
+
+            /* an attempt that has not completed by then has failed */
+            unsigned int attempt_timeout;
+            /* head start an attempt gets before the next address is
+             * tried alongside it */
+            unsigned int attempt_delay;
+            /* pause after the first failed round, doubled for each
+             * further one up to max_backoff; a refused connect is cheap,
+             * while max_backoff bounds how long a sink notices a source
+             * late */
+            unsigned int initial_backoff;
+            unsigned int max_backoff;
+            MiracNetwork::Options socket;
+        };
+
+        /* reactor must outlive the connector */
+        MiracConnector (MiracReactor *reactor, const std::string &address,
+                        const std::string &service,
+                        const ConnectedCallback &callback,
+                        const Options &options = Options());
+        ~MiracConnector ();
+
+        /* (re)starts connecting, the callback runs once an attempt
+         * succeeded and the connector is idle again by then */
+        void Start ();
+        void Stop ();
+        bool IsRunning () const;
+
+    private:
+        struct Address {
+            struct sockaddr_storage storage;
+            socklen_t length;
+        };
+
+        struct Attempt {
+            std::unique_ptr<MiracNetwork> connection;
+            MiracReactor::Id watch;
+            MiracReactor::Id timeout;
+        };
+
+        typedef unsigned int AttemptId;
+
+        void StartRound ();
+        void StartAttempt ();
+        bool AttemptCb (AttemptId id);
+        void FailAttempt (AttemptId id);
+        void RemoveAttempt (AttemptId id);
+        void Connected (MiracNetwork *connection);
+        void Retry ();
+        void Cancel ();
+        void Resolve ();
+
+        MiracReactor *reactor;
+        std::string address;
+        std::string service;
+        ConnectedCallback callback;
+        Options options;
+
+        /* addresses of the current round, in the order they are tried */
+        std::vector<Address> addresses;
+        size_t next_address;
+        std::unordered_map<AttemptId, std::unique_ptr<Attempt>> attempts;
+        AttemptId next_attempt;
+
+        /* starts the next attempt of the round */
+        MiracReactor::Id delay_timer;
+        /* starts the next round */
+        MiracReactor::Id retry_timer;
+        unsigned int backoff;
+        std::minstd_rand random;
+};
+
+
+#endif  /* MIRAC_CONNECTOR_HPP */
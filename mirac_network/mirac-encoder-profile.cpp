@@ -0,0 +1,215 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <algorithm>
+
+#include "mirac-encoder-profile.hpp"
+#include "videomodes.h"
+
+namespace {
+
+/* frame rate the presets are scaled to when the mode is unknown */
+const unsigned int default_frame_rate = 30;
+
+const char *const preset_names[] = {
+    "lowest-latency",
+    "balanced",
+    "max-quality"
+};
+
+/* in the order of the level mask, see WFD::kH264Levels */
+const char *const level_names[] = { "3.1", "3.2", "4", "4.1", "4.2" };
+
+}
+
+MiracEncoderProfile::MiracEncoderProfile (Preset preset)
+    : width(0),
+      height(0),
+      frame_rate(0),
+      interlaced(false),
+      variable_frame_rate(false),
+      frame_skipping(false),
+      max_slices(1)
+{
+    SetPreset (preset);
+}
+
+const char *MiracEncoderProfile::PresetName (Preset preset)
+{
+    return preset_names[preset];
+}
+
+bool MiracEncoderProfile::ParsePreset (const std::string &name, Preset &preset)
+{
+    for (int i = LOWEST_LATENCY; i <= MAX_QUALITY; i++) {
+        if (name == preset_names[i]) {
+            preset = static_cast<Preset> (i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void MiracEncoderProfile::SetCodec (const WFD::H264Codec &codec)
+{
+    const unsigned int masks[] = {
+        codec.cea_support_, codec.vesa_support_, codec.hh_support_
+    };
+
+    for (int type = WFD::CEA; type <= WFD::HH; type++) {
+        int index = WFD::best_video_mode (static_cast<WFD::ResolutionType> (type),
+                                          masks[type]);
+        if (index < 0)
+            continue;
+
+        const WFD::VideoMode &mode = WFD::kVideoModes[type][index];
+        width = mode.width;
+        height = mode.height;
+        interlaced = mode.interlaced;
+        /* the tables count fields for interlaced modes */
+        frame_rate = mode.interlaced ? mode.frame_rate / 2 : mode.frame_rate;
+        break;
+    }
+
+    profile = (codec.profile_ & WFD::CHP) ? "high" : "constrained-baseline";
+
+    level.clear();
+    for (unsigned int i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        if (codec.level_ & (1 << i)) {
+            level = level_names[i];
+            break;
+        }
+    }
+
+    /* a zero minimum slice size means the sink does not take slices,
+     * otherwise the low 10 bits of the encoding parameters limit them */
+    max_slices = codec.min_slice_size_ ?
+        std::max (1u, static_cast<unsigned int> (codec.slice_enc_params_ & 0x3ff)) : 1;
+    frame_skipping = codec.frame_rate_control_support_ & 1;
+
+    SetPreset (preset);
+}
+
+void MiracEncoderProfile::SetPreset (Preset new_preset)
+{
+    unsigned int rate = frame_rate ? frame_rate : default_frame_rate;
+    unsigned int estimated = 0;
+
+    preset = new_preset;
+
+    if (width && height) {
+        WFD::VideoMode mode = {
+            static_cast<unsigned short> (width),
+            static_cast<unsigned short> (height),
+            static_cast<unsigned char> (rate),
+            false
+        };
+        estimated = WFD::estimated_bitrate (mode);
+
+        /* stay within what the negotiated level allows */
+        for (unsigned int i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+            if (level == level_names[i]) {
+                unsigned int max_bitrate = WFD::kH264Levels[i].max_bitrate;
+                if (profile == "high")
+                    max_bitrate += max_bitrate / 4;
+                estimated = std::min (estimated, max_bitrate);
+            }
+        }
+    }
+
+    switch (preset) {
+    case LOWEST_LATENCY:
+        speed_preset = "ultrafast";
+        zero_latency = true;
+        bitrate = estimated;
+        vbv_buffer = std::max (1u, 1000 / rate);
+        key_int_max = rate;
+        bframes = 0;
+        lookahead = 0;
+        slices = std::min (max_slices, 4u);
+        threads = slices;
+        sliced_threads = true;
+        break;
+    case BALANCED:
+        speed_preset = "veryfast";
+        zero_latency = true;
+        bitrate = estimated;
+        vbv_buffer = std::max (1u, 3000 / rate);
+        key_int_max = 2 * rate;
+        bframes = 0;
+        lookahead = 0;
+        slices = std::min (max_slices, 2u);
+        threads = 0;
+        sliced_threads = true;
+        break;
+    case MAX_QUALITY:
+        /* B frames and lookahead cost latency, not bits */
+        speed_preset = "medium";
+        zero_latency = false;
+        bitrate = estimated * 3 / 4;
+        vbv_buffer = 1000;
+        key_int_max = 4 * rate;
+        bframes = profile == "high" ? 3 : 0;
+        lookahead = std::min (rate, 40u);
+        slices = 1;
+        threads = 0;
+        sliced_threads = false;
+        break;
+    }
+}
+
+std::string MiracEncoderProfile::Pipeline () const
+{
+    std::string pipeline = "videoscale ! videoconvert ! video/x-raw";
+
+    if (width && height)
+        pipeline += ",width=" + std::to_string(width) +
+                    ",height=" + std::to_string(height);
+    if (frame_rate && !variable_frame_rate)
+        pipeline += ",framerate=" + std::to_string(frame_rate) + "/1";
+
+    if (frame_skipping)
+        pipeline += " ! queue max-size-buffers=1 leaky=downstream";
+
+    pipeline += " ! x264enc name=encoder speed-preset=" + speed_preset;
+    if (zero_latency)
+        pipeline += " tune=zerolatency";
+    if (bitrate)
+        pipeline += " bitrate=" + std::to_string(bitrate);
+    pipeline += " vbv-buf-capacity=" + std::to_string(vbv_buffer) +
+                " key-int-max=" + std::to_string(key_int_max) +
+                " bframes=" + std::to_string(bframes) +
+                " rc-lookahead=" + std::to_string(lookahead) +
+                " threads=" + std::to_string(threads) +
+                " sliced-threads=" + (sliced_threads ? "true" : "false");
+    if (interlaced)
+        pipeline += " interlaced=true";
+
+    std::string options = "slices=" + std::to_string(slices);
+    if (!level.empty())
+        options += ":level=" + level;
+    pipeline += " option-string=\"" + options + "\"";
+
+    if (!profile.empty())
+        pipeline += " ! video/x-h264,profile=" + profile;
+
+    return pipeline;
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef MIRAC_ENCODER_PROFILE_HPP
+#define MIRAC_ENCODER_PROFILE_HPP
+
+#include <string>
+
+#include "videoformats.h"
+
+/* x264enc settings for a negotiated wfd_video_formats mode */
+struct MiracEncoderProfile
+{
+    /* how much CPU to spend for latency or quality */
+    enum Preset {
+        LOWEST_LATENCY,
+        BALANCED,
+        MAX_QUALITY
+    };
+
+    MiracEncoderProfile (Preset preset = BALANCED);
+
+    static const char *PresetName (Preset preset);
+    /* false if name is not one of PresetName() */
+    static bool ParsePreset (const std::string &name, Preset &preset);
+
+    /* takes profile, level, mode, slicing and frame skipping from the
+     * codec selected for M4 and rescales the preset to it */
+    void SetCodec (const WFD::H264Codec &codec);
+    void SetPreset (Preset preset);
+
+    /* gst-launch description from raw video to H.264, the encoder is
+     * named "encoder" */
+    std::string Pipeline () const;
+
+    Preset preset;
+
+    /* output mode, 0 keeps the capture size and rate */
+    unsigned int width;
+    unsigned int height;
+    unsigned int frame_rate;
+    bool interlaced;
+    /* frames only come when the picture changes, frame_rate is just
+     * the upper bound then */
+    bool variable_frame_rate;
+
+    /* "constrained-baseline" or "high", and "3.1" to "4.2" */
+    std::string profile;
+    std::string level;
+
+    /* kbit/s */
+    unsigned int bitrate;
+    /* ms of bitrate the decoder buffers, one frame keeps the latency
+     * of a large frame to one frame time */
+    unsigned int vbv_buffer;
+    /* frames between IDR frames */
+    unsigned int key_int_max;
+    unsigned int bframes;
+    unsigned int lookahead;
+    /* slices per frame, within what the sink can decode */
+    unsigned int slices;
+    /* 0 lets x264 pick */
+    unsigned int threads;
+    /* slice threads add no latency, frame threads add a frame each */
+    bool sliced_threads;
+    std::string speed_preset;
+    bool zero_latency;
+    /* the sink accepts skipped frames, so a busy encoder drops frames
+     * instead of queueing them */
+    bool frame_skipping;
+    /* slice limit of the sink, 1 if it does not do slices */
+    unsigned int max_slices;
+};
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "mirac-exception.hpp"
+#include "mirac-epoll-reactor.hpp"
+
+#define MIRAC_MAX_EVENTS 64
+
+MiracEpollReactor::MiracEpollReactor () :
+    next_id(1),
+    running(false)
+{
+    handle = epoll_create1(EPOLL_CLOEXEC);
+    if (handle < 0)
+        throw MiracException(errno, "epoll_create1()", __FUNCTION__);
+}
+
+MiracEpollReactor::~MiracEpollReactor ()
+{
+    for (auto &it : sources) {
+        if (it.second->is_timer)
+            close(it.second->fd);
+    }
+    close(handle);
+}
+
+MiracReactor::Id MiracEpollReactor::AddSource (std::unique_ptr<Source> source)
+{
+    Id id = next_id++;
+    if (next_id == 0)
+        next_id = 1;
+
+    int fd = source->fd;
+    sources[id] = std::move(source);
+    fds[fd].push_back(id);
+    try {
+        Update(fd);
+    } catch (...) {
+        sources.erase(id);
+        fds[fd].pop_back();
+        if (fds[fd].empty())
+            fds.erase(fd);
+        throw;
+    }
+    return id;
+}
+
+/* registers fd with the union of all its watches, or unregisters it */
+void MiracEpollReactor::Update (int fd)
+{
+    auto it = fds.find(fd);
+    if (it == fds.end()) {
+        if (epoll_ctl(handle, EPOLL_CTL_DEL, fd, NULL) < 0 &&
+            errno != EBADF && errno != ENOENT)
+            throw MiracException(errno, "epoll_ctl()", __FUNCTION__);
+        return;
+    }
+
+    struct epoll_event event = {};
+    event.data.fd = fd;
+    event.events = EPOLLET;
+    for (Id id : it->second) {
+        if (sources[id]->events & READABLE)
+            event.events |= EPOLLIN;
+        if (sources[id]->events & WRITABLE)
+            event.events |= EPOLLOUT;
+    }
+
+    /* MOD also re-arms the edge, so a watch added to an already writable
+     * fd is reported on the next Iterate() */
+    if (epoll_ctl(handle, EPOLL_CTL_MOD, fd, &event) < 0) {
+        if (errno != ENOENT ||
+            epoll_ctl(handle, EPOLL_CTL_ADD, fd, &event) < 0)
+            throw MiracException(errno, "epoll_ctl()", __FUNCTION__);
+    }
+}
+
+MiracReactor::Id MiracEpollReactor::AddWatch (int fd, unsigned int events,
+                                              const WatchCallback &callback)
+{
+    std::unique_ptr<Source> source(new Source);
+    source->fd = fd;
+    source->events = events;
+    source->is_timer = false;
+    source->watch = callback;
+    return AddSource(std::move(source));
+}
+
+MiracReactor::Id MiracEpollReactor::AddTimeout (unsigned int milliseconds,
+                                                const TimeoutCallback &callback)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        throw MiracException(errno, "timerfd_create()", __FUNCTION__);
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = milliseconds / 1000;
+    spec.it_interval.tv_nsec = (milliseconds % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    /* a zero it_value would disarm the timer */
+    if (milliseconds == 0)
+        spec.it_value.tv_nsec = 1;
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+        int error = errno;
+        close(fd);
+        throw MiracException(error, "timerfd_settime()", __FUNCTION__);
+    }
+
+    std::unique_ptr<Source> source(new Source);
+    source->fd = fd;
+    source->events = READABLE;
+    source->is_timer = true;
+    source->timeout = callback;
+    try {
+        return AddSource(std::move(source));
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+}
+
+void MiracEpollReactor::Remove (Id id)
+{
+    auto it = sources.find(id);
+    if (it == sources.end())
+        return;
+
+    int fd = it->second->fd;
+    bool is_timer = it->second->is_timer;
+    /* Iterate() dispatches a copy of the callback, so a source may
+     * remove itself */
+    sources.erase(it);
+
+    auto &ids = fds[fd];
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+    if (ids.empty())
+        fds.erase(fd);
+
+    if (is_timer) {
+        /* closing drops it from the epoll set */
+        close(fd);
+    } else {
+        Update(fd);
+    }
+}
+
+int MiracEpollReactor::Iterate (int timeout_ms)
+{
+    struct epoll_event events[MIRAC_MAX_EVENTS];
+
+    int count = epoll_wait(handle, events, MIRAC_MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR)
+            return 0;
+        throw MiracException(errno, "epoll_wait()", __FUNCTION__);
+    }
+
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        unsigned int ready = 0;
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            ready |= READABLE;
+        if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+            ready |= WRITABLE;
+
+        auto it = fds.find(fd);
+        if (it == fds.end())
+            continue;
+        /* callbacks may add and remove sources, so dispatch a copy and
+         * check that each one is still registered */
+        std::vector<Id> ids(it->second);
+        for (Id id : ids) {
+            auto source = sources.find(id);
+            if (source == sources.end())
+                continue;
+
+            bool keep;
+            if (source->second->is_timer) {
+                uint64_t expirations;
+                if (read(fd, &expirations, sizeof(expirations)) < 0)
+                    continue;
+                TimeoutCallback callback(source->second->timeout);
+                keep = callback();
+            } else {
+                if (!(source->second->events & ready))
+                    continue;
+                WatchCallback callback(source->second->watch);
+                keep = callback(fd, source->second->events & ready);
+            }
+            if (!keep)
+                Remove(id);
+        }
+    }
+
+    return count;
+}
+
+void MiracEpollReactor::Run ()
+{
+    running = true;
+    while (running)
+        Iterate(-1);
+}
+
+void MiracEpollReactor::Quit ()
+{
+    running = false;
+}
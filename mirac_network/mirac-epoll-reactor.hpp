@@ -0,0 +1,76 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_EPOLL_REACTOR_HPP
+#define MIRAC_EPOLL_REACTOR_HPP
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "mirac-reactor.hpp"
+
+/* Edge-triggered epoll reactor without a GLib dependency. Every fd is
+ * registered once with the union of its watches; timeouts are timerfds
+ * on the same epoll set, so one wakeup costs one epoll_wait() no matter
+ * how many sessions are registered. */
+class MiracEpollReactor : public MiracReactor
+{
+    public:
+        MiracEpollReactor ();
+        virtual ~MiracEpollReactor ();
+
+        virtual Id AddWatch (int fd, unsigned int events,
+                             const WatchCallback &callback) override;
+        virtual Id AddTimeout (unsigned int milliseconds,
+                               const TimeoutCallback &callback) override;
+        virtual void Remove (Id id) override;
+
+        virtual void Run () override;
+        virtual void Quit () override;
+
+        /* waits up to timeout_ms (-1 for ever) and dispatches the ready
+         * sources, returns the number of dispatched events */
+        int Iterate (int timeout_ms = -1);
+
+    private:
+        struct Source {
+            int fd;
+            unsigned int events;
+            bool is_timer;
+            WatchCallback watch;
+            TimeoutCallback timeout;
+        };
+
+        Id AddSource (std::unique_ptr<Source> source);
+        void Update (int fd);
+
+        int handle;
+        Id next_id;
+        bool running;
+        std::unordered_map<Id, std::unique_ptr<Source>> sources;
+        /* all ids watching an fd, timers have exactly one */
+        std::unordered_map<int, std::vector<Id>> fds;
+};
+
+
+#endif  /* MIRAC_EPOLL_REACTOR_HPP */
@@ -0,0 +1,128 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <glib-unix.h>
+
+#include "mirac-glib-reactor.hpp"
+
+namespace {
+
+gboolean watch_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+{
+    auto callback = reinterpret_cast<MiracReactor::WatchCallback*> (data_ptr);
+    unsigned int events = 0;
+
+    /* errors and hangups are reported to whoever is watching so that the
+     * following recv() / send() can raise them */
+    if (condition & (G_IO_IN | G_IO_HUP | G_IO_ERR))
+        events |= MiracReactor::READABLE;
+    if (condition & (G_IO_OUT | G_IO_HUP | G_IO_ERR))
+        events |= MiracReactor::WRITABLE;
+
+    return (*callback)(fd, events) ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+gboolean timeout_cb (gpointer data_ptr)
+{
+    auto callback = reinterpret_cast<MiracReactor::TimeoutCallback*> (data_ptr);
+    return (*callback)() ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+void destroy_watch (gpointer data_ptr)
+{
+    delete reinterpret_cast<MiracReactor::WatchCallback*> (data_ptr);
+}
+
+void destroy_timeout (gpointer data_ptr)
+{
+    delete reinterpret_cast<MiracReactor::TimeoutCallback*> (data_ptr);
+}
+
+}
+
+MiracReactor *MiracReactor::Default ()
+{
+    static MiracGlibReactor reactor;
+    return &reactor;
+}
+
+MiracGlibReactor::MiracGlibReactor (GMainContext *main_context) :
+    context(main_context ? g_main_context_ref(main_context) : NULL),
+    loop(g_main_loop_new(main_context, FALSE))
+{
+}
+
+MiracGlibReactor::~MiracGlibReactor ()
+{
+    g_main_loop_unref(loop);
+    if (context)
+        g_main_context_unref(context);
+}
+
+MiracReactor::Id MiracGlibReactor::Attach (GSource *source)
+{
+    Id id = g_source_attach(source, context);
+    g_source_unref(source);
+    return id;
+}
+
+MiracReactor::Id MiracGlibReactor::AddWatch (int fd, unsigned int events,
+                                             const WatchCallback &callback)
+{
+    int condition = 0;
+
+    if (events & READABLE)
+        condition |= G_IO_IN;
+    if (events & WRITABLE)
+        condition |= G_IO_OUT;
+
+    GSource *source = g_unix_fd_source_new(fd, static_cast<GIOCondition>(condition));
+    g_source_set_callback(source, reinterpret_cast<GSourceFunc>(watch_cb),
+                          new WatchCallback(callback), destroy_watch);
+    return Attach(source);
+}
+
+MiracReactor::Id MiracGlibReactor::AddTimeout (unsigned int milliseconds,
+                                               const TimeoutCallback &callback)
+{
+    GSource *source = g_timeout_source_new(milliseconds);
+    g_source_set_callback(source, timeout_cb,
+                          new TimeoutCallback(callback), destroy_timeout);
+    return Attach(source);
+}
+
+void MiracGlibReactor::Remove (Id id)
+{
+    GSource *source = g_main_context_find_source_by_id(context, id);
+    if (source)
+        g_source_destroy(source);
+}
+
+void MiracGlibReactor::Run ()
+{
+    g_main_loop_run(loop);
+}
+
+void MiracGlibReactor::Quit ()
+{
+    g_main_loop_quit(loop);
+}
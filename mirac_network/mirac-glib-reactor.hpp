@@ -0,0 +1,55 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_GLIB_REACTOR_HPP
+#define MIRAC_GLIB_REACTOR_HPP
+
+#include <glib.h>
+
+#include "mirac-reactor.hpp"
+
+/* Reactor on top of a GLib main context, so the broker can share a
+ * GMainLoop with GStreamer and the rest of the application */
+class MiracGlibReactor : public MiracReactor
+{
+    public:
+        explicit MiracGlibReactor (GMainContext *context = NULL);
+        virtual ~MiracGlibReactor ();
+
+        virtual Id AddWatch (int fd, unsigned int events,
+                             const WatchCallback &callback) override;
+        virtual Id AddTimeout (unsigned int milliseconds,
+                               const TimeoutCallback &callback) override;
+        virtual void Remove (Id id) override;
+
+        virtual void Run () override;
+        virtual void Quit () override;
+
+    private:
+        Id Attach (GSource *source);
+
+        GMainContext *context;
+        GMainLoop *loop;
+};
+
+
+#endif  /* MIRAC_GLIB_REACTOR_HPP */
@@ -21,7 +21,9 @@
  * 02110-1301 USA
  */
 
+#include <cstring>
 #include <iostream>
+#include <string>
 
 #include "mirac-gst-sink.hpp"
 
@@ -37,10 +39,57 @@ void _set_udp_caps(GstElement *playbin, GstElement *source, gpointer    user_dat
     gst_caps_unref(caps);
 }
 
-MiracGstSink::MiracGstSink (std::string hostname, int port)
+static std::string _low_latency_pipeline(const std::string& hostname, int port,
+                                         const MiracGstSink::Options& options)
+{
+    /* only the video elementary stream is decoded, tsdemux leaves the
+     * audio pad unlinked */
+    return "udpsrc name=src " +
+        (!hostname.empty() ? "address=" + hostname + " " : std::string()) +
+        "port=" + std::to_string(port > 0 ? port : 0) +
+        " caps=\"application/x-rtp,media=video,clock-rate=90000,encoding-name=MP2T\"" +
+        " ! rtpjitterbuffer latency=" + std::to_string(options.latency_ms) +
+        " drop-on-latency=" + (options.drop_on_latency ? "true" : "false") +
+        " ! rtpmp2tdepay name=depay ! tsdemux ! h264parse" +
+        " ! avdec_h264 name=decoder max-threads=" + std::to_string(options.decoder_threads) +
+        " ! videoconvert ! autovideosink name=videosink sync=" +
+        (options.sync ? "true" : "false");
+}
+
+MiracGstSink::MiracGstSink (std::string hostname, int port, const Options& options)
+    : gst_elem(NULL),
+      low_latency_pipeline(false),
+      decoder(NULL),
+      bus_watch(0),
+      loss_source(0)
 {
     std::string gst_pipeline;
 
+    memset(continuity, -1, sizeof(continuity));
+
+    if (options.low_latency) {
+        GError* error = NULL;
+
+        gst_pipeline = _low_latency_pipeline(hostname, port, options);
+        gst_elem = gst_parse_launch(gst_pipeline.c_str(), &error);
+        if (error) {
+            /* a missing element or property, playbin may still cope */
+            std::cerr << "Low latency sink pipeline unavailable: "
+                      << error->message << std::endl;
+            g_error_free(error);
+            if (gst_elem)
+                gst_object_unref (GST_OBJECT (gst_elem));
+            gst_elem = NULL;
+        }
+        low_latency_pipeline = gst_elem != NULL;
+    }
+
+    if (gst_elem) {
+        watch_losses();
+        gst_element_set_state (gst_elem, GST_STATE_PLAYING);
+        return;
+    }
+
     std::string url =  "udp://" + (!hostname.empty() ? hostname  : "::") + (port > 0 ? ":" + std::to_string(port) : ":");
     gst_pipeline = "playbin uri=" + url;
 
@@ -56,20 +105,165 @@ int MiracGstSink::sink_udp_port() {
         return 0;
 
     GstElement* source = NULL;
-    g_object_get(gst_elem, "source", &source, NULL);
+    if (low_latency_pipeline)
+        source = gst_bin_get_by_name(GST_BIN(gst_elem), "src");
+    else
+        g_object_get(gst_elem, "source", &source, NULL);
 
     if (source == NULL)
         return 0;
 
     gint port = 0;
     g_object_get(source, "port", &port, NULL);
+    gst_object_unref(source);
     return port;
 }
 
+GstPadProbeReturn MiracGstSink::frame_probe(GstPad* pad, GstPadProbeInfo* info,
+                                            gpointer user_data)
+{
+    MiracGstSink* self = static_cast<MiracGstSink*>(user_data);
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (buffer && GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)))
+        self->frame_callback(GST_BUFFER_PTS(buffer));
+    return GST_PAD_PROBE_OK;
+}
+
+bool MiracGstSink::set_frame_callback(const FrameCallback& callback)
+{
+    if (!low_latency_pipeline || frame_callback)
+        return false;
+
+    GstElement* videosink = gst_bin_get_by_name(GST_BIN(gst_elem), "videosink");
+    if (videosink == NULL)
+        return false;
+
+    GstPad* pad = gst_element_get_static_pad(videosink, "sink");
+    gst_object_unref(videosink);
+    if (pad == NULL)
+        return false;
+
+    frame_callback = callback;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, frame_probe, this, NULL);
+    gst_object_unref(pad);
+    return true;
+}
+
+void MiracGstSink::set_loss_callback(const LossCallback& callback)
+{
+    loss_callback = callback;
+}
+
+void MiracGstSink::watch_losses()
+{
+    GstElement* depay = gst_bin_get_by_name(GST_BIN(gst_elem), "depay");
+    if (depay) {
+        GstPad* pad = gst_element_get_static_pad(depay, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, continuity_probe, this, NULL);
+        gst_object_unref(pad);
+        gst_object_unref(depay);
+    }
+
+    decoder = gst_bin_get_by_name(GST_BIN(gst_elem), "decoder");
+    if (decoder)
+        gst_object_unref(decoder);
+
+    GstBus* bus = gst_element_get_bus(gst_elem);
+    bus_watch = gst_bus_add_watch(bus, bus_message, this);
+    gst_object_unref(bus);
+}
+
+GstPadProbeReturn MiracGstSink::continuity_probe(GstPad* pad, GstPadProbeInfo* info,
+                                                 gpointer user_data)
+{
+    MiracGstSink* self = static_cast<MiracGstSink*>(user_data);
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstMapInfo map;
+    bool lost = false;
+
+    if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ))
+        return GST_PAD_PROBE_OK;
+
+    for (gsize offset = 0; offset + 188 <= map.size; offset += 188) {
+        const guint8* packet = map.data + offset;
+        if (packet[0] != 0x47)
+            break;
+
+        unsigned int pid = ((packet[1] & 0x1f) << 8) | packet[2];
+        unsigned int adaptation = (packet[3] >> 4) & 3;
+        signed char counter = packet[3] & 0x0f;
+
+        if (pid == 0x1fff)
+            continue;
+        if (packet[1] & 0x80)
+            lost = true; /* transport_error_indicator */
+
+        /* the sender may restart the counter after a discontinuity flag */
+        if ((adaptation & 2) && packet[4] > 0 && (packet[5] & 0x80)) {
+            self->continuity[pid] = counter;
+            continue;
+        }
+        /* only packets with payload count, and each may be sent twice */
+        if (!(adaptation & 1))
+            continue;
+
+        signed char last = self->continuity[pid];
+        self->continuity[pid] = counter;
+        if (last >= 0 && counter != last && counter != ((last + 1) & 0x0f))
+            lost = true;
+    }
+    gst_buffer_unmap(buffer, &map);
+
+    if (lost)
+        self->stream_lost();
+    return GST_PAD_PROBE_OK;
+}
+
+gboolean MiracGstSink::bus_message(GstBus* bus, GstMessage* message, gpointer user_data)
+{
+    MiracGstSink* self = static_cast<MiracGstSink*>(user_data);
+
+    /* the decoder warns about undecodable frames before it gives up
+     * with an error */
+    if ((GST_MESSAGE_TYPE(message) == GST_MESSAGE_WARNING ||
+         GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) &&
+        self->decoder && GST_MESSAGE_SRC(message) == GST_OBJECT(self->decoder))
+        self->stream_lost();
+
+    return TRUE;
+}
+
+void MiracGstSink::stream_lost()
+{
+    std::lock_guard<std::mutex> lock(loss_mutex);
+    if (!loss_source)
+        loss_source = g_idle_add(report_loss, this);
+}
+
+gboolean MiracGstSink::report_loss(gpointer user_data)
+{
+    MiracGstSink* self = static_cast<MiracGstSink*>(user_data);
+    {
+        std::lock_guard<std::mutex> lock(self->loss_mutex);
+        self->loss_source = 0;
+    }
+
+    if (self->loss_callback)
+        self->loss_callback();
+    return G_SOURCE_REMOVE;
+}
+
 MiracGstSink::~MiracGstSink ()
 {
     if (gst_elem) {
         gst_element_set_state (gst_elem, GST_STATE_NULL);
         gst_object_unref (GST_OBJECT (gst_elem));
     }
+
+    /* streaming threads are gone, nothing schedules a report any more */
+    if (bus_watch)
+        g_source_remove(bus_watch);
+    if (loss_source)
+        g_source_remove(loss_source);
 }
\ No newline at end of file
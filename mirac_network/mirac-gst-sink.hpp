@@ -24,19 +24,84 @@
 #ifndef MIRAC_GST_SINK_HPP
 #define MIRAC_GST_SINK_HPP
 
+#include <functional>
+#include <mutex>
+#include <string>
+
 #include <gst/gst.h>
 
 
 class MiracGstSink
 {
 public:
-    MiracGstSink(std::string hostname, int port);
+    struct Options {
+        Options ()
+            : low_latency(true),
+              latency_ms(40),
+              drop_on_latency(true),
+              sync(false),
+              decoder_threads(1) {}
+
+        /* explicit udpsrc ! rtpjitterbuffer ! ... ! videosink pipeline,
+         * false falls back to playbin and its default buffering */
+        bool low_latency;
+        /* how long rtpjitterbuffer holds packets back for reordering */
+        unsigned int latency_ms;
+        /* drop packets that arrive later than latency_ms instead of
+         * letting the buffer grow */
+        bool drop_on_latency;
+        /* render on the pipeline clock, false shows each frame as soon
+         * as it is decoded */
+        bool sync;
+        /* frame threading delays the output by one frame per thread,
+         * 0 lets the decoder pick */
+        unsigned int decoder_threads;
+    };
+
+    /* called from the streaming thread with the PTS of every decoded
+     * video frame, before it is rendered */
+    typedef std::function<void (GstClockTime pts)> FrameCallback;
+    /* called from the main context after transport stream packets went
+     * missing or the decoder failed, once for a burst of such events */
+    typedef std::function<void ()> LossCallback;
+
+    MiracGstSink(std::string hostname, int port,
+                 const Options& options = Options());
     ~MiracGstSink ();
 
     int sink_udp_port();
+    bool low_latency() const { return low_latency_pipeline; }
+
+    /* only available in the low latency mode */
+    bool set_frame_callback(const FrameCallback& callback);
+    /* losses are only detected in the low latency mode */
+    void set_loss_callback(const LossCallback& callback);
 
 private:
+    static GstPadProbeReturn frame_probe(GstPad* pad, GstPadProbeInfo* info,
+                                         gpointer user_data);
+    static GstPadProbeReturn continuity_probe(GstPad* pad, GstPadProbeInfo* info,
+                                              gpointer user_data);
+    static gboolean bus_message(GstBus* bus, GstMessage* message, gpointer user_data);
+    static gboolean report_loss(gpointer user_data);
+
+    void watch_losses();
+    /* any thread */
+    void stream_lost();
+
     GstElement* gst_elem;
+    bool low_latency_pipeline;
+    FrameCallback frame_callback;
+    LossCallback loss_callback;
+
+    /* not referenced, only compared with message sources */
+    GstElement* decoder;
+    guint bus_watch;
+    /* last continuity counter of each PID, -1 before the first packet */
+    signed char continuity[8192];
+
+    std::mutex loss_mutex;
+    guint loss_source;
 };
 
 #endif
\ No newline at end of file
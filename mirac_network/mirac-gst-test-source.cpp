@@ -22,28 +22,148 @@
  */
 
 #include <iostream>
+#include <string>
 #include <gio/gio.h>
 
+#include "mirac-exception.hpp"
 #include "mirac-gst-test-source.hpp"
+#ifdef MIRAC_X_CAPTURE
+#include "mirac-x-capture.hpp"
 
-MiracGstTestSource::MiracGstTestSource (wfd_test_stream_t wfd_stream_type, std::string hostname, int port)
+namespace {
+
+struct CapturedFrame {
+    MiracXCapture* capture;
+    unsigned int slot;
+};
+
+void _release_frame(gpointer data)
+{
+    CapturedFrame* frame = static_cast<CapturedFrame*>(data);
+    frame->capture->Release(frame->slot);
+    delete frame;
+}
+
+}
+#endif
+
+MiracGstTestSource::MiracGstTestSource (wfd_test_stream_t wfd_stream_type, std::string hostname, int port,
+                                        const MiracEncoderProfile& encoder,
+                                        bool batched_send)
+    : gst_elem(NULL),
+      capture_src(NULL),
+      ts_sink(NULL)
 {
     std::string gst_pipeline;
 
     std::string hostname_port = (!hostname.empty() ? "host=" + hostname + " ": " ") + (port > 0 ? "port=" + std::to_string(port) : "");
 
+    if (batched_send) {
+        try {
+            /* the defaults of udpsink */
+            sender.reset(new MiracRtpSender(!hostname.empty() ? hostname : "localhost",
+                                            port > 0 ? port : 5004));
+            std::cout << "Sending with " << MiracRtpSender::ModeName(sender->GetMode()) << std::endl;
+        } catch (const MiracException& x) {
+            std::cout << "Batched send unavailable, using udpsink: " << x.what() << std::endl;
+        }
+    }
+
+    /* what follows mpegtsmux: with the sender the muxer outputs all
+     * packets of a frame in one buffer and the appsink passes it on */
+    std::string transport = sender ? "alignment=0 ! appsink name=ts emit-signals=true" :
+        "! rtpmp2tpay ! udpsink name=sink " + hostname_port;
+
     if (wfd_stream_type == WFD_TEST_BOTH) {
-        gst_pipeline = "videotestsrc ! x264enc ! muxer.  audiotestsrc ! avenc_ac3 ! muxer.  mpegtsmux name=muxer ! rtpmp2tpay ! udpsink name=sink " +
-            hostname_port;
+        gst_pipeline = "videotestsrc ! x264enc name=encoder ! muxer.  audiotestsrc ! avenc_ac3 ! muxer.  mpegtsmux name=muxer " +
+            transport;
     } else if (wfd_stream_type == WFD_TEST_AUDIO) {
-        gst_pipeline = "audiotestsrc ! avenc_ac3 ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
+        gst_pipeline = "audiotestsrc ! avenc_ac3 ! mpegtsmux " + transport;
     } else if (wfd_stream_type == WFD_TEST_VIDEO) {
-        gst_pipeline = "videotestsrc ! x264enc ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
+        gst_pipeline = "videotestsrc ! x264enc name=encoder ! mpegtsmux " + transport;
     } else if (wfd_stream_type == WFD_DESKTOP) {
-        gst_pipeline = "ximagesrc ! videoconvert ! x264enc tune=zerolatency ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
+        if (!CreateCapture(encoder, transport))
+            gst_pipeline = "ximagesrc ! " + encoder.Pipeline() + " ! mpegtsmux " + transport;
     }
 
+    if (gst_elem == NULL)
+        gst_elem = gst_parse_launch(gst_pipeline.c_str(), NULL);
+
+    if (gst_elem && sender) {
+        ts_sink = gst_bin_get_by_name(GST_BIN(gst_elem), "ts");
+        g_signal_connect(ts_sink, "new-sample", G_CALLBACK(_new_sample), this);
+    }
+}
+
+GstFlowReturn MiracGstTestSource::_new_sample(GstElement* appsink, gpointer user_data)
+{
+    MiracGstTestSource* self = static_cast<MiracGstTestSource*>(user_data);
+
+    GstSample* sample = NULL;
+    g_signal_emit_by_name(appsink, "pull-sample", &sample);
+    if (sample == NULL)
+        return GST_FLOW_EOS;
+
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        /* the 90 kHz clock rtpmp2tpay would stamp the packets with */
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+        guint32 timestamp = GST_CLOCK_TIME_IS_VALID(pts) ? pts * 9 / 100000 : 0;
+        self->sender->Send(map.data, map.size, timestamp);
+        gst_buffer_unmap(buffer, &map);
+    }
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+bool MiracGstTestSource::CreateCapture(const MiracEncoderProfile& encoder,
+                                       const std::string& transport)
+{
+#ifdef MIRAC_X_CAPTURE
+    MiracXCapture::Options options;
+    if (encoder.frame_rate)
+        options.frame_rate = encoder.frame_rate;
+
+    try {
+        capture.reset(new MiracXCapture([this] (const MiracXCapture::Frame& frame) {
+            /* the buffer hands the shared memory slot back once it is
+             * encoded, nothing is copied on the way */
+            CapturedFrame* captured = new CapturedFrame { capture.get(), frame.slot };
+            GstBuffer* buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                const_cast<guint8*>(frame.data), frame.size, 0, frame.size,
+                captured, _release_frame);
+            GstFlowReturn ret;
+            g_signal_emit_by_name(capture_src, "push-buffer", buffer, &ret);
+            gst_buffer_unref(buffer);
+        }, options));
+    } catch (const MiracException& x) {
+        std::cout << "X capture unavailable, using ximagesrc: " << x.what() << std::endl;
+        return false;
+    }
+
+    /* only changed frames are captured, so there is no fixed rate */
+    MiracEncoderProfile variable_rate(encoder);
+    variable_rate.variable_frame_rate = true;
+    std::string gst_pipeline = "appsrc name=capture is-live=true do-timestamp=true format=time ! " +
+        variable_rate.Pipeline() + " ! mpegtsmux " + transport;
+
     gst_elem = gst_parse_launch(gst_pipeline.c_str(), NULL);
+    if (gst_elem == NULL) {
+        capture.reset();
+        return false;
+    }
+
+    capture_src = gst_bin_get_by_name(GST_BIN(gst_elem), "capture");
+    std::string caps_description = "video/x-raw,format=BGRx,width=" + std::to_string(capture->Width()) +
+        ",height=" + std::to_string(capture->Height()) + ",framerate=0/1";
+    GstCaps* caps = gst_caps_from_string(caps_description.c_str());
+    g_object_set(capture_src, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    return true;
+#else
+    return false;
+#endif
 }
 
 void MiracGstTestSource::SetState(GstState state)
@@ -51,10 +171,53 @@ void MiracGstTestSource::SetState(GstState state)
     if (gst_elem) {
         gst_element_set_state (gst_elem, state);
     }
+#ifdef MIRAC_X_CAPTURE
+    if (capture) {
+        if (state == GST_STATE_PLAYING)
+            capture->Start();
+        else
+            capture->Stop();
+    }
+#endif
+}
+
+bool MiracGstTestSource::RequestKeyFrame()
+{
+    if (gst_elem == NULL)
+        return false;
+
+    GstElement* encoder = gst_bin_get_by_name(GST_BIN(gst_elem), "encoder");
+    if (encoder == NULL)
+        return false;
+
+    /* what gst_video_event_new_upstream_force_key_unit() builds, without
+     * linking gstreamer-video for it */
+    GstEvent* event = gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM,
+        gst_structure_new("GstForceKeyUnit",
+                          "running-time", GST_TYPE_CLOCK_TIME, GST_CLOCK_TIME_NONE,
+                          "all-headers", G_TYPE_BOOLEAN, TRUE,
+                          "count", G_TYPE_UINT, 0,
+                          NULL));
+
+    GstPad* pad = gst_element_get_static_pad(encoder, "src");
+    gboolean handled = gst_pad_send_event(pad, event);
+    gst_object_unref(pad);
+    gst_object_unref(encoder);
+
+#ifdef MIRAC_X_CAPTURE
+    /* a static screen sends no frame the key unit could start at */
+    if (capture)
+        capture->Refresh();
+#endif
+
+    return handled;
 }
 
 int MiracGstTestSource::UdpSourcePort()
 {
+    if (sender)
+        return sender->LocalPort();
+
     if (gst_elem == NULL)
         return 0;
 
@@ -80,4 +243,10 @@ MiracGstTestSource::~MiracGstTestSource ()
         gst_element_set_state (gst_elem, GST_STATE_NULL);
         gst_object_unref (GST_OBJECT (gst_elem));
     }
+    /* the capture goes after the pipeline, which releases its frames,
+     * and so does the sender, which the pipeline thread used */
+    if (capture_src)
+        gst_object_unref (capture_src);
+    if (ts_sink)
+        gst_object_unref (ts_sink);
 }
\ No newline at end of file
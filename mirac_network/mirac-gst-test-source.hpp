@@ -24,22 +24,47 @@
 #ifndef MIRAC_GST_TEST_SOURCE_HPP
 #define MIRAC_GST_TEST_SOURCE_HPP
 
+#include <memory>
+
 #include <gst/gst.h>
 
+#include "mirac-encoder-profile.hpp"
+#include "mirac-rtp-sender.hpp"
+
+class MiracXCapture;
+
 enum wfd_test_stream_t {WFD_TEST_AUDIO, WFD_TEST_VIDEO, WFD_TEST_BOTH, WFD_DESKTOP, WFD_UNKNOWN_STREAM};
 
 
 class MiracGstTestSource
 {
 public:
-    MiracGstTestSource(wfd_test_stream_t wfd_stream, std::string hostname, int port);
+    /* encoder is used for the desktop stream, which is captured with
+     * MiracXCapture when built with it and ximagesrc otherwise.
+     * batched_send hands each muxed frame to MiracRtpSender instead of
+     * rtpmp2tpay ! udpsink, which sends one datagram per syscall */
+    MiracGstTestSource(wfd_test_stream_t wfd_stream, std::string hostname, int port,
+                       const MiracEncoderProfile& encoder = MiracEncoderProfile(),
+                       bool batched_send = false);
     ~MiracGstTestSource ();
 
     void SetState(GstState state);
+    /* makes the encoder start a new IDR frame with SPS and PPS, false
+     * if the stream has no video */
+    bool RequestKeyFrame();
     int UdpSourcePort();
 
 private:
+    bool CreateCapture(const MiracEncoderProfile& encoder, const std::string& transport);
+    static GstFlowReturn _new_sample(GstElement* appsink, gpointer user_data);
+
     GstElement* gst_elem;
+    GstElement* capture_src;
+    GstElement* ts_sink;
+    /* used from the streaming thread of ts_sink */
+    std::unique_ptr<MiracRtpSender> sender;
+    /* shared_ptr, whose deleter is bound where the type is complete */
+    std::shared_ptr<MiracXCapture> capture;
 };
 
 #endif
\ No newline at end of file
@@ -35,14 +35,19 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 #include "mirac-network.hpp"
+#ifdef MIRAC_IO_URING
+#include "mirac-uring-network.hpp"
+#endif
 
 
 #define MIRAC_MAX_NAMELEN       255
+#define MIRAC_MAX_IOV           64
 
 
 MiracNetwork::MiracNetwork ()
@@ -65,6 +70,103 @@ MiracNetwork::~MiracNetwork ()
 }
 
 
+MiracNetwork * MiracNetwork::Create (int conn_handle, const Options &options)
+{
+    MiracNetwork *connection = NULL;
+
+#ifdef MIRAC_IO_URING
+    /* fall back to plain socket calls when the kernel lacks the
+     * io_uring features or the ring cannot be set up */
+    if (MiracUringNetwork::IsSupported())
+    {
+        try
+        {
+            connection = new MiracUringNetwork(conn_handle);
+        }
+        catch (MiracException &x)
+        {
+        }
+    }
+#endif
+    if (!connection)
+        connection = new MiracNetwork(conn_handle);
+    connection->options = options;
+    return connection;
+}
+
+
+void MiracNetwork::SetOptions (const Options &new_options)
+{
+    options = new_options;
+    if (handle >= 0)
+        ApplyOptions(handle);
+}
+
+
+void MiracNetwork::ApplyOptions (int conn_handle) const
+{
+    int on = 1;
+
+    if (options.no_delay && setsockopt(conn_handle, IPPROTO_TCP, TCP_NODELAY,
+        &on, sizeof(on)))
+        throw MiracException(errno, "setsockopt(TCP_NODELAY)", __FUNCTION__);
+    if (options.quick_ack && setsockopt(conn_handle, IPPROTO_TCP, TCP_QUICKACK,
+        &on, sizeof(on)))
+        throw MiracException(errno, "setsockopt(TCP_QUICKACK)", __FUNCTION__);
+
+    if (options.keep_alive)
+    {
+        if (setsockopt(conn_handle, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)))
+            throw MiracException(errno, "setsockopt(SO_KEEPALIVE)",
+                __FUNCTION__);
+        if (options.keep_idle > 0 && setsockopt(conn_handle, IPPROTO_TCP,
+            TCP_KEEPIDLE, &options.keep_idle, sizeof(options.keep_idle)))
+            throw MiracException(errno, "setsockopt(TCP_KEEPIDLE)",
+                __FUNCTION__);
+        if (options.keep_interval > 0 && setsockopt(conn_handle, IPPROTO_TCP,
+            TCP_KEEPINTVL, &options.keep_interval,
+            sizeof(options.keep_interval)))
+            throw MiracException(errno, "setsockopt(TCP_KEEPINTVL)",
+                __FUNCTION__);
+        if (options.keep_count > 0 && setsockopt(conn_handle, IPPROTO_TCP,
+            TCP_KEEPCNT, &options.keep_count, sizeof(options.keep_count)))
+            throw MiracException(errno, "setsockopt(TCP_KEEPCNT)",
+                __FUNCTION__);
+    }
+
+    /* note, TCP_USER_TIMEOUT is specific to Linux 2.6.37+ */
+    if (options.user_timeout && setsockopt(conn_handle, IPPROTO_TCP,
+        TCP_USER_TIMEOUT, &options.user_timeout, sizeof(options.user_timeout)))
+        throw MiracException(errno, "setsockopt(TCP_USER_TIMEOUT)",
+            __FUNCTION__);
+
+    if (options.priority >= 0 && setsockopt(conn_handle, SOL_SOCKET,
+        SO_PRIORITY, &options.priority, sizeof(options.priority)))
+        throw MiracException(errno, "setsockopt(SO_PRIORITY)", __FUNCTION__);
+
+    if (options.dscp >= 0)
+    {
+        /* the code point goes in the upper six bits of the traffic
+         * class, the option depends on the address family */
+        int tos = options.dscp << 2;
+        int family = AF_INET;
+        socklen_t optlen = sizeof(family);
+        if (getsockopt(conn_handle, SOL_SOCKET, SO_DOMAIN, &family, &optlen))
+            throw MiracException(errno, "getsockopt(SO_DOMAIN)", __FUNCTION__);
+        if (family == AF_INET6)
+        {
+            if (setsockopt(conn_handle, IPPROTO_IPV6, IPV6_TCLASS,
+                &tos, sizeof(tos)))
+                throw MiracException(errno, "setsockopt(IPV6_TCLASS)",
+                    __FUNCTION__);
+        }
+        else if (setsockopt(conn_handle, IPPROTO_IP, IP_TOS,
+            &tos, sizeof(tos)))
+            throw MiracException(errno, "setsockopt(IP_TOS)", __FUNCTION__);
+    }
+}
+
+
 void MiracNetwork::Init ()
 {
     long ps;
@@ -75,6 +177,11 @@ void MiracNetwork::Init ()
     page_size = (ps <= 0) ? 4096 : static_cast<size_t> (ps);
 
     conn_ares = NULL;
+    recv_begin = 0;
+    recv_end = 0;
+    recv_scanned = 0;
+    recv_consumed = 0;
+    send_offset = 0;
 }
 
 
@@ -92,7 +199,8 @@ void MiracNetwork::Close ()
 }
 
 
-void MiracNetwork::Bind (const char *address, const char *service)
+void MiracNetwork::Bind (const char *address, const char *service,
+    int backlog, bool reuse_port)
 {
     int ec;
     int reuse = 1;
@@ -107,6 +215,9 @@ void MiracNetwork::Bind (const char *address, const char *service)
     ec = getaddrinfo(address, service, &addr_hint, &addr_res);
     if (ec)
         throw MiracException(gai_strerror(ec), __FUNCTION__);
+    /* released however the loop ends, ApplyOptions() throws too */
+    std::unique_ptr<struct addrinfo, void (*)(struct addrinfo *)>
+        addr_guard(addr_res, freeaddrinfo);
     bind_addr = addr_res;
     while (bind_addr)
     {
@@ -119,6 +230,12 @@ void MiracNetwork::Bind (const char *address, const char *service)
         if (setsockopt(handle, SOL_SOCKET, SO_REUSEADDR,
             &reuse, sizeof(reuse)))
             throw MiracException(errno, "setsockopt()", __FUNCTION__);
+        /* note, SO_REUSEPORT is specific to Linux 3.9+ */
+        if (reuse_port && setsockopt(handle, SOL_SOCKET, SO_REUSEPORT,
+            &reuse, sizeof(reuse)))
+            throw MiracException(errno, "setsockopt(SO_REUSEPORT)",
+                __FUNCTION__);
+        ApplyOptions(handle);
 	if (bind(handle, bind_addr->ai_addr, bind_addr->ai_addrlen) == 0)
            break;
         else if (!bind_addr->ai_next)
@@ -126,9 +243,8 @@ void MiracNetwork::Bind (const char *address, const char *service)
         close(handle);
 	bind_addr = bind_addr->ai_next;
     }
-    freeaddrinfo(addr_res);
 
-    if (listen(handle, 1))
+    if (listen(handle, backlog))
         throw MiracException(errno, "listen()", __FUNCTION__);
 }
 
@@ -136,14 +252,28 @@ void MiracNetwork::Bind (const char *address, const char *service)
 MiracNetwork * MiracNetwork::Accept ()
 {
     int ch;
-    int nonblock = 1;
 
-    ch = accept(handle, NULL, NULL);
+    /* note, accept4() is specific to Linux 2.6.28+ */
+    do
+        ch = accept4(handle, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    while (ch < 0 && (errno == ECONNABORTED || errno == EINTR));
     if (ch < 0)
-        throw MiracException(errno, "accept()", __FUNCTION__);
-    if (ioctl(ch, FIONBIO, &nonblock))
-        throw MiracException(errno, "ioctl(FIONBIO)", __FUNCTION__);
-    return new MiracNetwork(ch);
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return NULL;
+        throw MiracException(errno, "accept4()", __FUNCTION__);
+    }
+    /* not every option is inherited from the listening socket */
+    try
+    {
+        ApplyOptions(ch);
+    }
+    catch (MiracException &x)
+    {
+        close(ch);
+        throw;
+    }
+    return Create(ch, options);
 }
 
 
@@ -183,6 +313,7 @@ bool MiracNetwork::Connect (const char *address, const char *service)
         addr->ai_socktype | SOCK_NONBLOCK, addr->ai_protocol);
     if (handle < 0)
         throw MiracException(errno, "socket()", __FUNCTION__);
+    ApplyOptions(handle);
     if (connect(handle, addr->ai_addr, addr->ai_addrlen))
     {
         if (errno == EINPROGRESS)
@@ -193,6 +324,50 @@ bool MiracNetwork::Connect (const char *address, const char *service)
 }
 
 
+bool MiracNetwork::ConnectAddress (const struct sockaddr *address,
+    socklen_t length)
+{
+    Close();
+
+    handle = socket(address->sa_family,
+        SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (handle < 0)
+        throw MiracException(errno, "socket()", __FUNCTION__);
+    ApplyOptions(handle);
+    if (connect(handle, address, length))
+    {
+        if (errno == EINPROGRESS)
+            return false;
+        throw MiracException(errno, "connect()", __FUNCTION__);
+    }
+    return true;
+}
+
+
+bool MiracNetwork::FinishConnect ()
+{
+    int ec = 0;
+    socklen_t optlen = sizeof(ec);
+
+    if (getsockopt(handle, SOL_SOCKET, SO_ERROR, &ec, &optlen))
+        throw MiracException(errno, "getsockopt()", __FUNCTION__);
+    if (ec)
+        throw MiracException(ec, "connect()", __FUNCTION__);
+
+    /* no error yet is not the same as connected */
+    struct sockaddr_storage peer;
+    socklen_t peerlen = sizeof(peer);
+    if (getpeername(handle,
+        reinterpret_cast<struct sockaddr *> (&peer), &peerlen))
+    {
+        if (errno == ENOTCONN)
+            return false;
+        throw MiracException(errno, "getpeername()", __FUNCTION__);
+    }
+    return true;
+}
+
+
 std::string MiracNetwork::GetPeerAddress ()
 {
     int ec;
@@ -242,16 +417,45 @@ unsigned short MiracNetwork::GetHostPort ()
 }
 
 
-bool MiracNetwork::Receive (std::string &message)
+void MiracNetwork::Reserve (size_t length)
 {
-    int ec;
-    size_t eom;
-    char nb[page_size];
+    /* move the unconsumed bytes to the front before growing the
+     * buffer */
+    if (recv_buf.size() - recv_end < length)
+    {
+        if (recv_begin > 0)
+        {
+            memmove(&recv_buf[0], &recv_buf[recv_begin],
+                recv_end - recv_begin);
+            recv_end -= recv_begin;
+            recv_scanned -= recv_begin;
+            recv_begin = 0;
+        }
+        if (recv_buf.size() - recv_end < length)
+            recv_buf.resize(std::max(2 * recv_buf.size(),
+                recv_end + length));
+    }
+}
+
+
+void MiracNetwork::Fill ()
+{
+    ssize_t ec;
 
     do {
-        ec = recv(handle, nb, page_size, 0);
+        /* keep at least a page free behind the data */
+        Reserve(page_size);
+
+        ec = recv(handle, &recv_buf[recv_end], recv_buf.size() - recv_end, 0);
         if (ec > 0)
-            recv_buf.append(nb, ec);
+        {
+            recv_end += ec;
+            if (options.quick_ack)
+            {
+                int on = 1;
+                setsockopt(handle, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+            }
+        }
         else if (ec < 0)
         {
             if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -261,64 +465,176 @@ bool MiracNetwork::Receive (std::string &message)
         else  // ec == 0
             throw MiracConnectionLostException( __FUNCTION__);
     } while (ec > 0);
+}
 
-    eom = recv_buf.find("\r\n\r\n");
-    if (eom == std::string::npos)
-        return false;
-    message = recv_buf.substr(0, eom + 4);
-    recv_buf.erase(0, eom + 4);
-    return true;
+
+void MiracNetwork::Consume ()
+{
+    /* drop the data handed out by the previous zero-copy Receive() */
+    if (recv_consumed)
+    {
+        recv_begin += recv_consumed;
+        recv_consumed = 0;
+        if (recv_begin == recv_end)
+            recv_begin = recv_end = 0;
+        recv_scanned = std::max(recv_scanned, recv_begin);
+        recv_scanned = std::min(recv_scanned, recv_end);
+    }
 }
 
 
-bool MiracNetwork::Receive (std::string &message, size_t length)
+bool MiracNetwork::FindHeaderEnd (size_t *end)
 {
-    int ec;
-    char nb[page_size];
+    /* resume where the previous search stopped, a terminator may have
+     * been split across two reads */
+    size_t pos = std::max(recv_begin, recv_scanned < 3 ? 0 : recv_scanned - 3);
 
-    do {
-        ec = recv(handle, nb, page_size, 0);
-        if (ec > 0)
-            recv_buf.append(nb, ec);
-        else if (ec < 0)
+    while (recv_end - pos >= 4)
+    {
+        const char *cr = static_cast<const char *> (
+            memchr(&recv_buf[pos], '\r', recv_end - pos - 3));
+        if (!cr)
+            break;
+        pos = cr - &recv_buf[0];
+        if (memcmp(cr, "\r\n\r\n", 4) == 0)
         {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-                break;
-            throw MiracException(errno, "recv()", __FUNCTION__);
+            *end = pos + 4;
+            recv_scanned = *end;
+            return true;
         }
-        else  // ec == 0
-            throw MiracConnectionLostException( __FUNCTION__);
-    } while (ec > 0);
+        ++pos;
+    }
+    recv_scanned = recv_end;
+    return false;
+}
+
+
+bool MiracNetwork::Receive (std::string &message)
+{
+    const char *data;
+    size_t length;
 
-    if (recv_buf.size() < length)
+    if (!Receive(&data, &length))
         return false;
+    message.assign(data, length);
+    return true;
+}
+
 
-    message = recv_buf.substr(0, length);
-    recv_buf.erase(0, length);
+bool MiracNetwork::Receive (std::string &message, size_t length)
+{
+    const char *data;
+
+    if (!ReceiveBody(&data, length))
+        return false;
+    message.assign(data, length);
     return true;
 }
 
 
-bool MiracNetwork::Send (const std::string &message)
+bool MiracNetwork::Receive (const char **message, size_t *length)
 {
-    int ec;
+    size_t eom;
+
+    Consume();
 
+    /* only read from the socket once the buffered data is used up */
+    if (!FindHeaderEnd(&eom))
+    {
+        Fill();
+        if (!FindHeaderEnd(&eom))
+            return false;
+    }
+    *message = recv_buf.data() + recv_begin;
+    *length = eom - recv_begin;
+    recv_consumed = *length;
+    return true;
+}
+
+
+bool MiracNetwork::ReceiveBody (const char **message, size_t length)
+{
+    Consume();
+
+    if (recv_end - recv_begin < length)
+    {
+        Fill();
+        if (recv_end - recv_begin < length)
+            return false;
+    }
+
+    *message = recv_buf.data() + recv_begin;
+    recv_consumed = length;
+    return true;
+}
+
+
+bool MiracNetwork::Send (const std::string &message)
+{
     if (!message.empty())
-        send_buf.append(message);
-    do {
-        ec = send(handle, send_buf.c_str(), send_buf.size(), MSG_NOSIGNAL);
-        if (ec > 0)
-            send_buf.erase(0, ec);
-        else
+        send_queue.push_back(message);
+    return Flush();
+}
+
+
+bool MiracNetwork::Send (std::string &&header, std::string &&payload)
+{
+    if (!header.empty())
+        send_queue.push_back(std::move(header));
+    if (!payload.empty())
+        send_queue.push_back(std::move(payload));
+    return Flush();
+}
+
+
+bool MiracNetwork::Flush ()
+{
+    ssize_t ec;
+    struct iovec iov[MIRAC_MAX_IOV];
+    struct msghdr msg;
+
+    while (!send_queue.empty())
+    {
+        size_t count = 0;
+        for (auto it = send_queue.begin();
+            it != send_queue.end() && count < MIRAC_MAX_IOV; ++it, ++count)
+        {
+            size_t offset = count ? 0 : send_offset;
+            iov[count].iov_base = const_cast<char *> (it->data()) + offset;
+            iov[count].iov_len = it->size() - offset;
+        }
+
+        memset(&msg, 0x00, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        /* one gathered call per MIRAC_MAX_IOV buffers, so a header and
+         * its payload already leave together */
+        ec = sendmsg(handle, &msg, MSG_NOSIGNAL);
+        if (ec < 0)
         {
             if (errno == EAGAIN || errno == EWOULDBLOCK)
                 return false;
             if (errno == EPIPE || errno == ENOTCONN)
                 throw MiracConnectionLostException(__FUNCTION__);
-            throw MiracException(errno, "send()", __FUNCTION__);
+            throw MiracException(errno, "sendmsg()", __FUNCTION__);
         }
-    } while (send_buf.size() > 0);
+
+        /* drop the buffers that went out completely */
+        size_t sent = ec;
+        while (sent > 0)
+        {
+            size_t left = send_queue.front().size() - send_offset;
+            if (sent < left)
+            {
+                send_offset += sent;
+                break;
+            }
+            sent -= left;
+            send_offset = 0;
+            send_queue.pop_front();
+        }
+    }
 
     return true;
 }
-
@@ -26,7 +26,11 @@
 #define MIRAC_NETWORK_HPP
 
 #include <cstring>
+#include <deque>
 #include <string>
+#include <vector>
+
+#include <sys/socket.h>
 
 #include <mirac-exception.hpp>
 
@@ -48,28 +52,131 @@ class MiracConnectionLostException : public MiracException
 class MiracNetwork
 {
     public:
+        /* tuning applied to the sockets Bind(), Connect() and Accept()
+         * create; by default only Nagle is off, see ControlChannel() */
+        struct Options {
+            Options () :
+                no_delay(true),
+                quick_ack(false),
+                keep_alive(false),
+                keep_idle(10),
+                keep_interval(2),
+                keep_count(3),
+                user_timeout(0),
+                priority(-1),
+                dscp(-1)
+                { }
+
+            /* for the RTSP control channel: a peer that went off the
+             * link is noticed within about 10 s, at the risk of
+             * dropping one that is just that slow */
+            static Options ControlChannel ()
+                {
+                    Options options;
+                    options.keep_alive = true;
+                    options.user_timeout = 10000;
+                    return options;
+                }
+
+            /* send small messages such as M5 triggers at once, rather
+             * than after the previous segment has been acknowledged */
+            bool no_delay;
+            /* acknowledge received data at once; Linux leaves quick ack
+             * mode by itself, so it is re-armed after every read at the
+             * cost of a syscall, not done by the io_uring transport */
+            bool quick_ack;
+            /* probe an idle peer after keep_idle seconds, every
+             * keep_interval seconds and keep_count times, a 0 keeps
+             * the system default for that value */
+            bool keep_alive;
+            int keep_idle;
+            int keep_interval;
+            int keep_count;
+            /* milliseconds sent data may stay unacknowledged before the
+             * connection is dropped, 0 keeps the system default */
+            unsigned int user_timeout;
+            /* SO_PRIORITY and DSCP code point, -1 leaves them alone */
+            int priority;
+            int dscp;
+        };
+
         MiracNetwork ();
         MiracNetwork (int conn_handle);
         virtual ~MiracNetwork ();
-        void Bind (const char *address, const char *service);
+        /* wraps an accepted socket with the best transport available,
+         * see MIRAC_IO_URING; options are expected to be applied
+         * already */
+        static MiracNetwork * Create (int conn_handle,
+                                      const Options &options = Options());
+        /* applies to the open socket, if any, and the ones created
+         * later */
+        void SetOptions (const Options &options);
+        const Options & GetOptions () const
+            { return options; }
+        /* with reuse_port several sockets, e.g. one per thread, can
+         * listen on the same port and the kernel spreads connections
+         * between them */
+        void Bind (const char *address, const char *service,
+                   int backlog = 1, bool reuse_port = false);
+        /* returns NULL once there are no more pending connections */
         MiracNetwork * Accept ();
         bool Connect (const char *address, const char *service);
+        /* non-blocking connect to a single resolved address, returns
+         * true when it completed at once, otherwise FinishConnect()
+         * tells the outcome once the handle is writable */
+        bool ConnectAddress (const struct sockaddr *address,
+                             socklen_t length);
+        /* false while the connect is still in progress, throws when it
+         * failed */
+        bool FinishConnect ();
         int GetHandle () const
             { return handle; }
+        /* descriptor the event loop has to watch, a completion based
+         * transport reports both received data and finished sends by
+         * it becoming readable */
+        virtual int GetPollHandle () const
+            { return handle; }
+        virtual bool IsCompletionBased () const
+            { return false; }
         std::string GetPeerAddress ();
         unsigned short GetHostPort ();
         bool Receive (std::string &message);
         bool Receive (std::string &message, size_t length);
+        /* zero-copy variants, *message points into the receive buffer
+         * and stays valid until the next Receive() or Send() call;
+         * ReceiveBody() waits for exactly length bytes */
+        bool Receive (const char **message, size_t *length);
+        bool ReceiveBody (const char **message, size_t length);
         bool Send (const std::string &message = std::string());
+        /* queues both buffers as they are, without joining them */
+        bool Send (std::string &&header, std::string &&payload);
 
     protected:
         int handle;
+        Options options;
         size_t page_size;
-        std::string recv_buf;
-        std::string send_buf;
+        /* received data lives in recv_buf[recv_begin, recv_end),
+         * recv_scanned is how far it has been searched for the end of
+         * a header */
+        std::vector<char> recv_buf;
+        size_t recv_begin;
+        size_t recv_end;
+        size_t recv_scanned;
+        size_t recv_consumed;
+        /* messages waiting to be sent, send_offset bytes of the first
+         * one are already out */
+        std::deque<std::string> send_queue;
+        size_t send_offset;
 
         void Init ();
         void Close ();
+        void ApplyOptions (int conn_handle) const;
+        /* makes room for at least length bytes at recv_end */
+        void Reserve (size_t length);
+        virtual void Fill ();
+        void Consume ();
+        bool FindHeaderEnd (size_t *end);
+        virtual bool Flush ();
 
     private:
         void *conn_ares;
@@ -0,0 +1,138 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <future>
+#include <string>
+
+#include <glib.h>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "mirac-exception.hpp"
+#include "mirac-reactor-pool.hpp"
+
+MiracReactorPool::MiracReactorPool (unsigned int count)
+{
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        std::unique_ptr<Shard> shard(new Shard);
+        shard->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard->wakeup < 0)
+            throw MiracException(errno, "eventfd()", __FUNCTION__);
+        shards.push_back(std::move(shard));
+    }
+}
+
+MiracReactorPool::~MiracReactorPool ()
+{
+    Stop();
+    for (auto &shard : shards)
+        close(shard->wakeup);
+}
+
+void MiracReactorPool::Run (Shard *shard, unsigned int index,
+    const ShardInit &init, std::function<void (std::exception_ptr)> started)
+{
+    uint64_t value;
+
+    /* drop a quit request left over from an earlier Stop() */
+    while (read(shard->wakeup, &value, sizeof(value)) > 0)
+        ;
+
+    try
+    {
+        MiracEpollReactor reactor;
+        reactor.AddWatch(shard->wakeup, MiracReactor::READABLE,
+            [&reactor] (int fd, unsigned int) {
+                uint64_t value;
+                if (read(fd, &value, sizeof(value)) > 0)
+                    reactor.Quit();
+                return true;
+            });
+
+        /* declared after the reactor, so it goes first even when Run()
+         * throws */
+        std::shared_ptr<void> state = init(&reactor, index);
+        started(nullptr);
+        reactor.Run();
+    }
+    catch (std::exception &x)
+    {
+        g_warning("shard %u: exception: %s", index, x.what());
+        started(std::current_exception());
+    }
+}
+
+void MiracReactorPool::Start (const ShardInit &init)
+{
+    for (unsigned int i = 0; i < shards.size(); i++)
+    {
+        Shard *shard = shards[i].get();
+        if (shard->thread.joinable())
+            continue;
+
+        auto result = std::make_shared<std::promise<void>>();
+        auto started = [result] (std::exception_ptr error) mutable {
+            if (!result)
+                return;
+            if (error)
+                result->set_exception(error);
+            else
+                result->set_value();
+            result.reset();
+        };
+        std::future<void> done = result->get_future();
+
+        shard->thread = std::thread(&MiracReactorPool::Run, this, shard, i,
+            init, started);
+        try
+        {
+            done.get();
+        }
+        catch (...)
+        {
+            shard->thread.join();
+            Stop();
+            throw;
+        }
+    }
+}
+
+void MiracReactorPool::Stop ()
+{
+    for (auto &shard : shards)
+    {
+        if (!shard->thread.joinable())
+            continue;
+        uint64_t value = 1;
+        if (write(shard->wakeup, &value, sizeof(value)) < 0)
+            throw MiracException(errno, "write()", __FUNCTION__);
+        shard->thread.join();
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_REACTOR_POOL_HPP
+#define MIRAC_REACTOR_POOL_HPP
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mirac-epoll-reactor.hpp"
+
+/* Runs a number of shards, each an epoll reactor on its own thread.
+ * Every shard creates its own brokers, typically listening on a shared
+ * port with reuse_port, so sessions and parser state stay on the thread
+ * that accepted them and nothing is shared between shards. */
+class MiracReactorPool
+{
+    public:
+        /* called on the shard's thread before its reactor runs, the
+         * returned state (e.g. the shard's broker) is released on the
+         * same thread once the reactor has stopped */
+        typedef std::function<std::shared_ptr<void> (MiracReactor *reactor,
+                                                     unsigned int shard)> ShardInit;
+
+        explicit MiracReactorPool (unsigned int shards);
+        ~MiracReactorPool ();
+
+        unsigned int GetShardCount () const
+            { return shards.size(); }
+
+        /* starts the shards one after the other, init has returned on
+         * the previous shard before the next one starts, and rethrows
+         * the first exception init raises */
+        void Start (const ShardInit &init);
+        /* quits every reactor and joins the threads */
+        void Stop ();
+
+    private:
+        struct Shard {
+            std::thread thread;
+            /* eventfd that asks the shard to quit */
+            int wakeup;
+        };
+
+        void Run (Shard *shard, unsigned int index, const ShardInit &init,
+                  std::function<void (std::exception_ptr)> started);
+
+        std::vector<std::unique_ptr<Shard>> shards;
+};
+
+
+#endif  /* MIRAC_REACTOR_POOL_HPP */
@@ -0,0 +1,63 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_REACTOR_HPP
+#define MIRAC_REACTOR_HPP
+
+#include <functional>
+
+/* Event demultiplexer the broker registers its sockets and timers with.
+ * Callbacks return true to stay registered and false to be removed. */
+class MiracReactor
+{
+    public:
+        enum Events {
+            READABLE = 1 << 0,
+            WRITABLE = 1 << 1
+        };
+
+        typedef unsigned int Id;
+        typedef std::function<bool (int fd, unsigned int events)> WatchCallback;
+        typedef std::function<bool ()> TimeoutCallback;
+
+        virtual ~MiracReactor () {}
+
+        /* watches fd for any of READABLE | WRITABLE, returns a non-zero id;
+         * backends may be edge-triggered, so callbacks must handle the fd
+         * until it would block */
+        virtual Id AddWatch (int fd, unsigned int events,
+                             const WatchCallback &callback) = 0;
+        /* calls callback every milliseconds until it returns false */
+        virtual Id AddTimeout (unsigned int milliseconds,
+                               const TimeoutCallback &callback) = 0;
+        virtual void Remove (Id id) = 0;
+
+        /* dispatches events until Quit() */
+        virtual void Run () = 0;
+        virtual void Quit () = 0;
+
+        /* GLib default main context backend used when none is given */
+        static MiracReactor *Default ();
+};
+
+
+#endif  /* MIRAC_REACTOR_HPP */
@@ -0,0 +1,290 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+
+#include "mirac-exception.hpp"
+#include "mirac-rtp-sender.hpp"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace {
+
+const size_t datagram_size = MiracRtpSender::RTP_HEADER_SIZE +
+    MiracRtpSender::TS_PACKETS_PER_DATAGRAM * MiracRtpSender::TS_PACKET_SIZE;
+
+/* a segmented send is still one UDP datagram for the stack, so it has
+ * to fit into 64 KB; the kernel takes at most 64 segments at once */
+const size_t max_segments = std::min<size_t>(64, 65507 / datagram_size);
+const size_t max_batch = 64;
+
+bool retry (int error, bool &refused)
+{
+    if (error == EINTR)
+        return true;
+    /* an earlier datagram got an ICMP port unreachable: the error has
+     * been reported now, so the send can go through. Happens when the
+     * sink has not bound the port yet. */
+    if (error == ECONNREFUSED && !refused) {
+        refused = true;
+        return true;
+    }
+    return false;
+}
+
+}
+
+MiracRtpSender::MiracRtpSender (const std::string &host, int port, Mode requested) :
+    fd(-1),
+    mode(requested),
+    automatic(requested == AUTO)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo *addrs;
+    std::string service = std::to_string(port);
+    int err = getaddrinfo(host.c_str(), service.c_str(), &hints, &addrs);
+    if (err != 0)
+        throw MiracException(gai_strerror(err), __FUNCTION__);
+
+    int error = 0;
+    for (struct addrinfo *addr = addrs; addr; addr = addr->ai_next) {
+        fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC,
+                    addr->ai_protocol);
+        if (fd < 0) {
+            error = errno;
+            continue;
+        }
+        if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0)
+            break;
+        error = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0)
+        throw MiracException(error, "connect()", __FUNCTION__);
+
+    if (mode == AUTO || mode == SEGMENT_OFFLOAD) {
+        int size = datagram_size;
+        if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &size, sizeof(size)) == 0) {
+            mode = SEGMENT_OFFLOAD;
+        } else if (mode == AUTO) {
+            mode = SENDMMSG;
+        } else {
+            error = errno;
+            close(fd);
+            throw MiracException(error, "setsockopt(UDP_SEGMENT)", __FUNCTION__);
+        }
+    }
+
+    std::random_device random;
+    sequence = random();
+    ssrc = random();
+    timestamp_offset = random();
+}
+
+MiracRtpSender::~MiracRtpSender ()
+{
+    close(fd);
+}
+
+void MiracRtpSender::Send (const uint8_t *ts, size_t length, uint32_t timestamp)
+{
+    size_t packets = length / TS_PACKET_SIZE;
+    size_t count = (packets + TS_PACKETS_PER_DATAGRAM - 1) / TS_PACKETS_PER_DATAGRAM;
+    if (count == 0)
+        return;
+
+    headers.resize(count * RTP_HEADER_SIZE);
+    iov.resize(count * 2);
+    timestamp += timestamp_offset;
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *header = &headers[i * RTP_HEADER_SIZE];
+        header[0] = 0x80;
+        header[1] = PAYLOAD_TYPE_MP2T;
+        header[2] = sequence >> 8;
+        header[3] = sequence & 0xff;
+        header[4] = timestamp >> 24;
+        header[5] = (timestamp >> 16) & 0xff;
+        header[6] = (timestamp >> 8) & 0xff;
+        header[7] = timestamp & 0xff;
+        header[8] = ssrc >> 24;
+        header[9] = (ssrc >> 16) & 0xff;
+        header[10] = (ssrc >> 8) & 0xff;
+        header[11] = ssrc & 0xff;
+        sequence++;
+
+        size_t first = i * TS_PACKETS_PER_DATAGRAM;
+        size_t payload = std::min<size_t>(TS_PACKETS_PER_DATAGRAM,
+                                          packets - first) * TS_PACKET_SIZE;
+        iov[i * 2].iov_base = header;
+        iov[i * 2].iov_len = RTP_HEADER_SIZE;
+        iov[i * 2 + 1].iov_base = const_cast<uint8_t*>(ts) + first * TS_PACKET_SIZE;
+        iov[i * 2 + 1].iov_len = payload;
+    }
+
+    size_t done = 0;
+    while (done < count) {
+        switch (mode) {
+        case SEGMENT_OFFLOAD:
+            done += SendSegmented(done, count - done);
+            break;
+        case SENDMMSG:
+        case AUTO:
+            done += SendBatch(done, count - done);
+            break;
+        case SENDTO:
+            done += SendEach(done);
+            break;
+        }
+    }
+}
+
+/* returns how many datagrams are off the list, sent or dropped; 0 means
+ * try again in the (new) mode */
+size_t MiracRtpSender::SendSegmented (size_t first, size_t count)
+{
+    count = std::min(count, max_segments);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov[first * 2];
+    msg.msg_iovlen = count * 2;
+
+    ssize_t sent;
+    bool refused = false;
+    do {
+        sent = sendmsg(fd, &msg, 0);
+        stats.syscalls++;
+    } while (sent < 0 && retry(errno, refused));
+
+    if (sent < 0) {
+        /* no checksum offload on the route (EIO) or a kernel that knows
+         * the option but not the path: cut the datagrams ourselves */
+        if (automatic && (errno == EIO || errno == EINVAL)) {
+            int off = 0;
+            setsockopt(fd, SOL_UDP, UDP_SEGMENT, &off, sizeof(off));
+            mode = SENDMMSG;
+            return 0;
+        }
+        stats.errors += count;
+        return count;
+    }
+
+    stats.datagrams += count;
+    stats.bytes += sent;
+    return count;
+}
+
+size_t MiracRtpSender::SendBatch (size_t first, size_t count)
+{
+    count = std::min(count, max_batch);
+
+    messages.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        memset(&messages[i], 0, sizeof(messages[i]));
+        messages[i].msg_hdr.msg_iov = &iov[(first + i) * 2];
+        messages[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    int sent;
+    bool refused = false;
+    do {
+        sent = sendmmsg(fd, &messages[0], count, 0);
+        stats.syscalls++;
+    } while (sent < 0 && retry(errno, refused));
+
+    if (sent <= 0) {
+        /* sendmmsg() only fails if the first datagram did */
+        stats.errors++;
+        return 1;
+    }
+
+    for (int i = 0; i < sent; i++)
+        stats.bytes += messages[i].msg_len;
+    stats.datagrams += sent;
+    return sent;
+}
+
+size_t MiracRtpSender::SendEach (size_t first)
+{
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov[first * 2];
+    msg.msg_iovlen = 2;
+
+    ssize_t sent;
+    bool refused = false;
+    do {
+        sent = sendmsg(fd, &msg, 0);
+        stats.syscalls++;
+    } while (sent < 0 && retry(errno, refused));
+
+    if (sent < 0) {
+        stats.errors++;
+    } else {
+        stats.datagrams++;
+        stats.bytes += sent;
+    }
+    return 1;
+}
+
+int MiracRtpSender::LocalPort () const
+{
+    struct sockaddr_storage addr;
+    socklen_t length = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr*)&addr, &length) < 0)
+        return -1;
+    if (addr.ss_family == AF_INET6)
+        return ntohs(((struct sockaddr_in6*)&addr)->sin6_port);
+    return ntohs(((struct sockaddr_in*)&addr)->sin_port);
+}
+
+const char *MiracRtpSender::ModeName (Mode mode)
+{
+    switch (mode) {
+    case AUTO:
+        return "auto";
+    case SEGMENT_OFFLOAD:
+        return "gso";
+    case SENDMMSG:
+        return "sendmmsg";
+    case SENDTO:
+        return "sendto";
+    }
+    return "unknown";
+}
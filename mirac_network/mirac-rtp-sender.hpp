@@ -0,0 +1,112 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef MIRAC_RTP_SENDER_HPP
+#define MIRAC_RTP_SENDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Packs an MPEG-TS stream into RTP (RFC 2250, seven TS packets per
+ * datagram, like rtpmp2tpay) and sends all the datagrams of one Send()
+ * with as few syscalls as the kernel allows. */
+class MiracRtpSender
+{
+    public:
+        enum Mode {
+            /* SEGMENT_OFFLOAD if the kernel has it, SENDMMSG otherwise */
+            AUTO,
+            /* one sendmsg() per up to 64 KB, the kernel or the NIC cuts
+             * it into datagrams (UDP_SEGMENT, Linux 4.18) */
+            SEGMENT_OFFLOAD,
+            /* one sendmmsg() per up to 64 datagrams */
+            SENDMMSG,
+            /* one syscall per datagram, what udpsink does */
+            SENDTO
+        };
+
+        struct Statistics {
+            Statistics ()
+                : datagrams(0),
+                  bytes(0),
+                  syscalls(0),
+                  errors(0) {}
+
+            uint64_t datagrams;
+            uint64_t bytes;
+            uint64_t syscalls;
+            uint64_t errors;
+        };
+
+        enum {
+            TS_PACKET_SIZE = 188,
+            TS_PACKETS_PER_DATAGRAM = 7,
+            RTP_HEADER_SIZE = 12,
+            PAYLOAD_TYPE_MP2T = 33
+        };
+
+        /* throws MiracException if the peer cannot be resolved or the
+         * socket cannot be set up */
+        MiracRtpSender (const std::string &host, int port, Mode mode = AUTO);
+        ~MiracRtpSender ();
+
+        /* ts holds whole TS packets, typically all of one frame, and
+         * timestamp is its 90 kHz media time, to which the random RTP
+         * offset is added; failures are counted in the statistics, a
+         * dropped datagram is no reason to stop */
+        void Send (const uint8_t *ts, size_t length, uint32_t timestamp);
+
+        int LocalPort () const;
+        /* what AUTO turned into */
+        Mode GetMode () const
+            { return mode; }
+        const Statistics &GetStatistics () const
+            { return stats; }
+
+        static const char *ModeName (Mode mode);
+
+    private:
+        size_t SendSegmented (size_t first, size_t count);
+        size_t SendBatch (size_t first, size_t count);
+        size_t SendEach (size_t first);
+
+        int fd;
+        Mode mode;
+        /* AUTO falls back to SENDMMSG if the device refuses segments */
+        bool automatic;
+        uint16_t sequence;
+        uint32_t ssrc;
+        uint32_t timestamp_offset;
+
+        /* per Send(), kept to avoid reallocating them */
+        std::vector<uint8_t> headers;
+        std::vector<struct iovec> iov;
+        std::vector<struct mmsghdr> messages;
+
+        Statistics stats;
+};
+
+#endif  /* MIRAC_RTP_SENDER_HPP */
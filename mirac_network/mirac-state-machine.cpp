@@ -0,0 +1,139 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+
+#include "mirac-state-machine.hpp"
+#include "triggermethod.h"
+
+MiracHistogram::MiracHistogram () :
+    count(0),
+    max(0)
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void MiracHistogram::Add (uint64_t microseconds)
+{
+    /* bucket n holds [2^(n-1), 2^n) */
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && (microseconds >> bucket))
+        bucket++;
+    buckets[bucket]++;
+    count++;
+    if (microseconds > max)
+        max = microseconds;
+}
+
+uint64_t MiracHistogram::Percentile (double fraction) const
+{
+    uint64_t wanted = static_cast<uint64_t> (fraction * count + 0.5);
+    uint64_t seen = 0;
+
+    for (int bucket = 0; bucket < BUCKETS; bucket++)
+    {
+        seen += buckets[bucket];
+        if (seen >= wanted && seen)
+            return std::min(max, (static_cast<uint64_t> (1) << bucket) - 1);
+    }
+    return max;
+}
+
+MiracStateMachineBase::MessageKind
+MiracStateMachineBase::Classify (const WFD::Message &message)
+{
+    switch (message.type())
+    {
+    case WFD::Message::MessageTypeOptions:
+        return OPTIONS;
+    case WFD::Message::MessageTypeGetParameter:
+        return GET_PARAMETER;
+    case WFD::Message::MessageTypeSetParameter:
+        break;
+    case WFD::Message::MessageTypeSetup:
+        return SETUP;
+    case WFD::Message::MessageTypePlay:
+        return PLAY;
+    case WFD::Message::MessageTypePause:
+        return PAUSE;
+    case WFD::Message::MessageTypeTeardown:
+        return TEARDOWN;
+    default:
+        return OTHER;
+    }
+
+    if (!message.payload().has_property(WFD::PropertyType::WFD_TRIGGER_METHOD)) {
+        /* M13 names the parameter without a value */
+        const auto &names = message.payload().get_parameter_property_types();
+        if (std::find(names.begin(), names.end(), WFD::PropertyType::WFD_IDR_REQUEST) != names.end())
+            return IDR_REQUEST;
+        return SET_PARAMETER;
+    }
+    auto trigger = std::static_pointer_cast<WFD::TriggerMethod> (
+        message.payload().get_property(WFD::PropertyType::WFD_TRIGGER_METHOD));
+    switch (trigger->method())
+    {
+    case WFD::TriggerMethod::SETUP:
+        return TRIGGER_SETUP;
+    case WFD::TriggerMethod::PLAY:
+        return TRIGGER_PLAY;
+    case WFD::TriggerMethod::PAUSE:
+        return TRIGGER_PAUSE;
+    case WFD::TriggerMethod::TEARDOWN:
+        return TRIGGER_TEARDOWN;
+    }
+    return OTHER;
+}
+
+const char *MiracStateMachineBase::KindName (MessageKind kind)
+{
+    static const char *names[MESSAGE_KIND_COUNT] = {
+        "OPTIONS",
+        "GET_PARAMETER",
+        "SET_PARAMETER",
+        "TRIGGER_SETUP",
+        "TRIGGER_PLAY",
+        "TRIGGER_PAUSE",
+        "TRIGGER_TEARDOWN",
+        "IDR_REQUEST",
+        "SETUP",
+        "PLAY",
+        "PAUSE",
+        "TEARDOWN",
+        "OTHER"
+    };
+    return kind < MESSAGE_KIND_COUNT ? names[kind] : "?";
+}
+
+void MiracStateMachineBase::PrintHistogram (std::ostream &out,
+    const char *state, MessageKind kind, const MiracHistogram &histogram)
+{
+    out << std::left << std::setw(28) << state
+        << std::setw(18) << KindName(kind) << std::right
+        << " count " << std::setw(6) << histogram.Count()
+        << " p50 " << std::setw(9) << histogram.Percentile(0.5)
+        << " p99 " << std::setw(9) << histogram.Percentile(0.99)
+        << " max " << std::setw(9) << histogram.Max() << " us"
+        << std::endl;
+}
@@ -0,0 +1,168 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_STATE_MACHINE_HPP
+#define MIRAC_STATE_MACHINE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+#include "message.h"
+
+/* Durations in microseconds, counted in power of two buckets */
+class MiracHistogram
+{
+    public:
+        MiracHistogram ();
+
+        void Add (uint64_t microseconds);
+        uint64_t Count () const
+            { return count; }
+        uint64_t Max () const
+            { return max; }
+        /* upper bound of the bucket holding that fraction of the
+         * samples, e.g. 0.99 */
+        uint64_t Percentile (double fraction) const;
+
+    private:
+        enum { BUCKETS = 40 };
+
+        uint64_t buckets[BUCKETS];
+        uint64_t count;
+        uint64_t max;
+};
+
+/* Session state machine parts that do not depend on the owner */
+class MiracStateMachineBase
+{
+    public:
+        /* what an incoming request asks for, SET_PARAMETER is split by
+         * its wfd_trigger_method or wfd_idr_request */
+        enum MessageKind {
+            OPTIONS,
+            GET_PARAMETER,
+            SET_PARAMETER,
+            TRIGGER_SETUP,
+            TRIGGER_PLAY,
+            TRIGGER_PAUSE,
+            TRIGGER_TEARDOWN,
+            IDR_REQUEST,
+            SETUP,
+            PLAY,
+            PAUSE,
+            TEARDOWN,
+            OTHER,
+            MESSAGE_KIND_COUNT
+        };
+
+        static MessageKind Classify (const WFD::Message &message);
+        static const char *KindName (MessageKind kind);
+
+    protected:
+        typedef std::chrono::steady_clock Clock;
+
+        static void PrintHistogram (std::ostream &out, const char *state,
+                                    MessageKind kind,
+                                    const MiracHistogram &histogram);
+};
+
+/* Dispatches requests through a state x message kind table of Owner
+ * member functions. Owner lists its transitions once, typically in a
+ * static const array, and each instance expands them into a dense table
+ * so that a dispatch is a single lookup. Every transition also records
+ * how long the session took to get there since the previous one, which
+ * shows where session setup time goes. */
+template <class Owner, int StateCount>
+class MiracStateMachine : public MiracStateMachineBase
+{
+    public:
+        typedef void (Owner::*Handler) (std::shared_ptr<WFD::Message> message);
+
+        /* handler runs for kind in every state from first_state to
+         * last_state */
+        struct Transition {
+            int first_state;
+            int last_state;
+            MessageKind kind;
+            Handler handler;
+        };
+
+        template <size_t N>
+        explicit MiracStateMachine (const Transition (&transitions)[N]) :
+            last(Clock::now())
+            {
+                for (int state = 0; state < StateCount; state++)
+                    for (int kind = 0; kind < MESSAGE_KIND_COUNT; kind++)
+                        table[state][kind] = NULL;
+                for (size_t i = 0; i < N; i++)
+                    for (int state = transitions[i].first_state;
+                         state <= transitions[i].last_state; state++)
+                        table[state][transitions[i].kind] = transitions[i].handler;
+            }
+
+        /* calls the handler for the message in state, returns false when
+         * there is none */
+        bool Dispatch (Owner *owner, int state,
+                       std::shared_ptr<WFD::Message> message)
+            {
+                MessageKind kind = Classify(*message);
+                Handler handler = table[state][kind];
+                if (!handler)
+                    return false;
+
+                (owner->*handler)(message);
+
+                Clock::time_point now = Clock::now();
+                histograms[state][kind].Add(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - last).count());
+                last = now;
+                return true;
+            }
+
+        /* the first transition of a session is timed from here */
+        void Restart ()
+            { last = Clock::now(); }
+
+        /* one line per transition taken, in microseconds */
+        void PrintStatistics (std::ostream &out,
+                              const char *const state_names[]) const
+            {
+                for (int state = 0; state < StateCount; state++)
+                    for (int kind = 0; kind < MESSAGE_KIND_COUNT; kind++)
+                        if (histograms[state][kind].Count())
+                            PrintHistogram(out, state_names[state],
+                                           static_cast<MessageKind>(kind),
+                                           histograms[state][kind]);
+            }
+
+    private:
+        Handler table[StateCount][MESSAGE_KIND_COUNT];
+        MiracHistogram histograms[StateCount][MESSAGE_KIND_COUNT];
+        Clock::time_point last;
+};
+
+
+#endif  /* MIRAC_STATE_MACHINE_HPP */
@@ -0,0 +1,454 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/io_uring.h>
+
+#include "mirac-uring-network.hpp"
+
+#define MIRAC_URING_ENTRIES     32
+#define MIRAC_URING_CQ_ENTRIES  256
+/* must be a power of two */
+#define MIRAC_URING_BUFFERS     8
+#define MIRAC_URING_BGID        0
+#define MIRAC_URING_MAX_CHAIN   16
+#define MIRAC_URING_RECV        1
+#define MIRAC_URING_SEND        2
+
+
+MiracUringNetwork::MiracUringNetwork (int conn_handle) :
+    MiracNetwork(conn_handle)
+{
+    try
+    {
+        Setup();
+    }
+    catch (...)
+    {
+        Teardown();
+        /* the caller keeps the socket to fall back on */
+        handle = -1;
+        throw;
+    }
+}
+
+
+MiracUringNetwork::~MiracUringNetwork ()
+{
+    Teardown();
+}
+
+
+bool MiracUringNetwork::IsSupported ()
+{
+    static const bool supported = [] () {
+        struct utsname name;
+        int major = 0;
+        int minor = 0;
+
+        /* multishot recv is 6.0+, registered buffer rings 5.19+ */
+        if (uname(&name) ||
+            sscanf(name.release, "%d.%d", &major, &minor) != 2 ||
+            major < 6)
+            return false;
+
+        struct io_uring_params params;
+        memset(&params, 0x00, sizeof(params));
+        int fd = syscall(__NR_io_uring_setup, 2, &params);
+        if (fd < 0)
+            return false;
+        close(fd);
+        return (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    } ();
+
+    return supported;
+}
+
+
+void MiracUringNetwork::Setup ()
+{
+    struct io_uring_params params;
+
+    ring_handle = -1;
+    ring_ptr = MAP_FAILED;
+    sqes_ptr = MAP_FAILED;
+    buf_ring = NULL;
+    recv_armed = false;
+    recv_closed = false;
+    recv_error = 0;
+    send_inflight = 0;
+    send_broken = false;
+    send_error = 0;
+
+    memset(&params, 0x00, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = MIRAC_URING_CQ_ENTRIES;
+    ring_handle = syscall(__NR_io_uring_setup, MIRAC_URING_ENTRIES, &params);
+    if (ring_handle < 0)
+        throw MiracException(errno, "io_uring_setup()", __FUNCTION__);
+
+    ring_size = std::max(
+        params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+    ring_ptr = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_handle, IORING_OFF_SQ_RING);
+    if (ring_ptr == MAP_FAILED)
+        throw MiracException(errno, "mmap()", __FUNCTION__);
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ptr = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_handle, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED)
+        throw MiracException(errno, "mmap()", __FUNCTION__);
+
+    char *ring = static_cast<char *> (ring_ptr);
+    sq_head = reinterpret_cast<unsigned int *> (ring + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned int *> (ring + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned int *> (ring + params.sq_off.ring_mask);
+    sq_flags = reinterpret_cast<unsigned int *> (ring + params.sq_off.flags);
+    sq_array = reinterpret_cast<unsigned int *> (ring + params.sq_off.array);
+    sqes = static_cast<struct io_uring_sqe *> (sqes_ptr);
+    sq_local_tail = *sq_tail;
+    to_submit = 0;
+    cq_head = reinterpret_cast<unsigned int *> (ring + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned int *> (ring + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned int *> (ring + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *> (ring + params.cq_off.cqes);
+
+    /* the buffer ring has to be page aligned */
+    buf_ring_size = std::max(page_size,
+        MIRAC_URING_BUFFERS * sizeof(struct io_uring_buf));
+    void *ptr = mmap(NULL, buf_ring_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        throw MiracException(errno, "mmap()", __FUNCTION__);
+    buf_ring = static_cast<struct io_uring_buf_ring *> (ptr);
+    buf_tail = 0;
+    buffers.resize(MIRAC_URING_BUFFERS * page_size);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0x00, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t> (buf_ring);
+    reg.ring_entries = MIRAC_URING_BUFFERS;
+    reg.bgid = MIRAC_URING_BGID;
+    if (syscall(__NR_io_uring_register, ring_handle,
+        IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        throw MiracException(errno, "io_uring_register()", __FUNCTION__);
+    for (unsigned int i = 0; i < MIRAC_URING_BUFFERS; i++)
+        Recycle(i);
+
+    QueueRecv();
+    try
+    {
+        Submit();
+    }
+    catch (...)
+    {
+        /* the recv never reached the kernel, so Teardown() has nothing
+         * to wait for and must not shut down the socket the caller
+         * falls back on */
+        recv_armed = false;
+        throw;
+    }
+}
+
+
+void MiracUringNetwork::Teardown ()
+{
+    if (recv_armed || send_inflight)
+    {
+        /* make the pending recv and sends complete, they must not touch
+         * the buffers once these are gone */
+        shutdown(handle, SHUT_RDWR);
+        try
+        {
+            for (int i = 0; i < 100 && (recv_armed || send_inflight); i++)
+            {
+                Submit(1);
+                Drain();
+            }
+        }
+        catch (std::exception &x)
+        {
+        }
+    }
+
+    if (buf_ring)
+        munmap(buf_ring, buf_ring_size);
+    if (sqes_ptr != MAP_FAILED)
+        munmap(sqes_ptr, sqes_size);
+    if (ring_ptr != MAP_FAILED)
+        munmap(ring_ptr, ring_size);
+    if (ring_handle >= 0)
+        close(ring_handle);
+    buf_ring = NULL;
+    sqes_ptr = MAP_FAILED;
+    ring_ptr = MAP_FAILED;
+    ring_handle = -1;
+}
+
+
+void MiracUringNetwork::Recycle (unsigned int buffer_id)
+{
+    /* the ring is an array of io_uring_buf with the tail overlaid on
+     * the first one, bufs[] itself is misplaced when the kernel header
+     * is compiled as C++ */
+    struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf *> (
+        buf_ring) + (buf_tail & (MIRAC_URING_BUFFERS - 1));
+
+    buf->addr = reinterpret_cast<uint64_t> (&buffers[buffer_id * page_size]);
+    buf->len = page_size;
+    buf->bid = buffer_id;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+
+struct io_uring_sqe * MiracUringNetwork::GetSqe ()
+{
+    unsigned int entries = *sq_mask + 1;
+
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= entries)
+    {
+        Submit();
+        if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= entries)
+            throw MiracException(EBUSY, "submission queue full", __FUNCTION__);
+    }
+
+    unsigned int index = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0x00, sizeof(*sqe));
+    sq_array[index] = index;
+    sq_local_tail++;
+    to_submit++;
+    return sqe;
+}
+
+
+void MiracUringNetwork::Submit (unsigned int wait)
+{
+    if (!to_submit && !wait)
+        return;
+
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    int ec = syscall(__NR_io_uring_enter, ring_handle, to_submit, wait,
+        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (ec < 0)
+    {
+        /* the entries stay queued for the next call */
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            return;
+        throw MiracException(errno, "io_uring_enter()", __FUNCTION__);
+    }
+    to_submit -= std::min(to_submit, static_cast<unsigned int> (ec));
+}
+
+
+void MiracUringNetwork::QueueRecv ()
+{
+    if (recv_armed || recv_closed || recv_error)
+        return;
+
+    struct io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = handle;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = MIRAC_URING_BGID;
+    sqe->user_data = MIRAC_URING_RECV;
+    recv_armed = true;
+}
+
+
+void MiracUringNetwork::QueueSends ()
+{
+    /* a new chain only starts once the previous one has completed, so
+     * the data goes out in order */
+    if (send_inflight || send_error || send_queue.empty())
+        return;
+
+    unsigned int count = std::min(send_queue.size(),
+        static_cast<size_t> (MIRAC_URING_MAX_CHAIN));
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const std::string &message = send_queue[i];
+        size_t offset = i ? 0 : send_offset;
+        bool last = (i + 1 == count);
+
+        struct io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = handle;
+        sqe->addr = reinterpret_cast<uint64_t> (message.data() + offset);
+        sqe->len = message.size() - offset;
+        /* WAITALL has the kernel retry short sends itself */
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        if (!last || count < send_queue.size())
+            sqe->msg_flags |= MSG_MORE;
+        if (!last)
+            sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = MIRAC_URING_SEND;
+        send_inflight++;
+    }
+    send_broken = false;
+}
+
+
+void MiracUringNetwork::HandleRecv (const struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+        recv_armed = false;
+
+    if (cqe->res > 0)
+    {
+        unsigned int buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        Reserve(cqe->res);
+        memcpy(&recv_buf[recv_end], &buffers[buffer_id * page_size],
+            cqe->res);
+        recv_end += cqe->res;
+        Recycle(buffer_id);
+    }
+    else if (cqe->res == 0)
+        recv_closed = true;
+    /* out of buffers only stops the multishot recv, it is re-armed */
+    else if (cqe->res != -ENOBUFS)
+        recv_error = -cqe->res;
+}
+
+
+void MiracUringNetwork::HandleSend (const struct io_uring_cqe *cqe)
+{
+    send_inflight--;
+
+    /* the rest of a broken chain is cancelled, it is sent again by the
+     * next one */
+    if (send_broken)
+        return;
+
+    if (cqe->res < 0)
+    {
+        send_broken = true;
+        if (cqe->res != -EAGAIN && cqe->res != -EINTR)
+            send_error = -cqe->res;
+        return;
+    }
+
+    size_t left = send_queue.front().size() - send_offset;
+    if (static_cast<size_t> (cqe->res) < left)
+    {
+        send_offset += cqe->res;
+        send_broken = true;
+        return;
+    }
+    send_offset = 0;
+    send_queue.pop_front();
+}
+
+
+/* with sends_only, stops at the first recv completion: received data
+ * must stay in the ring, which keeps the ring fd readable, until
+ * Receive() picks it up, or the reactor never reports it */
+void MiracUringNetwork::Drain (bool sends_only)
+{
+    for (;;)
+    {
+        unsigned int head = *cq_head;
+        unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++)
+        {
+            const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+            if (cqe->user_data == MIRAC_URING_RECV)
+            {
+                if (sends_only)
+                    break;
+                HandleRecv(cqe);
+            }
+            else if (cqe->user_data == MIRAC_URING_SEND)
+                HandleSend(cqe);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        if (head != tail)
+            break;
+
+        /* completions that did not fit are held by the kernel until it
+         * is asked for events */
+        if (!(__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+            break;
+        if (syscall(__NR_io_uring_enter, ring_handle, 0, 0,
+            IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            throw MiracException(errno, "io_uring_enter()", __FUNCTION__);
+    }
+}
+
+
+void MiracUringNetwork::Reap (bool sends_only)
+{
+    Drain(sends_only);
+    QueueRecv();
+    QueueSends();
+    if (!to_submit)
+        return;
+
+    /* sends on a writable socket usually complete during submission,
+     * pick them up right away */
+    Submit();
+    Drain(sends_only);
+    QueueRecv();
+    QueueSends();
+    Submit();
+}
+
+
+void MiracUringNetwork::Fill ()
+{
+    Reap();
+
+    if (recv_closed)
+        throw MiracConnectionLostException(__FUNCTION__);
+    if (recv_error)
+        throw MiracException(recv_error, "recv()", __FUNCTION__);
+}
+
+
+bool MiracUringNetwork::Flush ()
+{
+    /* sends behind an unread recv completion are picked up by the
+     * next Receive() or send watch callback */
+    Reap(true);
+
+    if (send_error)
+    {
+        if (send_error == EPIPE || send_error == ENOTCONN ||
+            send_error == ECONNRESET)
+            throw MiracConnectionLostException(__FUNCTION__);
+        throw MiracException(send_error, "send()", __FUNCTION__);
+    }
+    return send_queue.empty();
+}
@@ -0,0 +1,108 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_URING_NETWORK_HPP
+#define MIRAC_URING_NETWORK_HPP
+
+#include <cstdint>
+
+#include "mirac-network.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+/* MiracNetwork on a per connection io_uring: a multishot recv fills
+ * buffers from a ring registered with the kernel and queued messages go
+ * out as a chain of linked sends, so receiving costs no syscall and
+ * sending one io_uring_enter() per batch. Completions are picked up by
+ * Receive() and Send() whenever the ring fd, see GetPollHandle(),
+ * becomes readable. Needs Linux 6.0+. */
+class MiracUringNetwork : public MiracNetwork
+{
+    public:
+        MiracUringNetwork (int conn_handle);
+        virtual ~MiracUringNetwork ();
+
+        /* whether the running kernel has everything this needs */
+        static bool IsSupported ();
+
+        virtual int GetPollHandle () const override
+            { return ring_handle; }
+        virtual bool IsCompletionBased () const override
+            { return true; }
+
+    protected:
+        virtual void Fill () override;
+        virtual bool Flush () override;
+
+    private:
+        void Setup ();
+        void Teardown ();
+        io_uring_sqe * GetSqe ();
+        void Submit (unsigned int wait = 0);
+        void QueueRecv ();
+        void QueueSends ();
+        void Drain (bool sends_only = false);
+        void Reap (bool sends_only = false);
+        void Recycle (unsigned int buffer_id);
+        void HandleRecv (const io_uring_cqe *cqe);
+        void HandleSend (const io_uring_cqe *cqe);
+
+        int ring_handle;
+        void *ring_ptr;
+        size_t ring_size;
+        void *sqes_ptr;
+        size_t sqes_size;
+
+        unsigned int *sq_head;
+        unsigned int *sq_tail;
+        unsigned int *sq_mask;
+        unsigned int *sq_flags;
+        unsigned int *sq_array;
+        io_uring_sqe *sqes;
+        unsigned int sq_local_tail;
+        unsigned int to_submit;
+
+        unsigned int *cq_head;
+        unsigned int *cq_tail;
+        unsigned int *cq_mask;
+        io_uring_cqe *cqes;
+
+        /* provided buffers the multishot recv picks from */
+        io_uring_buf_ring *buf_ring;
+        size_t buf_ring_size;
+        unsigned short buf_tail;
+        std::vector<char> buffers;
+        bool recv_armed;
+        bool recv_closed;
+        int recv_error;
+
+        /* sends submitted and not completed yet, they cover the first
+         * send_inflight entries of send_queue */
+        unsigned int send_inflight;
+        bool send_broken;
+        int send_error;
+};
+
+
+#endif  /* MIRAC_URING_NETWORK_HPP */
@@ -0,0 +1,284 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <string>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xutil.h>
+
+#include "mirac-exception.hpp"
+#include "mirac-x-capture.hpp"
+
+MiracXCapture::MiracXCapture (const FrameCallback &frame_callback,
+                              const Options &capture_options,
+                              MiracReactor *capture_reactor,
+                              const char *display_name) :
+    callback(frame_callback),
+    options(capture_options),
+    reactor(capture_reactor ? capture_reactor : MiracReactor::Default()),
+    display(NULL),
+    root(0),
+    width(0),
+    height(0),
+    damage(0),
+    damage_event_base(0),
+    running(false),
+    damaged(false),
+    idle_ticks(0),
+    watch(0),
+    timer(0),
+    keepalive_timer(0)
+{
+    display = XOpenDisplay(display_name);
+    if (!display)
+        throw MiracException("cannot open display", __FUNCTION__);
+
+    if (!XShmQueryExtension(display)) {
+        Close();
+        throw MiracException("no MIT-SHM extension", __FUNCTION__);
+    }
+
+    int screen = DefaultScreen(display);
+    root = RootWindow(display, screen);
+    width = DisplayWidth(display, screen);
+    height = DisplayHeight(display, screen);
+
+    for (unsigned int i = 0; i < std::max(options.buffers, 1u); i++) {
+        std::unique_ptr<Slot> slot(new Slot());
+        slot->busy = false;
+        slot->image = XShmCreateImage(display, DefaultVisual(display, screen),
+                                      DefaultDepth(display, screen), ZPixmap,
+                                      NULL, &slot->shm, width, height);
+        if (!slot->image) {
+            Close();
+            throw MiracException("XShmCreateImage() failed", __FUNCTION__);
+        }
+        if (slot->image->bits_per_pixel != 32) {
+            XDestroyImage(slot->image);
+            Close();
+            throw MiracException("only 32 bits per pixel are supported", __FUNCTION__);
+        }
+
+        size_t size = slot->image->bytes_per_line * slot->image->height;
+        slot->shm.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+        if (slot->shm.shmid < 0) {
+            int error = errno;
+            XDestroyImage(slot->image);
+            Close();
+            throw MiracException(error, "shmget()", __FUNCTION__);
+        }
+        void *address = shmat(slot->shm.shmid, NULL, 0);
+        if (address == reinterpret_cast<void *> (-1)) {
+            int error = errno;
+            shmctl(slot->shm.shmid, IPC_RMID, NULL);
+            XDestroyImage(slot->image);
+            Close();
+            throw MiracException(error, "shmat()", __FUNCTION__);
+        }
+        slot->shm.shmaddr = slot->image->data = static_cast<char *> (address);
+        slot->shm.readOnly = False;
+        XShmAttach(display, &slot->shm);
+        XSync(display, False);
+        /* goes away with the last detach, even if we crash */
+        shmctl(slot->shm.shmid, IPC_RMID, NULL);
+        slots.push_back(std::move(slot));
+    }
+
+    int damage_error_base;
+    if (XDamageQueryExtension(display, &damage_event_base, &damage_error_base))
+        damage = XDamageCreate(display, root, XDamageReportNonEmpty);
+}
+
+MiracXCapture::~MiracXCapture ()
+{
+    Stop();
+    Close();
+}
+
+void MiracXCapture::Close ()
+{
+    if (damage)
+        XDamageDestroy(display, damage);
+    damage = 0;
+
+    for (auto &slot : slots) {
+        XShmDetach(display, &slot->shm);
+        XDestroyImage(slot->image);
+        shmdt(slot->shm.shmaddr);
+    }
+    slots.clear();
+
+    if (display)
+        XCloseDisplay(display);
+    display = NULL;
+}
+
+void MiracXCapture::Start ()
+{
+    if (running)
+        return;
+
+    running = true;
+    watch = reactor->AddWatch(ConnectionNumber(display), MiracReactor::READABLE,
+        [this] (int, unsigned int) {
+            ProcessEvents();
+            if (damaged && !timer)
+                Wake();
+            return true;
+        });
+    damaged = true;
+    Wake();
+}
+
+void MiracXCapture::Stop ()
+{
+    if (!running)
+        return;
+
+    running = false;
+    if (watch)
+        reactor->Remove(watch);
+    if (timer)
+        reactor->Remove(timer);
+    if (keepalive_timer)
+        reactor->Remove(keepalive_timer);
+    watch = timer = keepalive_timer = 0;
+}
+
+void MiracXCapture::Refresh ()
+{
+    if (!running)
+        return;
+
+    damaged = true;
+    if (!timer)
+        Wake();
+}
+
+void MiracXCapture::Release (unsigned int slot)
+{
+    slots[slot]->busy = false;
+}
+
+void MiracXCapture::ProcessEvents ()
+{
+    /* also drains what earlier round trips queued up, the watch only
+     * sees data still in the socket */
+    while (XPending(display)) {
+        XEvent event;
+        XNextEvent(display, &event);
+        if (damage && event.type == damage_event_base + XDamageNotify) {
+            damaged = true;
+            stats.damage_events++;
+        }
+    }
+}
+
+void MiracXCapture::Wake ()
+{
+    if (keepalive_timer)
+        reactor->Remove(keepalive_timer);
+    keepalive_timer = 0;
+
+    idle_ticks = 0;
+    timer = reactor->AddTimeout(1000 / std::max(options.frame_rate, 1u),
+                                [this] () { return OnTick(); });
+    /* the change that woke us up is shown without waiting a tick, or
+     * on the next one if downstream holds every slot */
+    if (Capture(false))
+        damaged = false;
+}
+
+bool MiracXCapture::OnTick ()
+{
+    ProcessEvents();
+
+    if (damaged || !damage) {
+        /* a skipped frame is retried on the next tick: the damage is
+         * only subtracted once it is captured, so no new event comes */
+        if (Capture(false)) {
+            damaged = false;
+            idle_ticks = 0;
+        }
+        return true;
+    }
+
+    unsigned int interval = 1000 / std::max(options.frame_rate, 1u);
+    if (++idle_ticks * interval < options.idle_timeout)
+        return true;
+
+    /* the screen is static: sleep until the next damage event and only
+     * repeat the last frame now and then for late decoders */
+    timer = 0;
+    if (options.keepalive)
+        keepalive_timer = reactor->AddTimeout(options.keepalive, [this] () {
+            Capture(true);
+            return true;
+        });
+    return false;
+}
+
+bool MiracXCapture::Capture (bool repeat)
+{
+    Slot *slot = NULL;
+    unsigned int index;
+
+    for (index = 0; index < slots.size(); index++) {
+        if (!slots[index]->busy) {
+            slot = slots[index].get();
+            break;
+        }
+    }
+    /* downstream is behind, drop this frame rather than queue it */
+    if (!slot) {
+        stats.skipped++;
+        return false;
+    }
+
+    /* whatever changes after this is reported again */
+    if (damage)
+        XDamageSubtract(display, damage, None, None);
+
+    if (!XShmGetImage(display, root, slot->image, 0, 0, AllPlanes)) {
+        stats.skipped++;
+        return false;
+    }
+
+    if (repeat)
+        stats.repeated++;
+    else
+        stats.captured++;
+
+    slot->busy = true;
+    Frame frame = {
+        reinterpret_cast<const uint8_t *> (slot->image->data),
+        static_cast<size_t> (slot->image->bytes_per_line * slot->image->height),
+        width,
+        height,
+        static_cast<unsigned int> (slot->image->bytes_per_line),
+        index
+    };
+    callback(frame);
+    return true;
+}
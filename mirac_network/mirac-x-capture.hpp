@@ -0,0 +1,149 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef MIRAC_X_CAPTURE_HPP
+#define MIRAC_X_CAPTURE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+
+#include "mirac-reactor.hpp"
+
+/* Root window capture for the desktop stream. Frames are copied by the
+ * X server straight into shared memory and only taken when XDamage
+ * reports a change; a static screen is not polled at all. */
+class MiracXCapture
+{
+    public:
+        struct Options {
+            Options ()
+                : frame_rate(30),
+                  idle_timeout(1000),
+                  keepalive(1000),
+                  buffers(3) {}
+
+            /* most frames per second while the screen changes */
+            unsigned int frame_rate;
+            /* ms without damage after which polling stops */
+            unsigned int idle_timeout;
+            /* ms between repeats of an unchanged screen, 0 for none */
+            unsigned int keepalive;
+            /* frames that may be held downstream at a time, a capture
+             * is skipped while all of them are */
+            unsigned int buffers;
+        };
+
+        struct Statistics {
+            Statistics ()
+                : captured(0),
+                  repeated(0),
+                  skipped(0),
+                  damage_events(0) {}
+
+            uint64_t captured;
+            uint64_t repeated;
+            uint64_t skipped;
+            uint64_t damage_events;
+        };
+
+        /* BGRx pixels, valid until Release(slot) */
+        struct Frame {
+            const uint8_t *data;
+            size_t size;
+            unsigned int width;
+            unsigned int height;
+            unsigned int stride;
+            unsigned int slot;
+        };
+
+        typedef std::function<void (const Frame &frame)> FrameCallback;
+
+        /* display NULL opens $DISPLAY; throws MiracException if the
+         * display or its MIT-SHM extension is not there */
+        MiracXCapture (const FrameCallback &callback,
+                       const Options &options = Options(),
+                       MiracReactor *reactor = NULL,
+                       const char *display_name = NULL);
+        ~MiracXCapture ();
+
+        unsigned int Width () const
+            { return width; }
+        unsigned int Height () const
+            { return height; }
+        bool Idle () const
+            { return running && !timer; }
+        const Statistics &GetStatistics () const
+            { return stats; }
+
+        /* the first frame is taken right away */
+        void Start ();
+        void Stop ();
+        /* takes a frame even if nothing changed, for a key frame */
+        void Refresh ();
+        /* may be called from any thread */
+        void Release (unsigned int slot);
+
+    private:
+        struct Slot {
+            XImage *image;
+            XShmSegmentInfo shm;
+            std::atomic<bool> busy;
+        };
+
+        void Close ();
+        void ProcessEvents ();
+        bool OnTick ();
+        void Wake ();
+        /* false if no frame went out, e.g. because all slots are busy */
+        bool Capture (bool repeat);
+
+        FrameCallback callback;
+        Options options;
+        MiracReactor *reactor;
+
+        Display *display;
+        Window root;
+        unsigned int width;
+        unsigned int height;
+        /* 0 without the DAMAGE extension, every tick captures then */
+        Damage damage;
+        int damage_event_base;
+        std::vector<std::unique_ptr<Slot>> slots;
+
+        bool running;
+        bool damaged;
+        unsigned int idle_ticks;
+        MiracReactor::Id watch;
+        MiracReactor::Id timer;
+        MiracReactor::Id keepalive_timer;
+
+        Statistics stats;
+};
+
+#endif  /* MIRAC_X_CAPTURE_HPP */
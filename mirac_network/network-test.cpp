@@ -25,9 +25,80 @@
 #include <glib.h>
 #include <glib-unix.h>
 
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 
 #include "mirac-network.hpp"
+#include "mirac-epoll-reactor.hpp"
+#ifdef MIRAC_IO_URING
+#include "mirac-uring-network.hpp"
+#endif
+
+
+/* the benchmark counts syscalls by having the linker route these
+ * through the wrappers below, see CMakeLists.txt */
+static unsigned long syscall_count = 0;
+
+extern "C" {
+ssize_t __real_recv (int fd, void *buf, size_t len, int flags);
+ssize_t __real_sendmsg (int fd, const struct msghdr *msg, int flags);
+int __real_epoll_wait (int epfd, struct epoll_event *events, int maxevents,
+    int timeout);
+long __real_syscall (long number, ...);
+
+ssize_t __wrap_recv (int fd, void *buf, size_t len, int flags)
+{
+    syscall_count++;
+    return __real_recv(fd, buf, len, flags);
+}
+
+ssize_t __wrap_sendmsg (int fd, const struct msghdr *msg, int flags)
+{
+    syscall_count++;
+    return __real_sendmsg(fd, msg, flags);
+}
+
+int __wrap_epoll_wait (int epfd, struct epoll_event *events, int maxevents,
+    int timeout)
+{
+    syscall_count++;
+    return __real_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+/* io_uring has no libc wrappers, it goes through syscall() */
+long __wrap_syscall (long number, ...)
+{
+    va_list args;
+    long arg[6] = { 0, 0, 0, 0, 0, 0 };
+    int count = 6;
+
+    if (number == SYS_io_uring_setup)
+        count = 2;
+    else if (number == SYS_io_uring_register)
+        count = 4;
+
+    va_start(args, number);
+    for (int i = 0; i < count; i++)
+        arg[i] = va_arg(args, long);
+    va_end(args);
+
+    syscall_count++;
+    return __real_syscall(number, arg[0], arg[1], arg[2], arg[3], arg[4],
+        arg[5]);
+}
+}
 
 
 static gboolean _sig_handler (gpointer data_ptr)
@@ -58,6 +129,14 @@ static gboolean _send_cb (gint fd, GIOCondition condition,
 }
 
 
+static void _add_send_watch (MiracNetwork *ctx)
+{
+    /* completion based transports signal finished sends as readable */
+    GIOCondition condition = ctx->IsCompletionBased() ? G_IO_IN : G_IO_OUT;
+    g_unix_fd_add(ctx->GetPollHandle(), condition, _send_cb, ctx);
+}
+
+
 static gboolean _receive_cb (gint fd, GIOCondition condition,
     gpointer data_ptr)
 {
@@ -65,12 +144,14 @@ static gboolean _receive_cb (gint fd, GIOCondition condition,
 
     try
     {
+        /* one wakeup of a completion based transport can bring in
+         * several messages */
         std::string msg;
-        if (ctx->Receive(msg))
+        while (ctx->Receive(msg))
         {
             g_message("message: %s", msg.c_str());
             if (!ctx->Send(msg))
-                g_unix_fd_add(ctx->GetHandle(), G_IO_OUT, _send_cb, ctx);
+                _add_send_watch(ctx);
         }
     }
     catch (std::exception &x)
@@ -90,9 +171,11 @@ static gboolean _listen_cb (gint fd, GIOCondition condition, gpointer data_ptr)
         MiracNetwork *listener = reinterpret_cast<MiracNetwork *> (data_ptr);
         MiracNetwork *ctx;
 
-        ctx = listener->Accept();
-        g_message("connection from: %s", ctx->GetPeerAddress().c_str());
-        g_unix_fd_add(ctx->GetHandle(), G_IO_IN, _receive_cb, ctx);
+        while ((ctx = listener->Accept()) != NULL)
+        {
+            g_message("connection from: %s", ctx->GetPeerAddress().c_str());
+            g_unix_fd_add(ctx->GetPollHandle(), G_IO_IN, _receive_cb, ctx);
+        }
     }
     catch (std::exception &x)
     {
@@ -109,7 +192,7 @@ static gboolean _sendmsg_cb (gint fd, GIOCondition condition, gpointer data_ptr)
         MiracNetwork *ctx = reinterpret_cast<MiracNetwork *> (data_ptr);
 
         if (!ctx->Send (std::string("Hello world!\r\n\r\n")))
-            g_unix_fd_add(ctx->GetHandle(), G_IO_OUT, _send_cb, ctx);
+            _add_send_watch(ctx);
 
     }
     catch (std::exception &x)
@@ -129,7 +212,7 @@ static gboolean _connect_cb (gint fd, GIOCondition condition, gpointer data_ptr)
         if (!ctx->Connect(NULL, NULL))
             return G_SOURCE_CONTINUE;
         g_message("connection success to: %s", ctx->GetPeerAddress().c_str());
-        g_unix_fd_add(ctx->GetHandle(), G_IO_OUT, _sendmsg_cb, ctx);
+        g_unix_fd_add(ctx->GetPollHandle(), G_IO_OUT, _sendmsg_cb, ctx);
     }
     catch (std::exception &x)
     {
@@ -139,10 +222,225 @@ static gboolean _connect_cb (gint fd, GIOCondition condition, gpointer data_ptr)
 }
 
 
+/* ping-pongs RTSP sized messages between a plain client and a server
+ * connection on the given transport, over loopback */
+static void _bench (const char *name, bool use_uring, int messages)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    MiracEpollReactor reactor;
+    MiracNetwork listener;
+    MiracNetwork client;
+
+    listener.Bind("127.0.0.1", "0");
+    std::string port = std::to_string(listener.GetHostPort());
+    bool connected = client.Connect("127.0.0.1", port.c_str());
+
+    struct pollfd pfd = { listener.GetHandle(), POLLIN, 0 };
+    if (poll(&pfd, 1, 1000) != 1)
+        throw MiracException("no connection", __FUNCTION__);
+    int handle = accept4(listener.GetHandle(), NULL, NULL, SOCK_NONBLOCK);
+    if (handle < 0)
+        throw MiracException(errno, "accept4()", __FUNCTION__);
+    pfd.fd = client.GetHandle();
+    pfd.events = POLLOUT;
+    while (!connected && poll(&pfd, 1, 1000) == 1)
+        connected = client.Connect(NULL, NULL);
+
+    std::unique_ptr<MiracNetwork> server;
+#ifdef MIRAC_IO_URING
+    if (use_uring)
+        server.reset(new MiracUringNetwork(handle));
+#endif
+    if (!server)
+        server.reset(new MiracNetwork(handle));
+
+    /* echo, a full socket buffer does not happen with one message in
+     * flight */
+    reactor.AddWatch(server->GetPollHandle(), MiracReactor::READABLE,
+        [&] (int, unsigned int) {
+            const char *msg;
+            size_t length;
+            while (server->Receive(&msg, &length))
+                server->Send(std::string(msg, length));
+            return true;
+        });
+
+    std::vector<double> latencies;
+    latencies.reserve(messages);
+    int cseq = 0;
+    Clock::time_point sent_at;
+    auto send_next = [&] () {
+        sent_at = Clock::now();
+        client.Send("GET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+            "CSeq: " + std::to_string(++cseq) + "\r\n"
+            "Content-Type: text/parameters\r\n"
+            "Content-Length: 0\r\n\r\n");
+    };
+
+    reactor.AddWatch(client.GetHandle(), MiracReactor::READABLE,
+        [&] (int, unsigned int) {
+            const char *msg;
+            size_t length;
+            while (client.Receive(&msg, &length))
+            {
+                std::chrono::duration<double, std::micro> elapsed =
+                    Clock::now() - sent_at;
+                latencies.push_back(elapsed.count());
+                if (cseq == messages)
+                {
+                    reactor.Quit();
+                    return false;
+                }
+                send_next();
+            }
+            return true;
+        });
+
+    syscall_count = 0;
+    send_next();
+    reactor.Run();
+    unsigned long syscalls = syscall_count;
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-10s %8d %16.2f %10.1f %10.1f\n", name, messages,
+        static_cast<double> (syscalls) / messages,
+        latencies[latencies.size() / 2],
+        latencies[latencies.size() * 99 / 100]);
+}
+
+
+/* times an M5 trigger until the M6 request that follows the reply to
+ * it, the second of two back to back writes, has arrived; without
+ * no_delay it waits for the peer to acknowledge the first */
+static void _bench_trigger (const char *name,
+    const MiracNetwork::Options &options, int rounds)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    MiracEpollReactor reactor;
+    MiracNetwork listener;
+    MiracNetwork client;
+
+    listener.SetOptions(options);
+    client.SetOptions(options);
+    listener.Bind("127.0.0.1", "0");
+    std::string port = std::to_string(listener.GetHostPort());
+    bool connected = client.Connect("127.0.0.1", port.c_str());
+
+    struct pollfd pfd = { listener.GetHandle(), POLLIN, 0 };
+    if (poll(&pfd, 1, 1000) != 1)
+        throw MiracException("no connection", __FUNCTION__);
+    std::unique_ptr<MiracNetwork> server(listener.Accept());
+    pfd.fd = client.GetHandle();
+    pfd.events = POLLOUT;
+    while (!connected && poll(&pfd, 1, 1000) == 1)
+        connected = client.Connect(NULL, NULL);
+
+    reactor.AddWatch(server->GetPollHandle(), MiracReactor::READABLE,
+        [&] (int, unsigned int) {
+            const char *msg;
+            size_t length;
+            while (server->Receive(&msg, &length))
+            {
+                server->Send("RTSP/1.0 200 OK\r\nCSeq: 1\r\n\r\n");
+                server->Send("SETUP rtsp://localhost/wfd1.0/streamid=0 RTSP/1.0\r\n"
+                    "CSeq: 2\r\n"
+                    "Transport: RTP/AVP/UDP;unicast;client_port=19000\r\n\r\n");
+            }
+            return true;
+        });
+
+    std::vector<double> latencies;
+    latencies.reserve(rounds);
+    int cseq = 0;
+    int received = 0;
+    Clock::time_point sent_at;
+    auto send_trigger = [&] () {
+        sent_at = Clock::now();
+        client.Send("SET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+            "CSeq: " + std::to_string(++cseq) + "\r\n"
+            "Content-Length: 0\r\n\r\n");
+    };
+
+    reactor.AddWatch(client.GetHandle(), MiracReactor::READABLE,
+        [&] (int, unsigned int) {
+            const char *msg;
+            size_t length;
+            while (client.Receive(&msg, &length))
+            {
+                /* the reply, then the request */
+                if (++received % 2)
+                    continue;
+                std::chrono::duration<double, std::micro> elapsed =
+                    Clock::now() - sent_at;
+                latencies.push_back(elapsed.count());
+                if (cseq == rounds)
+                {
+                    reactor.Quit();
+                    return false;
+                }
+                send_trigger();
+            }
+            return true;
+        });
+
+    send_trigger();
+    reactor.Run();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-16s %8d %10.1f %10.1f\n", name, rounds,
+        latencies[latencies.size() / 2],
+        latencies[latencies.size() * 99 / 100]);
+}
+
+
+static int _run_bench (int messages)
+{
+    printf("%-10s %8s %16s %10s %10s\n", "transport", "messages",
+        "syscalls/message", "p50 us", "p99 us");
+    try
+    {
+        _bench("socket", false, messages);
+#ifdef MIRAC_IO_URING
+        if (MiracUringNetwork::IsSupported())
+            _bench("io_uring", true, messages);
+        else
+            printf("io_uring   not supported by this kernel\n");
+#else
+        printf("io_uring   not built, see MIRAC_IO_URING\n");
+#endif
+
+        /* each round costs a delayed ack, i.e. tens of milliseconds,
+         * when Nagle is on */
+        int rounds = std::min(messages, 200);
+        MiracNetwork::Options nagle;
+        nagle.no_delay = false;
+        MiracNetwork::Options quick_ack = nagle;
+        quick_ack.quick_ack = true;
+
+        printf("\n%-16s %8s %10s %10s\n", "trigger", "rounds",
+            "p50 us", "p99 us");
+        _bench_trigger("nagle", nagle, rounds);
+        _bench_trigger("nagle+quickack", quick_ack, rounds);
+        _bench_trigger("no_delay", MiracNetwork::Options(), rounds);
+    }
+    catch (std::exception &x)
+    {
+        g_warning("exception: %s", x.what());
+        return 1;
+    }
+    return 0;
+}
+
+
 int main (int argc, char *argv[])
 {
     GMainLoop *ml = NULL;
 
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return _run_bench(argc > 2 ? atoi(argv[2]) : 20000);
+
     try
     {
         ml = g_main_loop_new(NULL, TRUE);
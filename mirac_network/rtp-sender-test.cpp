@@ -0,0 +1,259 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "mirac-exception.hpp"
+#include "mirac-rtp-sender.hpp"
+
+/* Sends the same synthetic MPEG-TS stream through MiracRtpSender in each
+ * mode to a socket on the loopback and compares the CPU time the sending
+ * thread needs per Mbit. SENDTO sends a datagram per syscall like
+ * rtpmp2tpay ! udpsink does. The receiver checks the RTP framing and the
+ * sequence numbers; loopback drops under the unpaced load are counted but
+ * are not an error. */
+
+typedef std::chrono::steady_clock Clock;
+
+struct Receiver
+{
+    Receiver () : fd(-1), datagrams(0), bytes(0), lost(0), invalid(0),
+                  done(false) {}
+
+    int fd;
+    std::thread thread;
+    uint64_t datagrams;
+    uint64_t bytes;
+    uint64_t lost;
+    uint64_t invalid;
+    std::atomic<bool> done;
+};
+
+static int open_receiver (int *port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        throw MiracException(errno, "socket()", __FUNCTION__);
+
+    int size = 8 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct timeval timeout = { 0, 100000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        getsockname(fd, (struct sockaddr*)&addr, &length) < 0)
+    {
+        close(fd);
+        throw MiracException(errno, "bind()", __FUNCTION__);
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static void receive (Receiver *r)
+{
+    const size_t batch = 64;
+    const size_t max_size = 2048;
+    std::vector<uint8_t> buffers(batch * max_size);
+    std::vector<struct iovec> iov(batch);
+    std::vector<struct mmsghdr> messages(batch);
+    bool first = true;
+    uint16_t expected = 0;
+
+    while (true)
+    {
+        for (size_t i = 0; i < batch; i++)
+        {
+            iov[i].iov_base = &buffers[i * max_size];
+            iov[i].iov_len = max_size;
+            memset(&messages[i], 0, sizeof(messages[i]));
+            messages[i].msg_hdr.msg_iov = &iov[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int count = recvmmsg(r->fd, &messages[0], batch, MSG_WAITFORONE, NULL);
+        if (count <= 0)
+        {
+            /* the timeout, once the sender is through the queue is empty */
+            if (r->done)
+                return;
+            continue;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            const uint8_t *data = &buffers[i * max_size];
+            size_t length = messages[i].msg_len;
+            size_t payload = length - MiracRtpSender::RTP_HEADER_SIZE;
+            if (length <= MiracRtpSender::RTP_HEADER_SIZE ||
+                payload % MiracRtpSender::TS_PACKET_SIZE != 0 ||
+                payload > MiracRtpSender::TS_PACKETS_PER_DATAGRAM *
+                          MiracRtpSender::TS_PACKET_SIZE ||
+                data[0] != 0x80 ||
+                (data[1] & 0x7f) != MiracRtpSender::PAYLOAD_TYPE_MP2T ||
+                data[MiracRtpSender::RTP_HEADER_SIZE] != 0x47)
+            {
+                r->invalid++;
+                continue;
+            }
+
+            uint16_t sequence = (data[2] << 8) | data[3];
+            if (!first)
+            {
+                uint16_t gap = sequence - expected;
+                if (gap >= 0x8000)
+                    r->invalid++;  /* reordered or repeated */
+                else
+                    r->lost += gap;
+            }
+            first = false;
+            expected = sequence + 1;
+            r->datagrams++;
+            r->bytes += length;
+        }
+    }
+}
+
+static double thread_cpu_us ()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 +
+        usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int main (int argc, char *argv[])
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 600;
+    int kbps = argc > 2 ? atoi(argv[2]) : 20000;
+    int fps = argc > 3 ? atoi(argv[3]) : 60;
+    if (frames <= 0 || kbps <= 0 || fps <= 0)
+    {
+        fprintf(stderr, "usage: %s [frames] [kbps] [fps]\n", argv[0]);
+        return 1;
+    }
+
+    /* one frame worth of TS packets with a running continuity counter */
+    size_t packets = std::max<size_t>(1, (size_t)kbps * 1000 / 8 / fps /
+                                         MiracRtpSender::TS_PACKET_SIZE);
+    std::vector<uint8_t> frame(packets * MiracRtpSender::TS_PACKET_SIZE);
+    for (size_t i = 0; i < packets; i++)
+    {
+        uint8_t *packet = &frame[i * MiracRtpSender::TS_PACKET_SIZE];
+        memset(packet, 0xff, MiracRtpSender::TS_PACKET_SIZE);
+        packet[0] = 0x47;
+        packet[1] = 0x10;
+        packet[2] = 0x11;
+        packet[3] = 0x10 | (i & 0x0f);
+    }
+
+    const MiracRtpSender::Mode modes[] = {
+        MiracRtpSender::SENDTO,
+        MiracRtpSender::SENDMMSG,
+        MiracRtpSender::SEGMENT_OFFLOAD
+    };
+
+    printf("%d frames of %zu TS packets, %.1f Mbit\n", frames, packets,
+           frames * frame.size() * 8 / 1e6);
+    printf("%-10s %10s %10s %10s %10s %10s %8s\n", "mode", "us/Mbit",
+           "syscalls", "sent", "received", "lost", "errors");
+
+    int failed = 0;
+    for (MiracRtpSender::Mode mode : modes)
+    {
+        Receiver r;
+        int port;
+        try
+        {
+            r.fd = open_receiver(&port);
+        }
+        catch (MiracException &e)
+        {
+            fprintf(stderr, "receiver: %s\n", e.what());
+            return 1;
+        }
+
+        std::unique_ptr<MiracRtpSender> sender;
+        try
+        {
+            sender.reset(new MiracRtpSender("127.0.0.1", port, mode));
+        }
+        catch (MiracException &e)
+        {
+            printf("%-10s not supported: %s\n", MiracRtpSender::ModeName(mode),
+                   e.what());
+            close(r.fd);
+            continue;
+        }
+
+        r.thread = std::thread(receive, &r);
+
+        double cpu = thread_cpu_us();
+        for (int i = 0; i < frames; i++)
+            sender->Send(&frame[0], frame.size(), i * 90000 / fps);
+        cpu = thread_cpu_us() - cpu;
+
+        r.done = true;
+        r.thread.join();
+        close(r.fd);
+
+        const MiracRtpSender::Statistics &stats = sender->GetStatistics();
+        double mbit = stats.bytes * 8 / 1e6;
+        printf("%-10s %10.1f %10llu %10llu %10llu %10llu %8llu\n",
+               MiracRtpSender::ModeName(mode), mbit > 0 ? cpu / mbit : 0.0,
+               (unsigned long long)stats.syscalls,
+               (unsigned long long)stats.datagrams,
+               (unsigned long long)r.datagrams,
+               (unsigned long long)r.lost,
+               (unsigned long long)stats.errors);
+
+        if (r.invalid || r.datagrams == 0 || r.datagrams + r.lost > stats.datagrams)
+        {
+            fprintf(stderr, "%s: %llu invalid datagrams\n",
+                    MiracRtpSender::ModeName(mode),
+                    (unsigned long long)r.invalid);
+            failed++;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <X11/Xlib.h>
+
+#include "mirac-epoll-reactor.hpp"
+#include "mirac-exception.hpp"
+#include "mirac-x-capture.hpp"
+
+/* Runs MiracXCapture against the X server in $DISPLAY, usually a
+ * throwaway one: xvfb-run -a x-capture-test. A static screen must stop
+ * producing frames, drawing on it must produce one with the change. */
+
+static const unsigned int fill_color = 0x00ff00;
+
+int main ()
+{
+    MiracEpollReactor reactor;
+    std::unique_ptr<MiracXCapture> capture;
+    unsigned int frames = 0;
+    unsigned int static_frames = 0;
+    uint32_t pixel = 0;
+    bool failed = false;
+
+    MiracXCapture::Options options;
+    options.idle_timeout = 300;
+    options.keepalive = 0;
+
+    try {
+        capture.reset(new MiracXCapture([&] (const MiracXCapture::Frame &frame) {
+            frames++;
+            pixel = *reinterpret_cast<const uint32_t *> (
+                frame.data + 20 * frame.stride + 20 * 4);
+            capture->Release(frame.slot);
+        }, options, &reactor));
+    } catch (const MiracException &x) {
+        fprintf(stderr, "cannot capture: %s\n", x.what());
+        return 1;
+    }
+
+    Display *display = XOpenDisplay(NULL);
+    Window root = DefaultRootWindow(display);
+    GC gc = XCreateGC(display, root, 0, NULL);
+
+    capture->Start();
+
+    reactor.AddTimeout(1000, [&] () {
+        /* the first frame, maybe one more while the server settles */
+        static_frames = frames;
+        if (!capture->Idle() || frames < 1 || frames > 2) {
+            fprintf(stderr, "static screen: %u frames, %s\n", frames,
+                    capture->Idle() ? "idle" : "still polling");
+            failed = true;
+        }
+        XSetForeground(display, gc, fill_color);
+        XFillRectangle(display, root, gc, 10, 10, 50, 50);
+        XFlush(display);
+        return false;
+    });
+
+    reactor.AddTimeout(1500, [&] () {
+        if (frames <= static_frames || (pixel & 0xffffff) != fill_color) {
+            fprintf(stderr, "after drawing: %u frames, pixel %06x\n",
+                    frames, pixel & 0xffffff);
+            failed = true;
+        }
+        reactor.Quit();
+        return false;
+    });
+
+    reactor.Run();
+
+    const MiracXCapture::Statistics &stats = capture->GetStatistics();
+    printf("captured %llu repeated %llu skipped %llu damage events %llu\n",
+           (unsigned long long) stats.captured,
+           (unsigned long long) stats.repeated,
+           (unsigned long long) stats.skipped,
+           (unsigned long long) stats.damage_events);
+
+    capture.reset();
+    XFreeGC(display, gc);
+    XCloseDisplay(display);
+
+    return failed ? 1 : 0;
+}
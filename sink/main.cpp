@@ -87,20 +87,6 @@ static gboolean _user_input_handler (
     return false;
 }
 
-static gboolean create_sink (gpointer data_ptr)
-{
-    SinkAppData* data = static_cast<SinkAppData*>(data_ptr);
-
-    try {
-        data->sink.reset(new MiracSink (data->host.c_str(), data->port));
-        std::cout << "Running sink on port "<< data->sink->get_host_port() << std::endl;
-        return G_SOURCE_REMOVE;
-    } catch (const std::exception &x) {
-        std::cout << "Failed to create sink, trying again soon..." << std::endl;
-        return G_SOURCE_CONTINUE;
-    }
-}
-
 int main (int argc, char *argv[])
 {
     SinkAppData data;
@@ -158,15 +144,17 @@ int main (int argc, char *argv[])
     auto array = ie.serialize ();
     data.connman.reset(new ConnmanClient (array));
 
-    // Hack while we wait for a better solution:
-    // try to create a sink every second and hope the connect succeeds at some point
-    // when the source is actually there...
-    g_timeout_add_seconds (1, create_sink, &data);
+    // the sink keeps trying to connect until the source is there
+    data.sink.reset(new MiracSink (data.host, data.port));
+    std::cout << "Connecting sink to " << data.host << ":" << data.port << std::endl;
 
     g_main_loop_run (main_loop);
 
     g_main_loop_unref (main_loop);
 
+    if (data.sink)
+        data.sink->print_statistics (std::cout);
+
     return 0;
 }
 
@@ -22,7 +22,6 @@
 
 #include <memory>
 #include <algorithm>
-#include <assert.h>
 
 #include "mirac-sink.hpp"
 #include "reply.h"
@@ -34,6 +33,7 @@
 #include "setparameter.h"
 #include "audiocodecs.h"
 #include "videoformats.h"
+#include "videomodes.h"
 #include "formats3d.h"
 #include "clientrtpports.h"
 #include "presentationurl.h"
@@ -43,37 +43,52 @@
 #include "connectortype.h"
 #include "standbyresumecapability.h"
 
+namespace {
 
-MiracSink::SetParameterType MiracSink::get_method(std::shared_ptr<WFD::SetParameter> set_param)
+// A loss burst is reported many times over, ask for one IDR frame per
+// burst. The request and the frame take about a round trip to arrive.
+const std::chrono::milliseconds idr_request_interval(200);
+// Past this the next periodic IDR frame is as good as an answer.
+const unsigned int idr_request_timeout = 1000;
+
+MiracConnector::Options connector_options()
 {
-    try {
-        auto method = set_param->payload().get_property (WFD::PropertyType::WFD_TRIGGER_METHOD);
-        auto trigger_method = std::static_pointer_cast<WFD::TriggerMethod> (method);
-        switch (trigger_method->method()) {
-            case WFD::TriggerMethod::SETUP:
-                return M5_TRIGGER_SETUP;
-            case WFD::TriggerMethod::PLAY:
-                return M5_TRIGGER_PLAY;
-            case WFD::TriggerMethod::PAUSE:
-                return M5_TRIGGER_PAUSE;
-            case WFD::TriggerMethod::TEARDOWN:
-                return M5_TRIGGER_TEARDOWN;
-            default:
-                assert(false);
-        }
-    } catch (std::out_of_range) {
-        return M4;
-    }
+    MiracConnector::Options options;
+    options.socket = MiracNetwork::Options::ControlChannel();
+    return options;
 }
 
+}
+
+
+const MiracSink::StateMachine::Transition MiracSink::transitions[] = {
+    { INIT, INIT, StateMachine::OPTIONS, &MiracSink::handle_m1_options },
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::GET_PARAMETER,
+      &MiracSink::handle_m3_get_parameter },
+    { CAPABILITY_NEGOTIATION, WFD_SESSION_PAUSED, StateMachine::SET_PARAMETER,
+      &MiracSink::handle_m4_set_parameter },
+    { RTSP_SESSION_ESTABLISHMENT, RTSP_SESSION_ESTABLISHMENT, StateMachine::TRIGGER_SETUP,
+      &MiracSink::handle_m5_setup_trigger },
+    { WFD_SESSION_PLAYING, WFD_SESSION_PAUSED, StateMachine::TRIGGER_TEARDOWN,
+      &MiracSink::handle_m5_teardown_trigger },
+    { WFD_SESSION_PLAYING, WFD_SESSION_PLAYING, StateMachine::TRIGGER_PAUSE,
+      &MiracSink::handle_m5_pause_trigger },
+    { WFD_SESSION_PAUSED, WFD_SESSION_PAUSED, StateMachine::TRIGGER_PLAY,
+      &MiracSink::handle_m5_play_trigger },
+};
+
+const char* const MiracSink::state_names[] = {
+    "INIT",
+    "CAPABILITY_NEGOTIATION",
+    "RTSP_SESSION_ESTABLISHMENT",
+    "WFD_SESSION_ESTABLISHMENT",
+    "WFD_SESSION_PLAYING",
+    "WFD_SESSION_PAUSED",
+};
 
 void MiracSink::set_state(MiracSink::State state)
 {
     state_ = state;
-    if (state == INIT) {
-        send_cseq_ = 1;
-        gst_pipeline.reset(new MiracGstSink("", 0));
-    }
     std::cout << "** State "<< state_ << std::endl;
 }
 
@@ -105,20 +120,17 @@ void MiracSink::handle_m1_options (std::shared_ptr<WFD::Message> message)
     send (reply);
 
     // Send M2 OPTIONS
-    expected_reply_ = WFD::Method::OPTIONS;
     WFD::Options m2("*");
-    m2.header().set_cseq (send_cseq_++);
     m2.header().set_require_wfd_support (true);
-    send (m2);
+    send_request (m2, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m2_options_reply (reply);
+    });
 }
 
 void MiracSink::handle_m2_options_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    // not expecting anything
-    expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
-
     // Ensure M2 OPTIONS reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     auto methods = reply->header().supported_methods();
@@ -141,10 +153,11 @@ void MiracSink::handle_m3_get_parameter (std::shared_ptr<WFD::Message> message)
     WFD::Reply reply(200);
     reply.header().set_cseq (message->header().cseq());
 
-    auto props = message->payload().get_parameter_properties();
+    auto props = message->payload().get_parameter_property_types();
     for (auto it = props.begin(); it != props.end(); it++) {
         std::shared_ptr<WFD::Property> new_prop;
-        if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_AUDIO_CODECS]){
+        switch (*it) {
+        case WFD::PropertyType::WFD_AUDIO_CODECS: {
             // declare that we support absolutely everything, let gstreamer deal with it
             auto codec_lpcm = new WFD::AudioCodec (WFD::AudioFormat::LPCM, WFD::AudioFormat::Modes(3), 0);
             auto codec_aac = new WFD::AudioCodec (WFD::AudioFormat::AAC, WFD::AudioFormat::Modes(15), 0);
@@ -154,70 +167,80 @@ void MiracSink::handle_m3_get_parameter (std::shared_ptr<WFD::Message> message)
             codec_list.push_back(*codec_aac);
             codec_list.push_back(*codec_ac3);
             new_prop.reset(new WFD::AudioCodecs(codec_list));
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_VIDEO_FORMATS]){
+            break;
+        }
+        case WFD::PropertyType::WFD_VIDEO_FORMATS: {
             auto codec_list = WFD::H264Codecs();
             // again, declare that we support absolutely everything, let gstreamer deal with it
-            auto codec_cbp = new WFD::H264Codec(1, 16, 0x1ffff, 0x1fffffff, 0xfff, 0, 0, 0, 0x11, 0, 0);
-            auto codec_chp = new WFD::H264Codec(2, 16, 0x1ffff, 0x1fffffff, 0xfff, 0, 0, 0, 0x11, 0, 0);
-            codec_list.push_back(*codec_cbp);
-            codec_list.push_back(*codec_chp);
-            new_prop.reset(new WFD::VideoFormats(64 , 0, codec_list)); // 64 should mean 1920x1080p24
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_3D_FORMATS]){
+            for (auto profile : { WFD::CBP, WFD::CHP })
+                codec_list.push_back(WFD::H264Codec(profile, 0x10,
+                                                    WFD::all_video_modes(WFD::CEA),
+                                                    WFD::all_video_modes(WFD::VESA),
+                                                    WFD::all_video_modes(WFD::HH),
+                                                    0, 0, 0, 0x11, 0, 0));
+            new_prop.reset(new WFD::VideoFormats(
+                WFD::native_resolution(WFD::CEA, 8), // 1920x1080p60
+                0, codec_list));
+            break;
+        }
+        case WFD::PropertyType::WFD_3D_FORMATS:
             new_prop.reset(new WFD::Formats3d());
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_CONTENT_PROTECTION]){
+            break;
+        case WFD::PropertyType::WFD_CONTENT_PROTECTION:
             new_prop.reset(new WFD::ContentProtection());
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_DISPLAY_EDID]){
+            break;
+        case WFD::PropertyType::WFD_DISPLAY_EDID:
             new_prop.reset(new WFD::DisplayEdid());
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_COUPLED_SINK]){
+            break;
+        case WFD::PropertyType::WFD_COUPLED_SINK:
             new_prop.reset(new WFD::CoupledSink());
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_CLIENT_RTP_PORTS]){
+            break;
+        case WFD::PropertyType::WFD_CLIENT_RTP_PORTS:
             new_prop.reset(new WFD::ClientRtpPorts(gst_pipeline->sink_udp_port(), 0));
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_I2C]){
+            break;
+        case WFD::PropertyType::WFD_I2C:
             new_prop.reset(new WFD::I2C(0));
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_UIBC_CAPABILITY]){
+            break;
+        case WFD::PropertyType::WFD_UIBC_CAPABILITY:
             new_prop.reset(new WFD::UIBCCapability());
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_CONNECTOR_TYPE]){
+            break;
+        case WFD::PropertyType::WFD_CONNECTOR_TYPE:
             new_prop.reset(new WFD::ConnectorType());
-            reply.payload().add_property(new_prop);
-        } else if (*it == WFD::PropertyName::name[WFD::PropertyType::WFD_STANDBY_RESUME_CAPABILITY]){
+            break;
+        case WFD::PropertyType::WFD_STANDBY_RESUME_CAPABILITY:
             new_prop.reset(new WFD::StandbyResumeCapability(false));
-            reply.payload().add_property(new_prop);
-        } else {
+            break;
+        default:
             std::cout << "** GET_PARAMETER: Property not supported" << std::endl;
+            break;
         }
+        if (new_prop)
+            reply.payload().add_property(new_prop);
     }
 
     send (reply);
 }
 
-void MiracSink::handle_m4_set_parameter (std::shared_ptr<WFD::Message> message, bool initial)
+void MiracSink::handle_m4_set_parameter (std::shared_ptr<WFD::Message> message)
 {
+    bool initial = state_ == CAPABILITY_NEGOTIATION;
     WFD::Reply reply(200);
     reply.header().set_cseq (message->header().cseq());
 
-    auto props = message->payload().properties();
+    auto& payload = message->payload();
 
     // presentation URL is the only thing we care about
     // support for other parameters can be added later as needed
     if (initial) {
-        auto prop = props.find (WFD::PropertyName::name[WFD::PropertyType::WFD_PRESENTATION_URL]);
-        if (prop == props.end()) {
+        if (!payload.has_property (WFD::PropertyType::WFD_PRESENTATION_URL)) {
             reply.set_response_code (303);
             std::cout << "** SET_PARAMETER: missing wfd_presentation_url" << std::endl;
             // Is 404 the right code? The spec is unclear...
             std::shared_ptr<WFD::PropertyErrors> error(new WFD::PropertyErrors(WFD::PropertyType::WFD_PRESENTATION_URL, {404}));
             reply.payload().add_property_error(error);
         } else {
-            auto url = std::static_pointer_cast<WFD::PresentationUrl>((*prop).second);
+            auto url = std::static_pointer_cast<WFD::PresentationUrl>(
+                payload.get_property (WFD::PropertyType::WFD_PRESENTATION_URL));
             set_presentation_url (url->presentation_url_1());
         }
     }
@@ -239,13 +262,35 @@ void MiracSink::handle_m5_trigger (std::shared_ptr<WFD::Message> message,
     (this->*command)();
 }
 
+void MiracSink::handle_m5_setup_trigger (std::shared_ptr<WFD::Message> message)
+{
+    handle_m5_trigger (message, &MiracSink::Setup);
+}
+
+void MiracSink::handle_m5_play_trigger (std::shared_ptr<WFD::Message> message)
+{
+    handle_m5_trigger (message, &MiracSink::Play);
+}
+
+void MiracSink::handle_m5_pause_trigger (std::shared_ptr<WFD::Message> message)
+{
+    handle_m5_trigger (message, &MiracSink::Pause);
+}
+
+void MiracSink::handle_m5_teardown_trigger (std::shared_ptr<WFD::Message> message)
+{
+    handle_m5_trigger (message, &MiracSink::Teardown);
+}
+
 void MiracSink::handle_m6_setup_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    // not expecting anything
-    expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
+    if (state_ != RTSP_SESSION_ESTABLISHMENT) {
+        std::cout << "** Unexpected reply" << std::endl;
+        return;
+    }
 
     // Ensure M6 SETUP reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     if (reply->header().session().empty()) {
@@ -261,11 +306,13 @@ void MiracSink::handle_m6_setup_reply (std::shared_ptr<WFD::Reply> reply)
 
 void MiracSink::handle_m7_play_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    // not expecting anything
-    expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
+    if (state_ != WFD_SESSION_ESTABLISHMENT && state_ != WFD_SESSION_PAUSED) {
+        std::cout << "** Unexpected reply" << std::endl;
+        return;
+    }
 
     // Ensure M7 PLAY reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     set_state (WFD_SESSION_PLAYING);
@@ -275,11 +322,13 @@ void MiracSink::handle_m7_play_reply (std::shared_ptr<WFD::Reply> reply)
 
 void MiracSink::handle_m8_teardown_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    // not expecting anything
-    expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
+    if (state_ != WFD_SESSION_PLAYING && state_ != WFD_SESSION_PAUSED) {
+        std::cout << "** Unexpected reply" << std::endl;
+        return;
+    }
 
     // Ensure M8 TEARDOWN reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
         return;
 
     set_state (INIT);
@@ -287,49 +336,68 @@ void MiracSink::handle_m8_teardown_reply (std::shared_ptr<WFD::Reply> reply)
 
 void MiracSink::handle_m9_pause_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    // not expecting anything
-    expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
+    if (state_ != WFD_SESSION_PLAYING) {
+        std::cout << "** Unexpected reply" << std::endl;
+        return;
+    }
 
     // Ensure M9 PAUSE reply is valid
-    if (reply->response_code() != 200)
+    if (!reply || reply->response_code() != 200)
       return;
 
     set_state (WFD_SESSION_PAUSED);
 }
 
-bool MiracSink::validate_message_sequence(std::shared_ptr<WFD::Message> message) const
+void MiracSink::handle_m13_idr_request_reply (std::shared_ptr<WFD::Reply> reply)
 {
-    if (message->type() == WFD::Message::MessageTypeReply) {
-        // Ensure sent message sequence
-        if (message->header().cseq() != send_cseq_ - 1) {
-            std::cout << "** Out-of-order reply CSeq, dropping reply" << std::endl;
-            return false;
-        }
-        if (expected_reply_ == WFD::Method::ORG_WFA_WFD_1_0) {
-            std::cout << "** Not expecting reply, dropping reply" << std::endl;
-            return false;
-        }
-    } else {
-        // Ensure received message sequence
-        if (message->type() != WFD::Message::MessageTypeOptions &&
-            message->header().cseq() != receive_cseq_ + 1) {
+    idr_pending_ = false;
 
-            WFD::Reply reply(400);
-            reply.header().set_cseq (message->header().cseq());
-            send (reply);
+    // Ensure M13 SET_PARAMETER reply is valid
+    if (!reply || reply->response_code() != 200)
+        std::cout << "** IDR request not answered" << std::endl;
+}
 
-            std::cout << "** Out-of-order message CSeq " << message->header().cseq() << std::endl;
-            return false;
-        }
+void MiracSink::request_idr()
+{
+    if (state_ != WFD_SESSION_PLAYING || idr_pending_)
+        return;
 
-        if (expected_reply_ != WFD::Method::ORG_WFA_WFD_1_0) {
-            WFD::Reply reply(400);
-            reply.header().set_cseq (message->header().cseq());
-            send (reply);
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_idr_request_ < idr_request_interval)
+        return;
+    last_idr_request_ = now;
+    idr_pending_ = true;
+
+    std::cout << "** requesting IDR" << std::endl;
+    WFD::SetParameter m13("rtsp://localhost/wfd1.0");
+    m13.header().set_session (session_);
+    m13.payload().add_get_parameter_property(WFD::PropertyType::WFD_IDR_REQUEST);
+    send_request (m13, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m13_idr_request_reply (reply);
+    }, idr_request_timeout);
+}
 
-            std::cout << "** Expected a reply";
-            return false;
-        }
+void MiracSink::watch_stream_losses()
+{
+    gst_pipeline->set_loss_callback([this] () {
+        request_idr();
+    });
+}
+
+// Replies are matched to their requests by the broker, requests may
+// arrive while our own ones are still in flight.
+bool MiracSink::validate_message_sequence(std::shared_ptr<WFD::Message> message) const
+{
+    // Ensure received message sequence
+    if (message->type() != WFD::Message::MessageTypeOptions &&
+        message->header().cseq() != receive_cseq_ + 1) {
+
+        WFD::Reply reply(400);
+        reply.header().set_cseq (message->header().cseq());
+        send (reply);
+
+        std::cout << "** Out-of-order message CSeq " << message->header().cseq() << std::endl;
+        return false;
     }
 
     return true;
@@ -344,139 +412,83 @@ void MiracSink::got_message(std::shared_ptr<WFD::Message> message)
 
     if (message->type() == WFD::Message::MessageTypeOptions)
         receive_cseq_ = message->header().cseq();
-    else if (message->type() != WFD::Message::MessageTypeReply)
+    else
         receive_cseq_++;
 
-    switch (message->type()) {
-        case WFD::Message::MessageTypeOptions:
-            if (state_ == INIT)
-                handle_m1_options(message);
-            else 
-                std::cout << "** Unexpected OPTIONS" << std::endl;
-            break;
-        case WFD::Message::MessageTypeGetParameter:
-            if (state_ >= CAPABILITY_NEGOTIATION)
-                handle_m3_get_parameter(message);
-            else 
-                std::cout << "** Unexpected GET_PARAMETER" << std::endl;
-            break;
-        case WFD::Message::MessageTypeSetParameter:
-        {
-            auto set_param = std::static_pointer_cast<WFD::SetParameter>(message);
-            if (state_ == CAPABILITY_NEGOTIATION &&
-                get_method(set_param) == SetParameterType::M4) {
-                handle_m4_set_parameter (message, true);
-            } else if (state_ >= RTSP_SESSION_ESTABLISHMENT &&
-                get_method(set_param) == SetParameterType::M4) {
-                handle_m4_set_parameter (message, false);
-            } else if (state_ == RTSP_SESSION_ESTABLISHMENT &&
-                       get_method(set_param) == SetParameterType::M5_TRIGGER_SETUP) {
-                handle_m5_trigger(message, &MiracSink::Setup);
-            } else if ((state_ == WFD_SESSION_PLAYING ||
-                        state_ == WFD_SESSION_PAUSED) &&
-                       get_method(set_param) == SetParameterType::M5_TRIGGER_TEARDOWN) {
-                handle_m5_trigger (message, &MiracSink::Teardown);
-            } else if (state_ == WFD_SESSION_PLAYING &&
-                       get_method(set_param) == SetParameterType::M5_TRIGGER_PAUSE) {
-                handle_m5_trigger(message, &MiracSink::Pause);
-            } else if (state_ == WFD_SESSION_PAUSED &&
-                       get_method(set_param) == SetParameterType::M5_TRIGGER_PLAY) {
-                handle_m5_trigger(message, &MiracSink::Play);
-            } else {
-                std::cout << "** Unexpected SET_PARAMETER" << std::endl;
-            }
-            break;
-        }
-        case WFD::Message::MessageTypeReply:
-            if (state_ == CAPABILITY_NEGOTIATION &&
-                expected_reply_ == WFD::Method::OPTIONS) {
-                handle_m2_options_reply(std::static_pointer_cast<WFD::Reply>(message));
-            } else if (state_ == RTSP_SESSION_ESTABLISHMENT &&
-                       expected_reply_ == WFD::Method::SETUP) {
-                handle_m6_setup_reply(std::static_pointer_cast<WFD::Reply>(message));
-            } else if (state_ == WFD_SESSION_ESTABLISHMENT &&
-                       expected_reply_ == WFD::Method::PLAY) {
-                handle_m7_play_reply(std::static_pointer_cast<WFD::Reply>(message));
-            } else if (state_ == WFD_SESSION_PLAYING) {
-                switch (expected_reply_) {
-                case WFD::Method::TEARDOWN:
-                    handle_m8_teardown_reply(std::static_pointer_cast<WFD::Reply>(message));
-                    break;
-                case WFD::Method::PAUSE:
-                    handle_m9_pause_reply(std::static_pointer_cast<WFD::Reply>(message));
-                    break;
-                default:
-                    break;
-                }
-            } else if (state_ == WFD_SESSION_PAUSED) {
-                switch (expected_reply_) {
-                case WFD::Method::TEARDOWN:
-                    handle_m8_teardown_reply(std::static_pointer_cast<WFD::Reply>(message));
-                    break;
-                case WFD::Method::PLAY:
-                    handle_m7_play_reply(std::static_pointer_cast<WFD::Reply>(message));
-                    break;
-                default:
-                    break;
-                }
-            } else {
-                std::cout << "** Unexpected reply" << std::endl;
-            }
-            break;
-        default:
-            std::cout << "** Method not implemented" << std::endl;
-            break;
-    }
+    if (!state_machine_.Dispatch (this, state_, message))
+        std::cout << "** Unexpected " << StateMachine::KindName (StateMachine::Classify (*message))
+                  << " in state " << state_names[state_] << std::endl;
 }
 
 void MiracSink::on_connected()
 {
     set_state(INIT);
+    state_machine_.Restart();
+    // requests of the last connection are gone with it
+    idr_pending_ = false;
 }
 
-MiracSink::MiracSink(const std::string& host, int rtsp_port)
-    : MiracBroker(host.c_str(), std::to_string(rtsp_port)),
-      send_cseq_(0),
-      receive_cseq_(0) {
+void MiracSink::on_disconnected()
+{
+    // have a fresh pipeline ready before the broker reconnects
+    gst_pipeline.reset(new MiracGstSink("", 0));
+    watch_stream_losses();
+}
 
+MiracSink::MiracSink(const std::string& host, int rtsp_port)
+    : MiracBroker(host.c_str(), std::to_string(rtsp_port), NULL,
+                  connector_options()),
+      state_(INIT),
+      state_machine_(transitions),
+      receive_cseq_(0),
+      idr_pending_(false),
+      // built while the source may not even be there yet, so that a
+      // new connection does not wait for it
+      gst_pipeline(new MiracGstSink("", 0)) {
+    watch_stream_losses();
 }
 
 MiracSink::~MiracSink()
 {
 }
 
+void MiracSink::print_statistics(std::ostream& out) const
+{
+    state_machine_.PrintStatistics (out, state_names);
+}
+
 void MiracSink::Teardown() {
     std::cout << "** teardown" << std::endl;
-    expected_reply_ = WFD::Method::TEARDOWN;
     WFD::Teardown m8(presentation_url_);
-    m8.header().set_cseq (send_cseq_++);
-    send(m8);
+    send_request(m8, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m8_teardown_reply (reply);
+    });
 }
 
 void MiracSink::Play() {
     std::cout << "** play" << std::endl;
-    expected_reply_ = WFD::Method::PLAY;
     WFD::Play m7(presentation_url_);
     m7.header().set_session (session_);
-    m7.header().set_cseq (send_cseq_++);
-    send (m7);
+    send_request (m7, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m7_play_reply (reply);
+    });
 }
 
 void MiracSink::Pause() {
     std::cout << "** pause" << std::endl;
-    expected_reply_ = WFD::Method::PAUSE;
     WFD::Pause m9(presentation_url_);
-    m9.header().set_cseq (send_cseq_++);
-    send(m9);
+    send_request(m9, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m9_pause_reply (reply);
+    });
 }
 
 void MiracSink::Setup() {
     std::cout << "** setup" << std::endl;
-    expected_reply_ = WFD::Method::SETUP;
     WFD::Setup m6(presentation_url_);
     auto transport = new WFD::TransportHeader();
     transport->set_client_port(gst_pipeline->sink_udp_port());
     m6.header().set_transport(transport);
-    m6.header().set_cseq (send_cseq_++);
-    send (m6);
+    send_request (m6, [this] (std::shared_ptr<WFD::Reply> reply) {
+        handle_m6_setup_reply (reply);
+    });
 }
@@ -25,9 +25,11 @@
 #ifndef MIRAC_SINK_HPP
 #define MIRAC_SINK_HPP
 
+#include <chrono>
 #include <memory>
 
 #include "mirac-broker.hpp"
+#include "mirac-state-machine.hpp"
 #include "reply.h"
 #include "setparameter.h"
 #include "mirac-gst-sink.hpp"
@@ -44,6 +46,9 @@ class MiracSink: public MiracBroker
         void Play(); // sends M7 RTSP message.
         void Pause(); // sends M9 RTSP message.
 
+        // time taken by each transition of the sessions so far
+        void print_statistics(std::ostream& out) const;
+
     private:
         enum State {
             INIT,
@@ -52,46 +57,52 @@ class MiracSink: public MiracBroker
             WFD_SESSION_ESTABLISHMENT, // RSTP SESSION OK
             WFD_SESSION_PLAYING,
             WFD_SESSION_PAUSED,
+            STATE_COUNT
         };
 
-        enum SetParameterType {
-            M4,
-            M5_TRIGGER_SETUP,
-            M5_TRIGGER_PLAY,
-            M5_TRIGGER_PAUSE,
-            M5_TRIGGER_TEARDOWN,
-        };
-
-        static SetParameterType get_method(std::shared_ptr<WFD::SetParameter> set_param);
+        typedef MiracStateMachine<MiracSink, STATE_COUNT> StateMachine;
+        static const StateMachine::Transition transitions[];
+        static const char* const state_names[];
 
         void got_message(std::shared_ptr<WFD::Message> message);
         void on_connected();
+        void on_disconnected();
 
         bool validate_message_sequence(std::shared_ptr<WFD::Message> message) const;
 
         void handle_m1_options (std::shared_ptr<WFD::Message> message);
         void handle_m2_options_reply (std::shared_ptr<WFD::Reply> reply);
         void handle_m3_get_parameter (std::shared_ptr<WFD::Message> message);
-        void handle_m4_set_parameter (std::shared_ptr<WFD::Message> message, bool initial);
+        void handle_m4_set_parameter (std::shared_ptr<WFD::Message> message);
         void handle_m5_trigger (std::shared_ptr<WFD::Message> message, TriggeredCommand command);
+        void handle_m5_setup_trigger (std::shared_ptr<WFD::Message> message);
+        void handle_m5_play_trigger (std::shared_ptr<WFD::Message> message);
+        void handle_m5_pause_trigger (std::shared_ptr<WFD::Message> message);
+        void handle_m5_teardown_trigger (std::shared_ptr<WFD::Message> message);
         void handle_m6_setup_reply (std::shared_ptr<WFD::Reply> reply);
         void handle_m7_play_reply (std::shared_ptr<WFD::Reply> reply);
         void handle_m8_teardown_reply (std::shared_ptr<WFD::Reply> reply);
         void handle_m9_pause_reply (std::shared_ptr<WFD::Reply> reply);
+        void handle_m13_idr_request_reply (std::shared_ptr<WFD::Reply> reply);
+
+        // sends M13 after the pipeline lost stream data
+        void request_idr();
+        void watch_stream_losses();
 
         void set_state(MiracSink::State state);
         void set_presentation_url (std::string url);
         void set_session (std::string session);
 
         MiracSink::State state_;
+        StateMachine state_machine_;
         std::string presentation_url_;
         std::string session_;
 
-        WFD::Method expected_reply_ = WFD::Method::ORG_WFA_WFD_1_0;
-
-        int send_cseq_;
         int receive_cseq_;
 
+        bool idr_pending_;
+        std::chrono::steady_clock::time_point last_idr_request_;
+
         std::unique_ptr<MiracGstSink> gst_pipeline;
 };
 
@@ -0,0 +1,112 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace WFD {
+
+Arena::Arena(size_t block_size)
+  : block_size_(block_size),
+    blocks_(nullptr),
+    current_(nullptr),
+    end_(nullptr),
+    destructors_(nullptr),
+    bytes_used_(0) {
+}
+
+Arena::~Arena() {
+  run_destructors();
+  free_blocks(blocks_);
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(current_);
+  size_t padding = (alignment - address % alignment) % alignment;
+
+  if (!current_ || padding + size > static_cast<size_t>(end_ - current_)) {
+    size_t block_size = sizeof(Block) + size + alignment;
+    if (block_size < block_size_)
+      block_size = block_size_;
+
+    Block* block = static_cast<Block*>(std::malloc(block_size));
+    if (!block)
+      throw std::bad_alloc();
+    block->next = blocks_;
+    block->size = block_size;
+    blocks_ = block;
+    current_ = reinterpret_cast<char*>(block + 1);
+    end_ = reinterpret_cast<char*>(block) + block_size;
+
+    address = reinterpret_cast<uintptr_t>(current_);
+    padding = (alignment - address % alignment) % alignment;
+  }
+
+  char* memory = current_ + padding;
+  current_ = memory + size;
+  bytes_used_ += padding + size;
+  return memory;
+}
+
+void Arena::reset() {
+  run_destructors();
+  if (blocks_) {
+    // Keep only the largest block around for the next message.
+    Block* largest = blocks_;
+    for (Block* block = blocks_->next; block; block = block->next) {
+      if (block->size > largest->size)
+        largest = block;
+    }
+    Block* block = blocks_;
+    while (block) {
+      Block* next = block->next;
+      if (block != largest)
+        std::free(block);
+      block = next;
+    }
+    largest->next = nullptr;
+    blocks_ = largest;
+    current_ = reinterpret_cast<char*>(blocks_ + 1);
+    end_ = reinterpret_cast<char*>(blocks_) + blocks_->size;
+  }
+  bytes_used_ = 0;
+}
+
+void Arena::run_destructors() {
+  while (destructors_) {
+    Destructor* destructor = destructors_;
+    destructors_ = destructor->next;
+    destructor->destroy(destructor->object);
+  }
+}
+
+void Arena::free_blocks(Block* block) {
+  while (block) {
+    Block* next = block->next;
+    std::free(block);
+    block = next;
+  }
+}
+
+}  // namespace WFD
@@ -0,0 +1,98 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace WFD {
+
+// Monotonic allocator for the objects of one parsed message. Memory is
+// handed out from large blocks and never given back individually;
+// reset() runs the destructors of all created objects in reverse order
+// and rewinds the arena so the memory can be reused for the next message.
+class Arena {
+ public:
+  explicit Arena(size_t block_size = 4096);
+  ~Arena();
+
+  void* allocate(size_t size, size_t alignment);
+
+  template <typename T, typename... Args>
+  T* create(Args&&... args) {
+    Destructor* destructor = nullptr;
+    if (!std::is_trivially_destructible<T>::value)
+      destructor = static_cast<Destructor*>(
+          allocate(sizeof(Destructor), alignof(Destructor)));
+    T* object = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if (destructor) {
+      destructor->destroy = &destroy<T>;
+      destructor->object = object;
+      destructor->next = destructors_;
+      destructors_ = destructor;
+    }
+    return object;
+  }
+
+  void reset();
+
+  size_t bytes_used() const { return bytes_used_; }
+
+ private:
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  struct Destructor {
+    void (*destroy)(void*);
+    void* object;
+    Destructor* next;
+  };
+
+  template <typename T>
+  static void destroy(void* object) {
+    static_cast<T*>(object)->~T();
+  }
+
+  void run_destructors();
+  void free_blocks(Block* block);
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  size_t block_size_;
+  Block* blocks_;
+  char* current_;
+  char* end_;
+  Destructor* destructors_;
+  size_t bytes_used_;
+};
+
+}  // namespace WFD
+
+#endif  // ARENA_H_
@@ -66,15 +66,19 @@ void AudioCodec::set_latency(unsigned short latency) {
 }
 
 std::string AudioCodec::to_string() const {
-  MAKE_HEX_STRING_8(audio_modes_str,
-      static_cast<unsigned int>(audio_modes().to_ulong()));
-  MAKE_HEX_STRING_2(latency_str, latency());
-  std::string ret = AudioFormat::name[audio_format()]
-    + std::string(SPACE) + audio_modes_str
-    + std::string(SPACE) + latency_str;
+  std::string ret;
+  write(ret);
   return ret;
 }
 
+void AudioCodec::write(std::string& out) const {
+  out += AudioFormat::name[audio_format()];
+  out += SPACE;
+  append_hex(out, static_cast<unsigned int>(audio_modes().to_ulong()), 8);
+  out += SPACE;
+  append_hex(out, static_cast<unsigned int>(latency()), 2);
+}
+
 AudioCodecs::AudioCodecs() : Property(WFD_AUDIO_CODECS, true) {
 }
 
@@ -87,24 +91,27 @@ AudioCodecs::~AudioCodecs() {
 }
 
 std::string AudioCodecs::to_string() const {
-  std::string ret = PropertyName::wfd_audio_codecs + std::string(SEMICOLON)
-    + std::string(SPACE);
+  std::string ret;
+  write(ret);
+  return ret;
+}
 
+void AudioCodecs::write(std::string& out) const {
+  out += PropertyName::wfd_audio_codecs;
+  out += SEMICOLON;
+  out += SPACE;
   if (audio_codecs_.size()) {
     auto i = audio_codecs_.begin();
     auto end = audio_codecs_.end();
     while (i != end) {
-      ret += (*i).to_string();
-      if (i != --audio_codecs_.end()) {
-        ret += ", ";
-      }
+      (*i).write(out);
       ++i;
+      if (i != end)
+        out += ", ";
     }
   } else {
-    ret += WFD::NONE;
+    out += WFD::NONE;
   }
-
-  return ret;
 }
 
 }  // namespace WFD
@@ -64,6 +64,7 @@ struct AudioCodec {
   void set_latency(unsigned short latency);
 
   std::string to_string() const;
+  void write(std::string& out) const;
 
  private:
   AudioFormat::Type audio_format_;
@@ -79,6 +80,7 @@ class AudioCodecs: public Property {
 
   const std::vector<AudioCodec>& audio_codecs() const { return audio_codecs_; }
   virtual std::string to_string() const;
+  virtual void write(std::string& out) const;
 
  private:
   std::vector<AudioCodec> audio_codecs_;
@@ -0,0 +1,482 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <strings.h>
+#include <vector>
+
+#include "driver.h"
+#include "reply.h"
+#include "setparameter.h"
+#include "audiocodecs.h"
+#include "videoformats.h"
+#include "clientrtpports.h"
+#include "presentationurl.h"
+
+#ifndef WFD_DATADUMPS_DIR
+#define WFD_DATADUMPS_DIR "../datadumps"
+#endif
+
+// Counts everything allocated through operator new. The flex buffers
+// come from malloc() and are not included.
+static size_t allocation_count = 0;
+static size_t allocated_bytes = 0;
+
+void* operator new(size_t size) {
+  ++allocation_count;
+  allocated_bytes += size;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+namespace {
+
+struct RawMessage {
+  std::string header;
+  std::string payload;
+};
+
+// Short control messages: keep-alives, triggers and their replies.
+const RawMessage kControlMessages[] = {
+  { "GET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+    "CSeq: 10\r\n"
+    "Session: 6B8B4567\r\n\r\n", "" },
+  { "RTSP/1.0 200 OK\r\n"
+    "CSeq: 10\r\n\r\n", "" },
+  { "SET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+    "CSeq: 11\r\n"
+    "Content-Type: text/parameters\r\n"
+    "Content-Length: 27\r\n\r\n",
+    "wfd_trigger_method: SETUP\r\n" },
+  { "OPTIONS * RTSP/1.0\r\n"
+    "CSeq: 1\r\n"
+    "Require: org.wfa.wfd1.0\r\n\r\n", "" },
+};
+
+// M3 reply of a sink with most capabilities filled in.
+const RawMessage kCapabilityReply = {
+  "RTSP/1.0 200 OK\r\n"
+  "CSeq: 2\r\n"
+  "Content-Type: text/parameters\r\n"
+  "Content-Length: 535\r\n\r\n",
+  "wfd_3d_video_formats: 80 00 03 0F 0000000000000005 00 0001 1401 13 none none\r\n"
+  "wfd_I2C: 404\r\n"
+  "wfd_audio_codecs: LPCM 00000003 00, AAC 00000001 00\r\n"
+  "wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0 mode=play\r\n"
+  "wfd_connector_type: 05\r\n"
+  "wfd_content_protection: HDCP2.1 port=1189\r\n"
+  "wfd_coupled_sink: none\r\n"
+  "wfd_display_edid: none\r\n"
+  "wfd_standby_resume_capability: supported\r\n"
+  "wfd_uibc_capability: none\r\n"
+  "wfd_video_formats: 40 00 02 04 0001DEFF 053C7FFF 00000FFF 00 0000 0000 11 none none, 01 04 0001DEFF 053C7FFF 00000FFF 00 0000 0000 11 none none\r\n"
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// Keeps the serialization loops from being optimized away.
+size_t serialized_bytes = 0;
+
+void parse(WFD::Driver& driver, const RawMessage& message) {
+  driver.parse_header(message.header);
+  if (!message.payload.empty())
+    driver.parse_payload(message.payload);
+}
+
+// Creates a new driver for every message. This is what every message
+// used to cost when the driver rebuilt its scanner and parser per parse.
+double bench_fresh_driver(int iterations) {
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto& message : kControlMessages) {
+      WFD::Driver driver;
+      parse(driver, message);
+    }
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// One driver per connection, lexers and parser are reused.
+double bench_reused_driver(int iterations) {
+  WFD::Driver driver;
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto& message : kControlMessages)
+      parse(driver, message);
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Same as above, but every message tree is allocated from one arena.
+double bench_arena_driver(int iterations) {
+  WFD::Driver driver;
+  driver.set_use_arena(true);
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto& message : kControlMessages)
+      parse(driver, message);
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Headers go through the hand-written parser, payloads through flex.
+double bench_fast_header_driver(int iterations) {
+  WFD::Driver driver;
+  driver.set_use_fast_header_parser(true);
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto& message : kControlMessages)
+      parse(driver, message);
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Parses the capability reply and looks up a single property in it,
+// like a source picking the RTP port out of an M3 reply.
+double bench_capability_lookup(bool lazy, int iterations) {
+  WFD::Driver driver;
+  driver.set_use_lazy_payloads(lazy);
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    parse(driver, kCapabilityReply);
+    driver.parsed_message()->payload().get_property(
+        WFD::WFD_CLIENT_RTP_PORTS);
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// M3 reply of a sink that advertises many H.264 codecs.
+std::unique_ptr<WFD::Message> create_m3_reply() {
+  std::unique_ptr<WFD::Message> reply(new WFD::Reply(200));
+  reply->header().set_cseq(2);
+
+  std::vector<WFD::AudioCodec> audio_codecs;
+  audio_codecs.push_back(WFD::AudioCodec(WFD::AudioFormat::LPCM,
+                                         WFD::AudioFormat::Modes(3), 0));
+  audio_codecs.push_back(WFD::AudioCodec(WFD::AudioFormat::AAC,
+                                         WFD::AudioFormat::Modes(15), 0));
+  audio_codecs.push_back(WFD::AudioCodec(WFD::AudioFormat::AC3,
+                                         WFD::AudioFormat::Modes(7), 0));
+  reply->payload().add_property(
+      std::make_shared<WFD::AudioCodecs>(audio_codecs));
+
+  WFD::H264Codecs codecs;
+  for (unsigned char profile = 1; profile <= 2; ++profile) {
+    for (unsigned char level = 1; level <= 16; level <<= 1)
+      codecs.push_back(WFD::H264Codec(profile, level, 0x1ffff, 0x1fffffff,
+                                      0xfff, 0, 0, 0, 0x11, 1920, 1080));
+  }
+  reply->payload().add_property(
+      std::make_shared<WFD::VideoFormats>(0x40, 0, codecs));
+  reply->payload().add_property(
+      std::make_shared<WFD::ClientRtpPorts>(19000, 0));
+  return reply;
+}
+
+// M4 request with the negotiated formats and the presentation URL.
+std::unique_ptr<WFD::Message> create_m4_request() {
+  std::unique_ptr<WFD::Message> request(
+      new WFD::SetParameter("rtsp://localhost/wfd1.0"));
+  request->header().set_cseq(3);
+
+  std::vector<WFD::AudioCodec> audio_codecs;
+  audio_codecs.push_back(WFD::AudioCodec(WFD::AudioFormat::AAC,
+                                         WFD::AudioFormat::Modes(1), 0));
+  request->payload().add_property(
+      std::make_shared<WFD::AudioCodecs>(audio_codecs));
+
+  WFD::H264Codecs codecs;
+  codecs.push_back(WFD::H264Codec(1, 16, 0x80, 0, 0, 0, 0, 0, 0x11,
+                                  1920, 1080));
+  request->payload().add_property(
+      std::make_shared<WFD::VideoFormats>(0x40, 0, codecs));
+  request->payload().add_property(
+      std::make_shared<WFD::ClientRtpPorts>(19000, 0));
+  request->payload().add_property(std::make_shared<WFD::PresentationUrl>(
+      "rtsp://192.168.173.1/wfd1.0/streamid=0", ""));
+  return request;
+}
+
+// A new string for every message.
+double bench_to_string(WFD::Message& message, int iterations) {
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    serialized_bytes += message.to_string().size();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// One output buffer reused for every message.
+double bench_serialize(WFD::Message& message, int iterations) {
+  std::string buffer;
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    message.serialize(buffer);
+    serialized_bytes += buffer.size();
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Splits a capture in the datadumps/ format into messages: a start
+// line, headers up to an empty line and, when the header announces
+// one, a body that runs until the next start line. Lines get CRLF
+// endings as on the wire.
+std::vector<RawMessage> load_capture(const std::string& path) {
+  std::vector<RawMessage> messages;
+  std::ifstream file(path);
+  std::string line;
+  bool in_header = false;
+  bool has_body = false;
+  while (std::getline(file, line)) {
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.erase(line.size() - 1);
+
+    bool is_start_line = line.compare(0, 5, "RTSP/") == 0;
+    for (int method = WFD::OPTIONS; method <= WFD::PAUSE; ++method) {
+      std::string prefix = std::string(WFD::MethodName::name[method]) + " ";
+      is_start_line |= line.compare(0, prefix.size(), prefix) == 0;
+    }
+    if (is_start_line) {
+      messages.push_back(RawMessage());
+      in_header = true;
+      has_body = false;
+    }
+    if (messages.empty())
+      continue;
+
+    RawMessage& message = messages.back();
+    if (in_header) {
+      message.header += line + "\r\n";
+      if (line.empty())
+        in_header = false;
+      else if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0)
+        has_body = atoi(line.c_str() + 15) > 0;
+    } else if (has_body && !line.empty()) {
+      message.payload += line + "\r\n";
+    }
+  }
+
+  // A header still open at the end of the file gets its empty line.
+  if (in_header)
+    messages.back().header += "\r\n";
+  return messages;
+}
+
+// Keeps only the messages the parser accepts, so that every
+// benchmark replays the same set.
+std::vector<RawMessage> parseable(const std::vector<RawMessage>& messages) {
+  std::vector<RawMessage> accepted;
+  WFD::Driver driver;
+  for (const auto& message : messages) {
+    try {
+      parse(driver, message);
+      accepted.push_back(message);
+    } catch (std::exception& x) {
+      std::cerr << "skipping message: " << x.what() << std::endl
+                << message.header;
+    }
+  }
+  return accepted;
+}
+
+double bench_corpus(const std::vector<RawMessage>& corpus, bool fast,
+                    int iterations) {
+  WFD::Driver driver;
+  driver.set_use_fast_header_parser(fast);
+  driver.set_use_lazy_payloads(fast);
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto& message : corpus)
+      parse(driver, message);
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::vector<std::shared_ptr<WFD::Message>> parse_all(
+    const std::vector<RawMessage>& corpus) {
+  std::vector<std::shared_ptr<WFD::Message>> messages;
+  WFD::Driver driver;
+  for (const auto& message : corpus) {
+    parse(driver, message);
+    messages.push_back(driver.parsed_message());
+  }
+  return messages;
+}
+
+double bench_corpus_to_string(
+    const std::vector<std::shared_ptr<WFD::Message>>& messages,
+    int iterations) {
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto& message : messages)
+      serialized_bytes += message->to_string().size();
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double bench_corpus_serialize(
+    const std::vector<std::shared_ptr<WFD::Message>>& messages,
+    int iterations) {
+  std::string buffer;
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    for (const auto& message : messages) {
+      message->serialize(buffer);
+      serialized_bytes += buffer.size();
+    }
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Result {
+  std::string name;
+  long messages;
+  double seconds;
+  size_t allocations;
+  size_t bytes;
+};
+
+std::vector<Result> results;
+
+// Runs |bench| and records its time and allocations for |messages|.
+template <typename Bench>
+void run(const std::string& name, long messages, Bench bench) {
+  size_t allocations_before = allocation_count;
+  size_t bytes_before = allocated_bytes;
+  double seconds = bench();
+  Result result = { name, messages, seconds,
+                    allocation_count - allocations_before,
+                    allocated_bytes - bytes_before };
+  results.push_back(result);
+}
+
+void print_text() {
+  for (const auto& result : results) {
+    double messages = result.messages;
+    std::cout << result.name << ": " << result.messages << " messages, "
+              << static_cast<long>(result.seconds * 1e9 / messages)
+              << " ns/message, "
+              << result.allocations / messages << " allocations/message, "
+              << result.bytes / messages << " bytes allocated/message"
+              << std::endl;
+  }
+}
+
+void print_json(int iterations) {
+  std::cout << "{\n  \"iterations\": " << iterations
+            << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    double messages = result.messages;
+    std::cout << (i ? "," : "") << "\n    {"
+              << "\"name\": \"" << result.name << "\", "
+              << "\"messages\": " << result.messages << ", "
+              << "\"ns_per_message\": " << result.seconds * 1e9 / messages
+              << ", \"allocations_per_message\": "
+              << result.allocations / messages
+              << ", \"bytes_allocated_per_message\": "
+              << result.bytes / messages << "}";
+  }
+  std::cout << "\n  ]\n}" << std::endl;
+}
+
+}  // namespace
+
+// usage: bench-wfd [--json] [--capture FILE] [ITERATIONS]
+int main(const int argc, const char **argv)
+{
+  bool json = false;
+  std::string capture = WFD_DATADUMPS_DIR "/rtsp-capture-win8.txt";
+  int iterations = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--json"))
+      json = true;
+    else if (!strcmp(argv[i], "--capture") && i + 1 < argc)
+      capture = argv[++i];
+    else
+      iterations = std::atoi(argv[i]);
+  }
+  if (iterations <= 0)
+    iterations = 20000;
+
+  const int count = sizeof(kControlMessages) / sizeof(kControlMessages[0]);
+  const int messages = iterations * count;
+
+  run("fresh driver", messages, [&] { return bench_fresh_driver(iterations); });
+  run("reused driver", messages, [&] { return bench_reused_driver(iterations); });
+  run("arena driver", messages, [&] { return bench_arena_driver(iterations); });
+  run("fast headers", messages, [&] { return bench_fast_header_driver(iterations); });
+
+  run("M3 reply, eager payload", iterations,
+      [&] { return bench_capability_lookup(false, iterations); });
+  run("M3 reply, lazy payload", iterations,
+      [&] { return bench_capability_lookup(true, iterations); });
+
+  auto m3_reply = create_m3_reply();
+  auto m4_request = create_m4_request();
+  run("M3 reply to_string", iterations,
+      [&] { return bench_to_string(*m3_reply, iterations); });
+  run("M3 reply serialize", iterations,
+      [&] { return bench_serialize(*m3_reply, iterations); });
+  run("M4 request to_string", iterations,
+      [&] { return bench_to_string(*m4_request, iterations); });
+  run("M4 request serialize", iterations,
+      [&] { return bench_serialize(*m4_request, iterations); });
+
+  // The capture is replayed fewer times, it has about ten times as
+  // many messages as the control set.
+  auto corpus = parseable(load_capture(capture));
+  if (corpus.empty()) {
+    std::cerr << "no messages in " << capture << std::endl;
+  } else {
+    int corpus_iterations = iterations / 10 ? iterations / 10 : 1;
+    long corpus_messages = static_cast<long>(corpus.size()) * corpus_iterations;
+    auto parsed = parse_all(corpus);
+    run("capture parse", corpus_messages,
+        [&] { return bench_corpus(corpus, false, corpus_iterations); });
+    run("capture parse, fast headers, lazy payloads", corpus_messages,
+        [&] { return bench_corpus(corpus, true, corpus_iterations); });
+    run("capture to_string", corpus_messages,
+        [&] { return bench_corpus_to_string(parsed, corpus_iterations); });
+    run("capture serialize", corpus_messages,
+        [&] { return bench_corpus_serialize(parsed, corpus_iterations); });
+  }
+
+  if (json)
+    print_json(iterations);
+  else
+    print_text();
+
+  return 0;
+}
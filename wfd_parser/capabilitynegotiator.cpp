@@ -0,0 +1,151 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+
+#include "capabilitynegotiator.h"
+
+#include "videomodes.h"
+
+namespace WFD {
+
+namespace {
+
+// Latencies in wfd_video_formats and wfd_audio_codecs are in 5 ms units.
+const unsigned int kLatencyUnit = 5;
+
+int highest_bit(unsigned long mask) {
+  return 8 * sizeof(mask) - 1 - __builtin_clzl(mask);
+}
+
+// Lowest level of |levels| that can carry |mode|, 0 if none can.
+unsigned char lowest_level(unsigned char levels, const VideoMode& mode,
+                           bool high_profile) {
+  unsigned int mode_bitrate = estimated_bitrate(mode);
+  for (const auto& level : kH264Levels) {
+    unsigned int max_bitrate = level.max_bitrate;
+    if (high_profile)
+      max_bitrate += max_bitrate / 4;
+    if ((levels & level.level) &&
+        frame_size(mode) <= level.max_frame_size &&
+        macroblock_rate(mode) <= level.max_macroblock_rate &&
+        mode_bitrate <= max_bitrate)
+      return level.level;
+  }
+  return 0;
+}
+
+}  // namespace
+
+CapabilityNegotiator::CapabilityNegotiator(
+    const H264Codecs& video_codecs,
+    const std::vector<AudioCodec>& audio_codecs)
+  : video_codecs_(video_codecs),
+    audio_codecs_(audio_codecs),
+    max_bitrate_(0),
+    max_latency_(0) {
+}
+
+std::shared_ptr<VideoFormats> CapabilityNegotiator::select_video_format(
+    const VideoFormats& remote) const {
+  H264Codecs selected;
+  unsigned char native = 0;
+  unsigned int best_pixel_rate = 0;
+
+  for (const auto& codec : remote.h264_codecs()) {
+    if (max_latency_ && codec.latency_ * kLatencyUnit > max_latency_)
+      continue;
+
+    for (const auto& local : video_codecs_) {
+      unsigned char profiles = codec.profile_ & local.profile_;
+      unsigned char levels = codec.level_ & local.level_;
+      if (!profiles || !levels)
+        continue;
+      // CHP compresses better than CBP at the same level.
+      unsigned char profile = 1 << highest_bit(profiles);
+
+      const unsigned int modes[] = {
+        codec.cea_support_ & local.cea_support_,
+        codec.vesa_support_ & local.vesa_support_,
+        codec.hh_support_ & local.hh_support_
+      };
+      for (int type = CEA; type <= HH; ++type) {
+        // Walk the common modes from the highest pixel rate down, the
+        // first one that fits is the best of this table.
+        const unsigned char* order = kVideoModesByPixelRate[type];
+        for (unsigned int i = 0; i < kVideoModeCount[type]; ++i) {
+          unsigned int index = order[i];
+          if (!(modes[type] & (1u << index)))
+            continue;
+          const VideoMode& mode = kVideoModes[type][index];
+          if (pixel_rate(mode) <= best_pixel_rate)
+            break;
+          if (max_bitrate_ && estimated_bitrate(mode) > max_bitrate_)
+            continue;
+          unsigned char level = lowest_level(levels, mode, profile == CHP);
+          if (!level)
+            continue;
+
+          best_pixel_rate = pixel_rate(mode);
+          native = native_resolution(static_cast<ResolutionType>(type), index);
+          selected.assign(1, H264Codec(
+              profile, level,
+              type == CEA ? 1u << index : 0,
+              type == VESA ? 1u << index : 0,
+              type == HH ? 1u << index : 0,
+              codec.latency_, codec.min_slice_size_, codec.slice_enc_params_,
+              codec.frame_rate_control_support_ &
+                  local.frame_rate_control_support_,
+              -1, -1));
+          break;
+        }
+      }
+    }
+  }
+
+  if (selected.empty())
+    return nullptr;
+  return std::make_shared<VideoFormats>(native, 0, selected);
+}
+
+std::shared_ptr<AudioCodecs> CapabilityNegotiator::select_audio_codec(
+    const AudioCodecs& remote) const {
+  for (const auto& local : audio_codecs_) {
+    for (const auto& codec : remote.audio_codecs()) {
+      if (codec.audio_format() != local.audio_format())
+        continue;
+      if (max_latency_ && codec.latency() * kLatencyUnit > max_latency_)
+        continue;
+      AudioFormat::Modes modes = codec.audio_modes() & local.audio_modes();
+      if (modes.none())
+        continue;
+
+      // Higher mode bits have more channels, or a higher sample rate
+      // for LPCM.
+      AudioFormat::Modes mode(1ul << highest_bit(modes.to_ulong()));
+      return std::make_shared<AudioCodecs>(std::vector<AudioCodec>(
+          1, AudioCodec(codec.audio_format(), mode, 0)));
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace WFD
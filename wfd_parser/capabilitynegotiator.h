@@ -0,0 +1,67 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+
+#ifndef CAPABILITYNEGOTIATOR_H_
+#define CAPABILITYNEGOTIATOR_H_
+
+#include <memory>
+#include <vector>
+
+#include "audiocodecs.h"
+#include "videoformats.h"
+
+namespace WFD {
+
+// Picks the formats a source announces in M4 out of the ones a sink
+// listed in its M3 reply and the ones the local encoders support.
+class CapabilityNegotiator {
+ public:
+  CapabilityNegotiator(const H264Codecs& video_codecs,
+                       const std::vector<AudioCodec>& audio_codecs);
+
+  // Upper bound for the video bitrate in kbit/s, 0 for none.
+  void set_max_bitrate(unsigned int max_bitrate) { max_bitrate_ = max_bitrate; }
+  // Upper bound for the decoder latency the sink reports, in ms,
+  // 0 for none.
+  void set_max_latency(unsigned int max_latency) { max_latency_ = max_latency; }
+
+  // The mode with the highest pixel rate that both sides support and
+  // that fits the limits, with the best common profile and the lowest
+  // level that can carry it. Null if there is no such mode.
+  std::shared_ptr<VideoFormats> select_video_format(
+      const VideoFormats& remote) const;
+  // The first local codec the sink also supports, in the common mode
+  // with the most channels. Null if there is none.
+  std::shared_ptr<AudioCodecs> select_audio_codec(
+      const AudioCodecs& remote) const;
+
+ private:
+  H264Codecs video_codecs_;
+  std::vector<AudioCodec> audio_codecs_;
+  unsigned int max_bitrate_;
+  unsigned int max_latency_;
+};
+
+}  // namespace WFD
+
+#endif  // CAPABILITYNEGOTIATOR_H_
@@ -22,6 +22,8 @@
 
 #include "clientrtpports.h"
 
+#include "macros.h"
+
 namespace WFD {
 
 namespace {
@@ -40,12 +42,22 @@ ClientRtpPorts::~ClientRtpPorts() {
 }
 
 std::string ClientRtpPorts::to_string() const {
-  std::string ret = PropertyName::wfd_client_rtp_ports + std::string(SEMICOLON)
-    + std::string(SPACE) + profile
-    + std::string(SPACE) + std::to_string(rtp_port_0_)
-    + std::string(SPACE) + std::to_string(rtp_port_1_)
-    + std::string(SPACE) + mode;
+  std::string ret;
+  write(ret);
   return ret;
 }
 
+void ClientRtpPorts::write(std::string& out) const {
+  out += PropertyName::wfd_client_rtp_ports;
+  out += SEMICOLON;
+  out += SPACE;
+  out += profile;
+  out += SPACE;
+  append_decimal(out, rtp_port_0_);
+  out += SPACE;
+  append_decimal(out, rtp_port_1_);
+  out += SPACE;
+  out += mode;
+}
+
 }  // namespace WFD
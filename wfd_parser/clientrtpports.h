@@ -35,6 +35,7 @@ class ClientRtpPorts: public Property {
   unsigned short rtp_port_0() const { return rtp_port_0_; }
   unsigned short rtp_port_1() const { return rtp_port_1_; }
   virtual std::string to_string() const;
+  virtual void write(std::string& out) const;
 
  private:
   unsigned short rtp_port_0_;
@@ -21,42 +21,121 @@
 
 
 #include "driver.h"
+#include "fastheaderparser.h"
 #include "message.h"
 #include "reply.h"
 
 #include "mirac-exception.hpp"
 
 #include <cctype>
-#include <sstream>
 
 namespace WFD {
 
-Driver::Driver() {
+namespace {
+
+// Decodes payload lines one at a time with a driver of its own. The
+// driver holds a message of the right kind so that the same lexer as
+// for the whole payload is used.
+class LineDecoder : public PropertyDecoder {
+ public:
+  explicit LineDecoder(bool is_reply) {
+    if (is_reply)
+      driver_.parse_header("RTSP/1.0 200 OK\r\n\r\n");
+    else
+      driver_.parse_header("SET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n\r\n");
+  }
+
+  std::shared_ptr<Property> decode(const std::string& line) override {
+    driver_.parse_payload(line);
+    auto properties = driver_.parsed_message()->payload().properties();
+    if (properties.empty())
+      return nullptr;
+    return properties.begin()->second;
+  }
+
+ private:
+  Driver driver_;
+};
+
+}  // namespace
+
+Driver::Driver()
+  : input_(&buffer_),
+    use_lazy_payloads_(false) {
 }
 
 void Driver::parse_header(const std::string& message) {
-  message_.reset();
-  parse(message);
+  parse_header(message.data(), message.size());
 }
 
 void Driver::parse_payload(const std::string& message) {
+  parse_payload(message.data(), message.size());
+}
+
+void Driver::parse_header(const char* data, size_t length) {
+  message_.reset();
+  if (arena_) {
+    // Messages handed out earlier keep their arena alive, only recycle
+    // it when nobody else holds on to it.
+    if (arena_.use_count() == 1)
+      arena_->reset();
+    else
+      arena_ = std::make_shared<Arena>();
+  }
+  if (fast_header_parser_ && fast_header_parser_->parse(data, length))
+    return;
+  parse(data, length);
+}
+
+void Driver::parse_payload(const char* data, size_t length) {
   if (!message_) {
     std::string where = std::string("WFD::Driver::") + std::string(__func__);
     throw MiracException("Cannot parse payload without header", where.c_str());
   }
 
-  parse(message);
+  if (use_lazy_payloads_ && parse_lazy_payload(data, length))
+    return;
+  parse(data, length);
 }
 
-void Driver::parse(const std::string& message) {
-  std::istringstream in(message);
-  if (!in.good()) {
+bool Driver::parse_lazy_payload(const char* data, size_t length) {
+  bool is_reply = message_->is_reply();
+  // Error replies have a grammar of their own.
+  if (is_reply &&
+      std::static_pointer_cast<Reply>(message_)->response_code() == 303)
+    return false;
+
+  auto& decoder = is_reply ? reply_decoder_ : request_decoder_;
+  if (!decoder)
+    decoder = std::make_shared<LineDecoder>(is_reply);
+
+  Payload* payload = create<Payload>();
+  try {
+    if (!payload->set_lazy_properties(data, length, decoder)) {
+      destroy(payload);
+      return false;
+    }
+  } catch (...) {
+    destroy(payload);
+    throw;
+  }
+  set_payload(payload);
+  return true;
+}
+
+void Driver::parse(const char* data, size_t length) {
+  buffer_.reset(data, length);
+  input_.clear();
+  if (!input_.good()) {
     std::string where = std::string("WFD::Driver::") + std::string(__func__);
     throw MiracException("Invalid input stream", where.c_str());
   }
 
-  scanner_.reset(new Scanner(&in, *this));
-  parser_.reset(new Parser(*scanner_, *this));
+  if (!scanner_) {
+    scanner_.reset(new Scanner(*this));
+    parser_.reset(new Parser(*scanner_, *this));
+  }
+  scanner_->reset(&input_);
 
   // todo: remove, just for testing
   //scanner_->set_debug(1);
@@ -65,13 +144,40 @@ void Driver::parse(const std::string& message) {
   parser_->parse();
 }
 
+void Driver::set_use_arena(bool use_arena) {
+  message_.reset();
+  if (!use_arena)
+    arena_.reset();
+  else if (!arena_)
+    arena_ = std::make_shared<Arena>();
+}
+
+void Driver::set_use_fast_header_parser(bool use_fast_header_parser) {
+  if (!use_fast_header_parser)
+    fast_header_parser_.reset();
+  else if (!fast_header_parser_)
+    fast_header_parser_.reset(new FastHeaderParser(*this));
+}
+
+void Driver::set_use_lazy_payloads(bool use_lazy_payloads) {
+  use_lazy_payloads_ = use_lazy_payloads;
+}
+
 void Driver::set_message(Message* message) {
-  message_.reset(message);
+  if (arena_)
+    message_ = std::shared_ptr<Message>(arena_, message);
+  else
+    message_.reset(message);
 }
 
 void Driver::set_payload(Payload* payload) {
-  if (message_)
-    message_->set_payload(payload);
+  if (!message_) {
+    destroy(payload);
+    return;
+  }
+  if (arena_)
+    payload->set_owner(arena_);
+  message_->set_payload(adopt(payload));
 }
 
 Driver::~Driver(){
@@ -23,9 +23,13 @@
 #ifndef DRIVER_H_
 #define DRIVER_H_
 
-#include <string>
+#include <cstddef>
+#include <istream>
 #include <memory>
+#include <streambuf>
+#include <string>
 
+#include "arena.h"
 #include "scanner.h"
 #include "message.h"
 #include "payload.h"
@@ -33,6 +37,17 @@
 
 namespace WFD {
 
+class FastHeaderParser;
+
+// Read-only stream buffer over memory owned by the caller, lets the
+// lexers read a message in place instead of from a copy.
+class InputBuffer : public std::streambuf {
+ public:
+  void reset(const char* data, size_t length) {
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + length);
+  }
+};
 
 class Driver {
  public:
@@ -41,17 +56,77 @@ class Driver {
 
   void parse_header(const std::string& message);
   void parse_payload(const std::string& message);
+  // Parse |length| bytes at |data| without copying them first, the
+  // memory only needs to stay valid for the duration of the call.
+  void parse_header(const char* data, size_t length);
+  void parse_payload(const char* data, size_t length);
   std::shared_ptr<Message> parsed_message() const { return message_; }
 
+  // When enabled, the whole tree of each parsed message is allocated
+  // from one arena that is released together with the message.
+  // Property, header and payload pointers obtained from such a message
+  // are only valid for as long as the message itself is referenced.
+  void set_use_arena(bool use_arena);
+  bool use_arena() const { return arena_ != nullptr; }
+
+  // When enabled, headers in the common RTSP forms are parsed by a
+  // hand-written single pass parser and only the remaining ones go
+  // through the generated lexer and parser.
+  void set_use_fast_header_parser(bool use_fast_header_parser);
+  bool use_fast_header_parser() const { return fast_header_parser_ != nullptr; }
+
+  // When enabled, parse_payload() only splits "name: value" bodies into
+  // lines and each known property is decoded when it is first looked up
+  // in the payload. Errors in such a property are then reported by the
+  // lookup instead of by parse_payload().
+  void set_use_lazy_payloads(bool use_lazy_payloads);
+  bool use_lazy_payloads() const { return use_lazy_payloads_; }
+
  private:
   friend class Parser;
+  friend class FastHeaderParser;
   void set_message(Message* message);
   void set_payload(Payload* payload);
-  void parse(const std::string& message);
+  void parse(const char* data, size_t length);
+  bool parse_lazy_payload(const char* data, size_t length);
+
+  template <typename T, typename... Args>
+  T* create(Args&&... args) {
+    if (arena_)
+      return arena_->create<T>(std::forward<Args>(args)...);
+    return new T(std::forward<Args>(args)...);
+  }
+
+  // Releases a parser value that did not end up in the message tree.
+  template <typename T>
+  void destroy(T* object) {
+    if (!arena_)
+      delete object;
+  }
+
+  // Hands an object over to the message tree. Arena objects are owned by
+  // the arena; the links inside the tree must not own it as well, that
+  // would be a cycle, but the message and the properties handed out of
+  // it do, see set_message() and Payload::set_owner().
+  template <typename T>
+  std::shared_ptr<T> adopt(T* object) {
+    if (arena_)
+      return std::shared_ptr<T>(std::shared_ptr<T>(), object);
+    return std::shared_ptr<T>(object);
+  }
 
  private:
-  std::unique_ptr<Parser> parser_;
+  // The scanner and the parser are created on the first parse and then
+  // reused for every following message, only the input is re-targeted.
+  InputBuffer buffer_;
+  std::istream input_;
   std::unique_ptr<Scanner> scanner_;
+  std::unique_ptr<Parser> parser_;
+  std::unique_ptr<FastHeaderParser> fast_header_parser_;
+  bool use_lazy_payloads_;
+  std::shared_ptr<PropertyDecoder> request_decoder_;
+  std::shared_ptr<PropertyDecoder> reply_decoder_;
+  std::shared_ptr<Arena> arena_;
   std::shared_ptr<Message> message_;
 };
 
@@ -38,6 +38,8 @@ class ErrorScanner : public yyFlexLexer, public BaseLexer {
  : yyFlexLexer(in),
    BaseLexer() {};
 
+ virtual void reset(std::istream *in);
+
  private:
   virtual int yylex();
 };
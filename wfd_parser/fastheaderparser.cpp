@@ -0,0 +1,410 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "fastheaderparser.h"
+
+#include <cstring>
+#include <strings.h>
+
+#include "driver.h"
+#include "header.h"
+#include "transportheader.h"
+#include "options.h"
+#include "setparameter.h"
+#include "getparameter.h"
+#include "setup.h"
+#include "play.h"
+#include "teardown.h"
+#include "pause.h"
+#include "reply.h"
+
+namespace WFD {
+
+namespace {
+
+const char kTransportPrefix[] = " RTP/AVP/UDP;unicast;client_port=";
+const char kServerPort[] = ";server_port=";
+const char kTimeout[] = ";timeout=";
+const char kRequireValue[] = " org.wfa.wfd1.0";
+
+// Longer numbers are left to the flex path, which handles overflow.
+const int kMaxDigits = 9;
+
+// Returns the position of the CRLF ending the line at |begin|, or null
+// if the line is not terminated by CRLF or contains a bare LF.
+const char* find_line_end(const char* begin, const char* end) {
+  const char* cr = static_cast<const char*>(memchr(begin, '\r', end - begin));
+  if (!cr || cr + 1 == end || cr[1] != '\n')
+    return nullptr;
+  if (memchr(begin, '\n', cr - begin))
+    return nullptr;
+  return cr;
+}
+
+bool starts_with(const char* begin, const char* end, const char* prefix) {
+  size_t length = strlen(prefix);
+  return static_cast<size_t>(end - begin) >= length
+      && memcmp(begin, prefix, length) == 0;
+}
+
+bool equals_nocase(const char* begin, const char* end, const char* literal) {
+  size_t length = strlen(literal);
+  return static_cast<size_t>(end - begin) == length
+      && strncasecmp(begin, literal, length) == 0;
+}
+
+bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+bool is_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool is_alnum(char c) {
+  return is_alpha(c) || is_digit(c);
+}
+
+const char* skip_sp(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    ++p;
+  return p;
+}
+
+bool parse_number(const char*& p, const char* end, unsigned long long* value) {
+  const char* begin = p;
+  unsigned long long result = 0;
+  while (p < end && is_digit(*p)) {
+    if (p - begin == kMaxDigits)
+      return false;
+    result = result * 10 + (*p - '0');
+    ++p;
+  }
+  *value = result;
+  return p != begin;
+}
+
+// "RTSP/" DIGIT "." DIGIT
+bool parse_version(const char*& p, const char* end) {
+  if (!starts_with(p, end, "RTSP/") || end - p < 8 ||
+      !is_digit(p[5]) || p[6] != '.' || !is_digit(p[7]))
+    return false;
+  p += 8;
+  return true;
+}
+
+}  // namespace
+
+FastHeaderParser::FastHeaderParser(Driver& driver)
+  : driver_(driver) {
+}
+
+bool FastHeaderParser::parse(const char* data, size_t length) {
+  const char* end = data + length;
+  const char* line_end = find_line_end(data, end);
+  if (!line_end)
+    return false;
+
+  Message* message = parse_start_line(data, line_end);
+  if (!message)
+    return false;
+
+  Header* header = driver_.create<Header>();
+  bool complete = false;
+  const char* line = line_end + 2;
+  while (line < end) {
+    line_end = find_line_end(line, end);
+    if (!line_end)
+      break;
+    if (line_end == line) {
+      // Empty line, the header must end here.
+      complete = (line_end + 2 == end);
+      break;
+    }
+    if (!parse_header_line(header, line, line_end))
+      break;
+    line = line_end + 2;
+  }
+
+  if (!complete) {
+    driver_.destroy(header);
+    driver_.destroy(message);
+    return false;
+  }
+
+  message->set_header(driver_.adopt(header));
+  driver_.set_message(message);
+  return true;
+}
+
+Message* FastHeaderParser::parse_start_line(const char* line,
+                                            const char* end) {
+  const char* p = line;
+
+  // RTSP/1.0 200 OK
+  if (parse_version(p, end)) {
+    unsigned long long code;
+    if (p == end || *p++ != ' ' || !parse_number(p, end, &code))
+      return nullptr;
+    // The reason phrase is ignored, but the grammar wants at least two
+    // characters after the spaces.
+    while (p < end && *p == ' ')
+      ++p;
+    if (end - p < 2)
+      return nullptr;
+    return driver_.create<Reply>(code);
+  }
+
+  // METHOD SP (rtsp://... | *) SP RTSP/1.0
+  const char* method_end =
+      static_cast<const char*>(memchr(p, ' ', end - p));
+  if (!method_end)
+    return nullptr;
+  const char* uri = method_end + 1;
+  const char* uri_end = static_cast<const char*>(memchr(uri, ' ', end - uri));
+  if (!uri_end)
+    return nullptr;
+  p = uri_end + 1;
+  if (!parse_version(p, end) || p != end)
+    return nullptr;
+
+  std::string method(line, method_end - line);
+  if (method == MethodName::OPTIONS && uri_end - uri == 1 && *uri == '*')
+    return driver_.create<Options>("*");
+
+  if (!starts_with(uri, uri_end, "rtsp://") ||
+      static_cast<size_t>(uri_end - uri) == strlen("rtsp://") ||
+      memchr(uri, '\t', uri_end - uri))
+    return nullptr;
+  std::string request_uri(uri, uri_end - uri);
+
+  if (method == MethodName::OPTIONS)
+    return driver_.create<Options>(request_uri);
+  if (method == MethodName::SET_PARAMETER)
+    return driver_.create<SetParameter>(request_uri);
+  if (method == MethodName::GET_PARAMETER)
+    return driver_.create<GetParameter>(request_uri);
+  if (method == MethodName::SETUP)
+    return driver_.create<Setup>(request_uri);
+  if (method == MethodName::PLAY)
+    return driver_.create<Play>(request_uri);
+  if (method == MethodName::TEARDOWN)
+    return driver_.create<Teardown>(request_uri);
+  if (method == MethodName::PAUSE)
+    return driver_.create<Pause>(request_uri);
+  return nullptr;
+}
+
+bool FastHeaderParser::parse_header_line(Header* header,
+                                         const char* line,
+                                         const char* end) {
+  const char* colon = static_cast<const char*>(memchr(line, ':', end - line));
+  if (!colon || !is_alpha(*line))
+    return false;
+  for (const char* p = line + 1; p < colon; ++p) {
+    if (!is_alnum(*p) && *p != '-' && *p != '_')
+      return false;
+  }
+
+  const char* value = colon + 1;
+  unsigned long long number;
+
+  if (equals_nocase(line, colon, "CSeq")) {
+    const char* p = skip_sp(value, end);
+    if (!parse_number(p, end, &number) || p != end)
+      return false;
+    header->set_cseq(number);
+    return true;
+  }
+
+  if (equals_nocase(line, colon, "Content-Length")) {
+    const char* p = skip_sp(value, end);
+    if (!parse_number(p, end, &number) || p != end)
+      return false;
+    header->set_content_length(number);
+    return true;
+  }
+
+  if (equals_nocase(line, colon, "Content-Type")) {
+    const char* p = skip_sp(value, end);
+    const char* mime = p;
+    while (p < end && (is_alnum(*p) || *p == '-'))
+      ++p;
+    if (p == mime || p == end || *p++ != '/')
+      return false;
+    const char* subtype = p;
+    while (p < end && (is_alnum(*p) || *p == '-'))
+      ++p;
+    if (p == subtype || p != end)
+      return false;
+    header->set_content_type(std::string(mime, end - mime));
+    return true;
+  }
+
+  if (equals_nocase(line, colon, "Session"))
+    return parse_session(header, value, end);
+
+  if (equals_nocase(line, colon, "Transport"))
+    return parse_transport(header, value, end);
+
+  if (equals_nocase(line, colon, "Public"))
+    return parse_methods(header, value, end);
+
+  if (equals_nocase(line, colon, "Require")) {
+    if (!equals_nocase(value, end, kRequireValue))
+      return false;
+    header->set_require_wfd_support(true);
+    return true;
+  }
+
+  // Any other header is kept as a string, without its leading spaces.
+  const char* p = value;
+  while (p < end && *p == ' ')
+    ++p;
+  if (end - p < 2)
+    return false;
+  header->add_generic_header(std::string(line, colon - line),
+                             std::string(p, end - p));
+  return true;
+}
+
+bool FastHeaderParser::parse_session(Header* header,
+                                     const char* value,
+                                     const char* end) {
+  const char* p = skip_sp(value, end);
+  if (p == value)
+    return false;
+
+  const char* id = p;
+  while (p < end && is_alnum(*p))
+    ++p;
+  if (p == id)
+    return false;
+  std::string session(id, p - id);
+
+  unsigned long long timeout = 0;
+  if (p != end) {
+    if (!starts_with(p, end, kTimeout))
+      return false;
+    p += strlen(kTimeout);
+    if (!parse_number(p, end, &timeout) || p != end)
+      return false;
+  }
+
+  header->set_session(session);
+  header->set_timeout(timeout);
+  return true;
+}
+
+bool FastHeaderParser::parse_transport(Header* header,
+                                       const char* value,
+                                       const char* end) {
+  const char* p = value;
+  if (!starts_with(p, end, kTransportPrefix))
+    return false;
+  p += strlen(kTransportPrefix);
+
+  unsigned long long client_port;
+  unsigned long long server_port = 0;
+  unsigned long long ignored;
+  bool client_rtcp = false;
+  bool has_server_port = false;
+  bool server_rtcp = false;
+
+  if (!parse_number(p, end, &client_port))
+    return false;
+  if (p < end && *p == '-') {
+    ++p;
+    if (!parse_number(p, end, &ignored))
+      return false;
+    client_rtcp = true;
+  }
+  if (p < end) {
+    if (!starts_with(p, end, kServerPort))
+      return false;
+    p += strlen(kServerPort);
+    if (!parse_number(p, end, &server_port))
+      return false;
+    has_server_port = true;
+    if (p < end && *p == '-') {
+      ++p;
+      if (!parse_number(p, end, &ignored))
+        return false;
+      server_rtcp = true;
+    }
+  }
+  if (p != end)
+    return false;
+
+  TransportHeader* transport = driver_.create<TransportHeader>();
+  transport->set_client_port(client_port);
+  if (client_rtcp)
+    transport->set_client_supports_rtcp(true);
+  if (has_server_port)
+    transport->set_server_port(server_port);
+  if (server_rtcp)
+    transport->set_server_supports_rtcp(true);
+  header->set_transport(driver_.adopt(transport));
+  return true;
+}
+
+bool FastHeaderParser::parse_methods(Header* header,
+                                     const char* value,
+                                     const char* end) {
+  static const Method kMethods[] = {
+    OPTIONS, SET_PARAMETER, GET_PARAMETER, SETUP, PLAY, TEARDOWN, PAUSE,
+    ORG_WFA_WFD_1_0
+  };
+
+  methods_.clear();
+  const char* p = skip_sp(value, end);
+  while (true) {
+    const char* name = p;
+    while (p < end && *p != ',' && *p != ' ' && *p != '\t')
+      ++p;
+
+    bool found = false;
+    for (Method method : kMethods) {
+      const char* method_name = MethodName::name[method];
+      if (static_cast<size_t>(p - name) == strlen(method_name) &&
+          !memcmp(name, method_name, p - name)) {
+        methods_.push_back(method);
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+      return false;
+
+    p = skip_sp(p, end);
+    if (p == end)
+      break;
+    if (*p++ != ',')
+      return false;
+    p = skip_sp(p, end);
+  }
+
+  header->set_supported_methods(methods_);
+  return true;
+}
+
+}  // namespace WFD
@@ -0,0 +1,63 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef FASTHEADERPARSER_H_
+#define FASTHEADERPARSER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+namespace WFD {
+
+class Driver;
+class Header;
+class Message;
+
+// Single pass parser for the RTSP start line and the common headers
+// (CSeq, Session, Content-Length, Content-Type, Transport, Public and
+// Require). Lines are found with memchr() instead of going through the
+// flex scanner and the bison grammar. It only accepts input for which it
+// produces exactly what the flex path would; for anything else parse()
+// returns false and the caller falls back to the flex scanner.
+class FastHeaderParser {
+ public:
+  explicit FastHeaderParser(Driver& driver);
+
+  bool parse(const char* data, size_t length);
+
+ private:
+  Message* parse_start_line(const char* line, const char* end);
+  bool parse_header_line(Header* header, const char* line, const char* end);
+  bool parse_session(Header* header, const char* value, const char* end);
+  bool parse_transport(Header* header, const char* value, const char* end);
+  bool parse_methods(Header* header, const char* value, const char* end);
+
+  Driver& driver_;
+  std::vector<Method> methods_;
+};
+
+}  // namespace WFD
+
+#endif  // FASTHEADERPARSER_H_
@@ -49,6 +49,7 @@ struct H264Codec3d {
       max_vres_(max_vres) {}
 
   std::string to_string() const;
+  void write(std::string& out) const;
 
   unsigned char profile_;
   unsigned char level_;
@@ -76,6 +77,7 @@ class Formats3d: public Property {
   const H264Codecs3d& codecs() const { return h264_codecs_3d_; }
 
   virtual std::string to_string() const;
+  virtual void write(std::string& out) const;
 
  private:
   unsigned char native_;
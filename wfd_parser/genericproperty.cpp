@@ -39,7 +39,15 @@ GenericProperty::~GenericProperty() {
 }
 
 std::string GenericProperty::to_string() const{
-  return key_ + ": " + value_;
+  std::string ret;
+  write(ret);
+  return ret;
+}
+
+void GenericProperty::write(std::string& out) const {
+  out += key_;
+  out += ": ";
+  out += value_;
 }
 
 }  // namespace WFD
@@ -38,6 +38,7 @@ class GenericProperty: public Property {
     const std::string& value () const { return value_; }
 
     virtual std::string to_string() const;
+    virtual void write(std::string& out) const;
   private:
     std::string key_;
     std::string value_;
@@ -31,11 +31,8 @@ GetParameter::GetParameter(const std::string& request_uri)
 GetParameter::~GetParameter() {
 }
 
-std::string GetParameter::to_string() {
-  std::string ret = MethodName::GET_PARAMETER
-      + std::string(SPACE) + request_uri()
-      + std::string(SPACE) + std::string(RTSP_END) + std::string(CRLF);
-  return ret + Message::to_string();
+void GetParameter::write_start_line(std::string& out) const {
+  write_request_line(MethodName::GET_PARAMETER, out);
 }
 
 } /* namespace WFD */
@@ -31,7 +31,9 @@ class GetParameter : public Message {
  public:
     explicit GetParameter(const std::string& request_uri);
     virtual ~GetParameter();
-    virtual std::string to_string();
+
+  protected:
+    virtual void write_start_line(std::string& out) const;
 };
 
 } // namespace WFD
@@ -21,6 +21,7 @@
 
 
 #include "header.h"
+#include "macros.h"
 
 namespace WFD {
 
@@ -95,6 +96,10 @@ void Header::set_transport(TransportHeader* transport) {
     transport_.reset(transport);
 }
 
+void Header::set_transport(const std::shared_ptr<TransportHeader>& transport) {
+    transport_ = transport;
+}
+
 bool Header::require_wfd_support() const {
   return require_wfd_support_;
 }
@@ -122,46 +127,66 @@ void Header::set_supported_methods(
 
 std::string Header::to_string() const {
   std::string ret;
+  write(ret);
+  return ret;
+}
 
-  ret += kCSeq + std::to_string(cseq_) + WFD::CRLF;
+void Header::write(std::string& out) const {
+  out += kCSeq;
+  append_decimal(out, cseq_);
+  out += WFD::CRLF;
 
   if (!session_.empty()) {
-      if (timeout_ > 0)
-          ret += kSession + session_
-            + kTimeout + std::to_string(timeout_) + WFD::CRLF;
-      else
-          ret += kSession + session_ + WFD::CRLF;
+    out += kSession;
+    out += session_;
+    if (timeout_ > 0) {
+      out += kTimeout;
+      append_decimal(out, timeout_);
+    }
+    out += WFD::CRLF;
   }
 
-  if (content_type_.length())
-    ret += kContentType + content_type_ + WFD::CRLF;
+  if (content_type_.length()) {
+    out += kContentType;
+    out += content_type_;
+    out += WFD::CRLF;
+  }
 
-  if (content_length_)
-    ret += kContentLenght + std::to_string(content_length_) + WFD::CRLF;
+  if (content_length_) {
+    out += kContentLenght;
+    append_decimal(out, content_length_);
+    out += WFD::CRLF;
+  }
 
-  ret += transport().to_string();
+  if (transport_)
+    transport_->write(out);
 
   if (supported_methods_.size()) {
     auto i = supported_methods_.begin();
     auto end = supported_methods_.end();
-    ret += kPublic;
+    out += kPublic;
     while (i != end) {
-      ret += MethodName::name[*i];
-      if (i != --supported_methods_.end()) {
-        ret += ", ";
-      }
+      out += MethodName::name[*i];
       ++i;
+      if (i != end)
+        out += ", ";
     }
-    ret += WFD::CRLF;
+    out += WFD::CRLF;
   }
 
-  if (require_wfd_support_)
-    ret += std::string(kRequire) + WFD::CRLF;
+  if (require_wfd_support_) {
+    out += kRequire;
+    out += WFD::CRLF;
+  }
 
-  for (auto it = generic_headers_.begin(); it != generic_headers_.end(); it++)
-    ret += (*it).first + ": " + (*it).second + WFD::CRLF;
+  for (auto it = generic_headers_.begin(); it != generic_headers_.end(); it++) {
+    out += (*it).first;
+    out += ": ";
+    out += (*it).second;
+    out += WFD::CRLF;
+  }
 
-  return ret + WFD::CRLF;
+  out += WFD::CRLF;
 }
 
 } // namespace WFD
@@ -57,6 +57,7 @@ class Header {
 
     TransportHeader& transport() const;
     void set_transport(TransportHeader* transport);
+    void set_transport(const std::shared_ptr<TransportHeader>& transport);
 
     bool require_wfd_support() const;
     void set_require_wfd_support(bool require_wfd_support);
@@ -68,13 +69,14 @@ class Header {
     const GenericHeaderMap& generic_headers () const;
 
     virtual std::string to_string() const;
+    void write(std::string& out) const;
 
  private:
     int cseq_;
     int content_length_;
     unsigned int timeout_;
     std::string session_;
-    mutable std::unique_ptr<TransportHeader> transport_;
+    mutable std::shared_ptr<TransportHeader> transport_;
     std::string content_type_;
     bool require_wfd_support_;
     std::vector<Method> supported_methods_;
@@ -37,6 +37,8 @@ class HeaderScanner : public yyFlexLexer, public BaseLexer {
  : yyFlexLexer(in),
    BaseLexer() {};
 
+ virtual void reset(std::istream *in);
+
  private:
   virtual int yylex();
 };
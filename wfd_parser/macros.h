@@ -23,35 +23,77 @@
 #ifndef MACROS_H_
 #define MACROS_H_
 
-#include <stdio.h>
+#include <string>
+
+namespace WFD {
+
+const char kHexDigits[] = "0123456789ABCDEF";
+
+// Formats |value| as |digits| upper case hex digits followed by a NUL.
+// Like "%0<digits>X" truncated to |digits| characters, a value that does
+// not fit keeps its leading digits.
+inline void format_hex(char* out, unsigned long long value, int digits) {
+  int length = 1;
+  while (length < 16 && (value >> (4 * length)))
+    ++length;
+  if (length > digits)
+    value >>= 4 * (length - digits);
+  out[digits] = '\0';
+  while (digits--) {
+    out[digits] = kHexDigits[value & 0xF];
+    value >>= 4;
+  }
+}
+
+inline void append_hex(std::string& out, unsigned long long value, int digits) {
+  char buffer[17];
+  format_hex(buffer, value, digits);
+  out.append(buffer, digits);
+}
+
+inline void append_decimal(std::string& out, long long value) {
+  char buffer[21];
+  char* end = buffer + sizeof(buffer);
+  char* begin = end;
+  unsigned long long magnitude = value < 0 ? 0ULL - value : value;
+  do {
+    *--begin = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  if (value < 0)
+    *--begin = '-';
+  out.append(begin, end - begin);
+}
+
+}  // namespace WFD
 
 #define MAKE_HEX_STRING_2(NAME, PROPERTY) \
   char NAME[3]; \
-  std::snprintf(NAME, sizeof(NAME), "%02X", PROPERTY) \
+  WFD::format_hex(NAME, static_cast<unsigned int>(PROPERTY), 2) \
 
 #define MAKE_HEX_STRING_4(NAME, PROPERTY) \
   char NAME[5]; \
-  std::snprintf(NAME, sizeof(NAME), "%04X", PROPERTY) \
+  WFD::format_hex(NAME, static_cast<unsigned int>(PROPERTY), 4) \
 
 #define MAKE_HEX_STRING_6(NAME, PROPERTY) \
   char NAME[7]; \
-  std::snprintf(NAME, sizeof(NAME), "%06X", PROPERTY) \
+  WFD::format_hex(NAME, static_cast<unsigned int>(PROPERTY), 6) \
 
 #define MAKE_HEX_STRING_8(NAME, PROPERTY) \
   char NAME[9]; \
-  std::snprintf(NAME, sizeof(NAME), "%08X", PROPERTY) \
+  WFD::format_hex(NAME, static_cast<unsigned int>(PROPERTY), 8) \
 
 #define MAKE_HEX_STRING_10(NAME, PROPERTY) \
   char NAME[11]; \
-  std::snprintf(NAME, sizeof(NAME), "%010llX", PROPERTY) \
+  WFD::format_hex(NAME, PROPERTY, 10) \
 
 #define MAKE_HEX_STRING_12(NAME, PROPERTY) \
   char NAME[13]; \
-  std::snprintf(NAME, sizeof(NAME), "%012llX", PROPERTY) \
+  WFD::format_hex(NAME, PROPERTY, 12) \
 
 #define MAKE_HEX_STRING_16(NAME, PROPERTY) \
   char NAME[17]; \
-  std::snprintf(NAME, sizeof(NAME), "%016llX", PROPERTY) \
+  WFD::format_hex(NAME, PROPERTY, 16) \
 
 #endif  // MACROS_H_
 
@@ -22,6 +22,8 @@
 
 #include "message.h"
 
+#include <algorithm>
+
 namespace WFD {
 
 Message::Message(MessageType type, const std::string& request_uri)
@@ -44,6 +46,10 @@ void Message::set_header(Header* header) {
   header_.reset(header);
 }
 
+void Message::set_header(const std::shared_ptr<Header>& header) {
+  header_ = header;
+}
+
 Header& Message::header() const {
   if (!header_)
     header_.reset(new Header());
@@ -54,6 +60,10 @@ void Message::set_payload(Payload* payload) {
   payload_.reset(payload);
 }
 
+void Message::set_payload(const std::shared_ptr<Payload>& payload) {
+  payload_ = payload;
+}
+
 Payload& Message::payload() const {
   if (!payload_)
     payload_.reset(new Payload());
@@ -62,16 +72,52 @@ Payload& Message::payload() const {
 
 std::string Message::to_string() {
   std::string ret;
+  serialize(ret);
+  return ret;
+}
+
+void Message::serialize(std::string& out) {
+  out.clear();
+
+  // The payload goes first so that its length is known when writing the
+  // header, then the start line and header are rotated in front of it.
   if (payload_)
-    ret = payload_->to_string();
+    payload_->write(out);
+  size_t payload_length = out.size();
+
+  write_start_line(out);
+  if (header_) {
+    header_->set_content_length(payload_length);
+    header_->write(out);
+  }
+
+  std::rotate(out.begin(), out.begin() + payload_length, out.end());
+}
+
+void Message::serialize(std::string& header, std::string& payload) {
+  header.clear();
+  payload.clear();
 
+  if (payload_)
+    payload_->write(payload);
 
+  write_start_line(header);
   if (header_) {
-    header_->set_content_length (ret.length());
-    ret = header_->to_string() + ret;
+    header_->set_content_length(payload.size());
+    header_->write(header);
   }
+}
 
-  return ret;
+void Message::write_start_line(std::string& out) const {
+}
+
+void Message::write_request_line(const char* method, std::string& out) const {
+  out += method;
+  out += SPACE;
+  out += request_uri_;
+  out += SPACE;
+  out += RTSP_END;
+  out += CRLF;
 }
 
 } // namespace WFD
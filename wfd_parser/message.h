@@ -58,20 +58,32 @@ class Message {
   void set_request_uri(const std::string& request_uri);
 
   void set_header(Header* header);
+  void set_header(const std::shared_ptr<Header>& header);
   Header& header() const;
 
   void set_payload(Payload* payload);
+  void set_payload(const std::shared_ptr<Payload>& payload);
   Payload& payload() const;
 
   virtual std::string to_string();
+  // Serializes the whole message into |out|, replacing its contents.
+  // Reusing the same string for every message avoids reallocating it.
+  void serialize(std::string& out);
+  // Same as above but keeps the start line and header apart from the
+  // payload, for senders that write both without joining them.
+  void serialize(std::string& header, std::string& payload);
 
  protected:
+  // Appends the request or status line.
+  virtual void write_start_line(std::string& out) const;
+  void write_request_line(const char* method, std::string& out) const;
+
   MessageType type_;
 
  private:
   std::string request_uri_;
-  mutable std::unique_ptr<Header> header_;
-  mutable std::unique_ptr<Payload> payload_;
+  mutable std::shared_ptr<Header> header_;
+  mutable std::shared_ptr<Payload> payload_;
 };
 
 }  // namespace WFD
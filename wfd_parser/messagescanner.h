@@ -38,6 +38,8 @@ class MessageScanner : public yyFlexLexer, public BaseLexer {
    BaseLexer(),
    is_reply_message_(is_reply_message) {};
 
+ virtual void reset(std::istream *in);
+
  private:
   bool is_reply_message_;
   virtual int yylex();
@@ -31,11 +31,8 @@ Options::Options(const std::string& request_uri)
 Options::~Options() {
 }
 
-std::string Options::to_string() {
-  std::string ret = MethodName::OPTIONS
-      + std::string(SPACE) + request_uri()
-      + std::string(SPACE) + std::string(RTSP_END) + std::string(CRLF);
-  return ret + Message::to_string();
+void Options::write_start_line(std::string& out) const {
+  write_request_line(MethodName::OPTIONS, out);
 }
 
 } // namespace WFD
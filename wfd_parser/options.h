@@ -31,7 +31,9 @@ class Options: public Message {
   public:
     explicit Options(const std::string& request_uri);
     virtual ~Options();
-    virtual std::string to_string();
+
+  protected:
+    virtual void write_start_line(std::string& out) const;
 };
 
 } // namespace WFD
@@ -31,11 +31,8 @@ Pause::Pause(const std::string& request_uri)
 Pause::~Pause() {
 }
 
-std::string Pause::to_string() {
-  std::string ret = MethodName::PAUSE
-      + std::string(SPACE) + request_uri()
-      + std::string(SPACE) + std::string(RTSP_END) + std::string(CRLF);
-  return ret + Message::to_string();
+void Pause::write_start_line(std::string& out) const {
+  write_request_line(MethodName::PAUSE, out);
 }
 
 } /* namespace WFD */
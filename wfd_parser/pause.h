@@ -31,7 +31,9 @@ class Pause : public Message {
  public:
     explicit Pause(const std::string& request_uri);
     virtual ~Pause();
-    virtual std::string to_string();
+
+  protected:
+    virtual void write_start_line(std::string& out) const;
 };
 
 } // namespace WFD
@@ -22,18 +22,57 @@
 
 #include "payload.h"
 
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
 namespace WFD {
 
+namespace {
+
+bool name_less(PropertyType a, PropertyType b) {
+  return strcmp(PropertyName::name[a], PropertyName::name[b]) < 0;
+}
+
+// Known property types sorted by name, so that to_string() keeps
+// producing properties in the same order as the old name keyed map.
+const std::vector<PropertyType>& types_by_name() {
+  static const std::vector<PropertyType> types = [] {
+    std::vector<PropertyType> sorted;
+    for (int i = 0; i < WFD_GENERIC; ++i)
+      sorted.push_back(static_cast<PropertyType>(i));
+    std::sort(sorted.begin(), sorted.end(), name_less);
+    return sorted;
+  }();
+  return types;
+}
+
+// Binary search over the sorted names, WFD_GENERIC for unknown ones.
+PropertyType type_for_name(const std::string& name) {
+  const std::vector<PropertyType>& types = types_by_name();
+  auto it = std::lower_bound(types.begin(), types.end(), name,
+      [](PropertyType type, const std::string& key) {
+        return strcmp(PropertyName::name[type], key.c_str()) < 0;
+      });
+  if (it != types.end() && name == PropertyName::name[*it])
+    return *it;
+  return WFD_GENERIC;
+}
+
+}  // namespace
+
 Payload::Payload() {
 }
 
 Payload::Payload(const std::vector<std::string>& properties)
   : request_properties_(properties) {
-
+  for (auto& name : properties)
+    request_property_types_.push_back(type_for_name(name));
 }
 
-Payload::Payload(const PropertyMap& properties)
-  : properties_(properties) {
+Payload::Payload(const PropertyMap& properties) {
+  for (auto& property : properties)
+    add_property(property.second);
 }
 
 Payload::Payload(const PropertyErrorMap& property_errors)
@@ -45,33 +84,57 @@ Payload::~Payload() {
 
 std::shared_ptr<WFD::Property> Payload::get_property(std::string name) const
 {
-  return properties_.at(name);
+  PropertyType type = type_for_name(name);
+  if (type != WFD_GENERIC)
+    decode(type);
+  if (type != WFD_GENERIC && properties_[type])
+    return share(properties_[type]);
+  return share(generic_properties_.at(name));
 }
 
 std::shared_ptr<WFD::Property> Payload::get_property(WFD::PropertyType type) const
 {
-  if (type == WFD_GENERIC)
-    throw std::out_of_range("WFD_GENERIC can't be used as a PropertyMap key");
+  if (type < 0 || type >= WFD_GENERIC)
+    throw std::out_of_range("WFD_GENERIC can't be used as a property index");
+  decode(type);
+  if (!properties_[type])
+    throw std::out_of_range(PropertyName::name[type]);
+
+  return share(properties_[type]);
+}
 
-  return properties_.at(WFD::PropertyName::name[type]);
+bool Payload::has_property(WFD::PropertyType type) const {
+  if (type < 0 || type >= WFD_GENERIC)
+    return false;
+  return properties_[type] || (!pending_.empty() && pending_[type].length);
 }
 
 void Payload::add_property(const std::shared_ptr<Property>& property) {
   if (property->type() == WFD_GENERIC) {
     auto gen_prop = std::static_pointer_cast<GenericProperty>(property);
-    properties_[gen_prop->key()] = property;
+    generic_properties_[gen_prop->key()] = property;
   } else {
-    properties_[PropertyName::name[property->type()]] = property;
+    properties_[property->type()] = property;
+    if (!pending_.empty())
+      pending_[property->type()].length = 0;
   }
 }
 
-const PropertyMap& Payload::properties() const {
-  return properties_;
+PropertyMap Payload::properties() const {
+  decode_all();
+  PropertyMap properties;
+  for (auto& property : generic_properties_)
+    properties[property.first] = share(property.second);
+  for (int i = 0; i < WFD_GENERIC; ++i) {
+    if (properties_[i])
+      properties[PropertyName::name[i]] = share(properties_[i]);
+  }
+  return properties;
 }
 
 std::shared_ptr<WFD::PropertyErrors> Payload::get_property_error(std::string name) const
 {
-  return property_errors_.at(name);
+  return share(property_errors_.at(name));
 }
 
 std::shared_ptr<WFD::PropertyErrors> Payload::get_property_error(WFD::PropertyType type) const
@@ -79,7 +142,7 @@ std::shared_ptr<WFD::PropertyErrors> Payload::get_property_error(WFD::PropertyTy
   if (type == WFD_GENERIC)
     throw std::out_of_range("WFD_GENERIC can't be used as a PropertyErrorMap key");
 
-  return property_errors_.at(WFD::PropertyName::name[type]);
+  return share(property_errors_.at(WFD::PropertyName::name[type]));
 }
 
 void Payload::add_property_error(const std::shared_ptr<WFD::PropertyErrors>& errors) {
@@ -90,51 +153,144 @@ void Payload::add_property_error(const std::shared_ptr<WFD::PropertyErrors>& err
   }
 }
 
+void Payload::set_owner(const std::shared_ptr<void>& owner) {
+  owner_ = owner;
+}
+
+template <typename T>
+std::shared_ptr<T> Payload::share(const std::shared_ptr<T>& object) const {
+  std::shared_ptr<void> owner = owner_.lock();
+  if (!owner || !object)
+    return object;
+  return std::shared_ptr<T>(owner, object.get());
+}
+
 const PropertyErrorMap& Payload::property_errors() const {
   return property_errors_;
 }
 
 void Payload::add_get_parameter_property(const PropertyType& type) {
   request_properties_.push_back(WFD::PropertyName::name[type]);
+  request_property_types_.push_back(type);
 }
 
 void Payload::add_get_parameter_property(const std::string& generic_property) {
   request_properties_.push_back(generic_property);
+  request_property_types_.push_back(WFD_GENERIC);
 }
 
-const std::vector<std::string> Payload::get_parameter_properties() const {
+const std::vector<std::string>& Payload::get_parameter_properties() const {
   return request_properties_;
 }
 
+const std::vector<PropertyType>& Payload::get_parameter_property_types() const {
+  return request_property_types_;
+}
+
 std::string Payload::to_string() const {
   std::string ret;
-  auto i = properties_.begin();
-  auto end = properties_.end();
+  write(ret);
+  return ret;
+}
+
+bool Payload::set_lazy_properties(
+    const char* data, size_t length,
+    const std::shared_ptr<PropertyDecoder>& decoder) {
+  std::vector<LineSpan> pending(WFD_GENERIC, LineSpan());
+  std::vector<LineSpan> others;
+
+  // Check every line first, the payload must not change if one of them
+  // is not a property.
+  size_t offset = 0;
+  while (offset < length) {
+    const char* line = data + offset;
+    const char* cr = static_cast<const char*>(
+        memchr(line, '\r', length - offset));
+    if (!cr || cr + 1 == data + length || cr[1] != '\n')
+      return false;
+    LineSpan span = { offset, static_cast<size_t>(cr + 2 - line) };
+    offset += span.length;
+    if (cr == line)
+      continue;
 
-  while(i != end) {
-    if ((*i).second) {
-      ret += (*i).second->to_string();
-      ret += "\r\n";
+    const char* colon = static_cast<const char*>(memchr(line, ':', cr - line));
+    if (!colon)
+      return false;
+    PropertyType type = type_for_name(std::string(line, colon - line));
+    if (type == WFD_GENERIC)
+      others.push_back(span);
+    else
+      pending[type] = span;
+  }
+  if (others.empty() &&
+      std::none_of(pending.begin(), pending.end(),
+                   [](const LineSpan& span) { return span.length != 0; }))
+    return false;
+
+  // Names that are not an exact match, like generic properties or known
+  // ones in another case, are decoded at once.
+  for (auto& span : others) {
+    auto property = decoder->decode(std::string(data + span.offset,
+                                                span.length));
+    if (property)
+      add_property(property);
+  }
+
+  lazy_data_.assign(data, length);
+  pending_.swap(pending);
+  decoder_ = decoder;
+  return true;
+}
+
+void Payload::decode(PropertyType type) const {
+  if (pending_.empty() || !pending_[type].length)
+    return;
+
+  const LineSpan& span = pending_[type];
+  auto property = decoder_->decode(lazy_data_.substr(span.offset,
+                                                      span.length));
+  pending_[type].length = 0;
+  if (property && property->type() != WFD_GENERIC)
+    properties_[property->type()] = property;
+}
+
+void Payload::decode_all() const {
+  for (size_t i = 0; i < pending_.size(); ++i)
+    decode(static_cast<PropertyType>(i));
+}
+
+void Payload::write(std::string& out) const {
+  decode_all();
+  // Merge the known properties with the generic ones by name.
+  const auto& types = types_by_name();
+  auto type_i = types.begin();
+  auto generic_i = generic_properties_.begin();
+  while (type_i != types.end() || generic_i != generic_properties_.end()) {
+    Property* property;
+    if (type_i != types.end() &&
+        (generic_i == generic_properties_.end() ||
+         generic_i->first.compare(PropertyName::name[*type_i]) > 0)) {
+      property = properties_[*type_i++].get();
+    } else {
+      property = (generic_i++)->second.get();
+    }
+    if (property) {
+      property->write(out);
+      out += CRLF;
     }
-    ++i;
   }
 
-  auto req_i = request_properties_.begin();
-  auto req_end = request_properties_.end();
-  while(req_i != req_end) {
-    ret += *req_i;
-    ret += "\r\n";
-    ++req_i;
+  for (auto& name : request_properties_) {
+    out += name;
+    out += CRLF;
   }
 
   auto error_i = property_errors_.rbegin();
   while(error_i != property_errors_.rend()) {
-    ret += error_i->second->to_string();
-    ret += "\r\n";
+    error_i->second->write(out);
+    out += CRLF;
     error_i++;
   }
-
-  return ret;
 }
 
 } // namespace WFD
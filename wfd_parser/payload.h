@@ -37,6 +37,13 @@ typedef std::map<std::string, std::shared_ptr<WFD::PropertyErrors>> PropertyErro
 
 namespace WFD {
 
+// Turns a single "name: value" payload line into a property.
+class PropertyDecoder {
+ public:
+  virtual ~PropertyDecoder() {}
+  virtual std::shared_ptr<Property> decode(const std::string& line) = 0;
+};
+
 class Payload {
  public:
   Payload();
@@ -47,24 +54,66 @@ class Payload {
 
   std::shared_ptr<WFD::Property> get_property(std::string name) const;
   std::shared_ptr<WFD::Property> get_property(WFD::PropertyType type) const;
+  bool has_property(WFD::PropertyType type) const;
   void add_property(const std::shared_ptr<WFD::Property>& property);
-  const PropertyMap& properties() const;
+  // Builds a name keyed map of all properties, prefer get_property()
+  // or has_property() when the type is known.
+  PropertyMap properties() const;
 
   void add_get_parameter_property(const PropertyType& property);
   void add_get_parameter_property(const std::string& generic_property);
-  const std::vector<std::string> get_parameter_properties() const;
+  const std::vector<std::string>& get_parameter_properties() const;
+  // Same order as get_parameter_properties(), non-standard
+  // parameters are reported as WFD_GENERIC.
+  const std::vector<PropertyType>& get_parameter_property_types() const;
 
   std::shared_ptr<WFD::PropertyErrors> get_property_error(std::string name) const;
   std::shared_ptr<WFD::PropertyErrors> get_property_error(WFD::PropertyType type) const;
   void add_property_error(const std::shared_ptr<WFD::PropertyErrors>& errors);
+  // For an arena allocated payload the entries are only valid while the
+  // message is referenced, get_property_error() hands out owning ones.
   const PropertyErrorMap& property_errors() const;
 
+  // Keeps the "name: value" lines of |data| and has |decoder| decode
+  // each known property only when it is first looked up; other lines
+  // are decoded right away. Returns false and leaves the payload
+  // untouched if |data| is not made of such lines only.
+  bool set_lazy_properties(const char* data, size_t length,
+                           const std::shared_ptr<PropertyDecoder>& decoder);
+
+  // Set by the driver for payloads allocated from its arena: property
+  // pointers handed out from then on share the ownership of |owner|,
+  // so they keep the whole message tree alive.
+  void set_owner(const std::shared_ptr<void>& owner);
+
   virtual std::string to_string() const;
+  void write(std::string& out) const;
 
  private:
-  PropertyMap properties_;
+  struct LineSpan {
+    size_t offset;
+    size_t length;
+  };
+
+  void decode(PropertyType type) const;
+  void decode_all() const;
+  template <typename T>
+  std::shared_ptr<T> share(const std::shared_ptr<T>& object) const;
+
+  // Known properties are indexed by type, only WFD_GENERIC ones
+  // are kept by name. Lazily decoded ones are filled in on lookup.
+  mutable std::shared_ptr<WFD::Property> properties_[WFD_GENERIC];
+  PropertyMap generic_properties_;
   PropertyErrorMap property_errors_;
   std::vector<std::string> request_properties_;
+  std::vector<PropertyType> request_property_types_;
+  // Undecoded lines of known properties, indexed by type, as spans of
+  // |lazy_data_|. Empty unless set_lazy_properties() was used.
+  std::string lazy_data_;
+  mutable std::vector<LineSpan> pending_;
+  std::shared_ptr<PropertyDecoder> decoder_;
+  // Not a shared_ptr: the payload lives in the arena it refers to.
+  std::weak_ptr<void> owner_;
 };
 
 } //namespace WFD
@@ -31,11 +31,8 @@ Play::Play(const std::string& request_uri)
 Play::~Play() {
 }
 
-std::string Play::to_string() {
-  std::string ret = MethodName::PLAY
-      + std::string(SPACE) + request_uri()
-      + std::string(SPACE) + std::string(RTSP_END) + std::string(CRLF);
-  return ret + Message::to_string();
+void Play::write_start_line(std::string& out) const {
+  write_request_line(MethodName::PLAY, out);
 }
 
 } /* namespace WFD */
@@ -31,7 +31,9 @@ class Play : public Message {
  public:
     explicit Play(const std::string& request_uri);
     virtual ~Play();
-    virtual std::string to_string();
+
+  protected:
+    virtual void write_start_line(std::string& out) const;
 };
 
 } // namespace WFD
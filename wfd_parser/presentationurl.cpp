@@ -35,13 +35,18 @@ PresentationUrl::~PresentationUrl() {
 }
 
 std::string PresentationUrl::to_string() const {
-  std::string ret =
-      PropertyName::wfd_presentation_url + std::string(SEMICOLON)
-    + std::string(SPACE)
-    + (presentation_url_1_.length() ? presentation_url_1_ : WFD::NONE)
-    + std::string(SPACE)
-    + (presentation_url_2_.length() ? presentation_url_2_ : WFD::NONE);
+  std::string ret;
+  write(ret);
   return ret;
 }
 
+void PresentationUrl::write(std::string& out) const {
+  out += PropertyName::wfd_presentation_url;
+  out += SEMICOLON;
+  out += SPACE;
+  out += presentation_url_1_.length() ? presentation_url_1_.c_str() : WFD::NONE;
+  out += SPACE;
+  out += presentation_url_2_.length() ? presentation_url_2_.c_str() : WFD::NONE;
+}
+
 }  // namespace WFD
@@ -36,6 +36,7 @@ class PresentationUrl: public Property {
   const std::string& presentation_url_1() const { return presentation_url_1_; }
   const std::string& presentation_url_2() const { return presentation_url_2_; }
   virtual std::string to_string() const;
+  virtual void write(std::string& out) const;
 
  private:
   std::string presentation_url_1_;
@@ -42,4 +42,8 @@ std::string Property::to_string() const {
   return std::string();
 }
 
+void Property::write(std::string& out) const {
+  out += to_string();
+}
+
 }  // namespace WFD
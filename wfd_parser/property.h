@@ -35,6 +35,8 @@ class Property {
   explicit Property(PropertyType type);
   virtual ~Property();
   virtual std::string to_string() const;
+  // Appends the serialized property to |out|.
+  virtual void write(std::string& out) const;
 
   PropertyType type() { return type_; }
   bool is_none() const { return is_none_; }
@@ -24,6 +24,8 @@
 
 #include <assert.h>
 
+#include "macros.h"
+
 namespace WFD {
 
 PropertyErrors::PropertyErrors(PropertyType type, std::vector<unsigned short> error_codes) :
@@ -44,23 +46,26 @@ PropertyErrors::~PropertyErrors() {
 
 std::string PropertyErrors::to_string() const {
   std::string ret;
+  write(ret);
+  return ret;
+}
 
+void PropertyErrors::write(std::string& out) const {
   if (type_ == WFD_GENERIC)
-    ret += generic_property_name_;
+    out += generic_property_name_;
   else
-    ret += PropertyName::name[type_];
+    out += PropertyName::name[type_];
 
-  ret += std::string(SEMICOLON) + std::string(SPACE);
+  out += SEMICOLON;
+  out += SPACE;
 
   auto it = error_codes_.begin();
   while (it != error_codes_.end()) {
-    ret += std::to_string(*it);
+    append_decimal(out, *it);
     it++;
     if (it != error_codes_.end())
-      ret += ", ";
+      out += ", ";
   }
-
-  return ret;
 }
 
 }  // namespace WFD
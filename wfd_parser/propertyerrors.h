@@ -41,6 +41,7 @@ class PropertyErrors {
   const std::string& generic_property_name() const {return generic_property_name_; }
 
   std::string to_string() const;
+  void write(std::string& out) const;
 
  private:
   PropertyType type_;
@@ -22,6 +22,8 @@
 
 #include "reply.h"
 
+#include "macros.h"
+
 namespace WFD {
 
 namespace {
@@ -37,11 +39,12 @@ Reply::Reply(int response_code)
 Reply::~Reply() {
 }
 
-std::string Reply::to_string() {
-  std::string ret;
-  ret += kRTSPHeader + std::to_string(response_code_)
-       + std::string(SPACE) + kOK + std::string(CRLF);
-  return ret + Message::to_string();
+void Reply::write_start_line(std::string& out) const {
+  out += kRTSPHeader;
+  append_decimal(out, response_code_);
+  out += SPACE;
+  out += kOK;
+  out += CRLF;
 }
 
 }  // namespace WFD
@@ -35,7 +35,8 @@ class Reply: public Message {
   int response_code() const { return response_code_; }
   void set_response_code(int response_code) { response_code_ = response_code; }
 
-  virtual std::string to_string();
+ protected:
+  virtual void write_start_line(std::string& out) const;
 
  private:
   int response_code_;
@@ -29,20 +29,39 @@
 
 namespace WFD {
 
-Scanner::Scanner(std::istream *in, const WFD::Driver& driver) {
-  auto message = driver.parsed_message();
+Scanner::Scanner(const WFD::Driver& driver)
+  : driver_(driver),
+    lexer_(nullptr) {
+}
+
+void Scanner::reset(std::istream *in) {
+  auto message = driver_.parsed_message();
+  std::unique_ptr<BaseLexer>* lexer = &message_lexer_;
+  bool is_reply = false;
+
   if (!message) {
-    lexer_.reset(new HeaderScanner(in));
+    lexer = &header_lexer_;
   } else if (message->is_reply()) {
     auto reply = std::static_pointer_cast<Reply>(message);
-    if (reply->response_code() == 303)
-      lexer_.reset(new ErrorScanner(in));
+    if (reply->response_code() == 303) {
+      lexer = &error_lexer_;
+    } else {
+      lexer = &reply_message_lexer_;
+      is_reply = true;
+    }
+  }
+
+  if (!*lexer) {
+    if (lexer == &header_lexer_)
+      lexer->reset(new HeaderScanner(in));
+    else if (lexer == &error_lexer_)
+      lexer->reset(new ErrorScanner(in));
     else
-      lexer_.reset(new MessageScanner(in, true));
+      lexer->reset(new MessageScanner(in, is_reply));
   }
 
-  if (!lexer_)
-    lexer_.reset(new MessageScanner(in));
+  lexer_ = lexer->get();
+  lexer_->reset(in);
 }
 
 int Scanner::yylex(WFD::Parser::semantic_type *lval) {
@@ -22,6 +22,7 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#include <istream>
 #include <memory>
 
 #include "driver.h"
@@ -39,6 +40,9 @@ class BaseLexer {
     yylval = lval;
     return( yylex() );
   }
+  // Re-targets the lexer at a new input stream and resets its start
+  // condition, so that the same lexer can be used for several messages.
+  virtual void reset(std::istream *in) = 0;
 
  protected:
   virtual int yylex() = 0;
@@ -47,12 +51,21 @@ class BaseLexer {
 
 class Scanner {
 public:
-  Scanner(std::istream *in, const WFD::Driver& driver);
+  explicit Scanner(const WFD::Driver& driver);
   ~Scanner() {}
   virtual int yylex(WFD::Parser::semantic_type *lval);
 
+  // Selects the lexer matching the driver state and points it at |in|.
+  // Lexers are created on first use and reused for subsequent messages.
+  void reset(std::istream *in);
+
  private:
-  std::unique_ptr<BaseLexer> lexer_;
+  const WFD::Driver& driver_;
+  BaseLexer* lexer_;
+  std::unique_ptr<BaseLexer> header_lexer_;
+  std::unique_ptr<BaseLexer> message_lexer_;
+  std::unique_ptr<BaseLexer> reply_message_lexer_;
+  std::unique_ptr<BaseLexer> error_lexer_;
 };
 
 }  // namespace WFD
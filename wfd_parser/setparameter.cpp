@@ -32,11 +32,8 @@ SetParameter::SetParameter(const std::string& request_uri)
 SetParameter::~SetParameter() {
 }
 
-std::string SetParameter::to_string() {
-  std::string ret = MethodName::SET_PARAMETER
-      + std::string(SPACE) + request_uri()
-      + std::string(SPACE) + std::string(RTSP_END) + std::string(CRLF);
-  return ret + Message::to_string();
+void SetParameter::write_start_line(std::string& out) const {
+  write_request_line(MethodName::SET_PARAMETER, out);
 }
 
 } /* namespace WFD */
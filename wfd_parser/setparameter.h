@@ -31,7 +31,9 @@ class SetParameter : public Message {
  public:
     explicit SetParameter(const std::string& request_uri);
     virtual ~SetParameter();
-    virtual std::string to_string();
+
+  protected:
+    virtual void write_start_line(std::string& out) const;
 };
 
 } // namespace WFD
@@ -31,11 +31,8 @@ Setup::Setup(const std::string& request_uri)
 Setup::~Setup() {
 }
 
-std::string Setup::to_string() {
-  std::string ret = MethodName::SETUP
-      + std::string(SPACE) + request_uri()
-      + std::string(SPACE) + std::string(RTSP_END) + std::string(CRLF);
-  return ret + Message::to_string();
+void Setup::write_start_line(std::string& out) const {
+  write_request_line(MethodName::SETUP, out);
 }
 
 } /* namespace WFD */
@@ -31,7 +31,9 @@ class Setup : public Message {
  public:
     explicit Setup(const std::string& request_uri);
     virtual ~Setup();
-    virtual std::string to_string();
+
+  protected:
+    virtual void write_start_line(std::string& out) const;
 };
 
 } // namespace WFD
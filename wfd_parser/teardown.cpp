@@ -31,11 +31,8 @@ Teardown::Teardown(const std::string& request_uri)
 Teardown::~Teardown() {
 }
 
-std::string Teardown::to_string() {
-  std::string ret = MethodName::TEARDOWN
-      + std::string(SPACE) + request_uri()
-      + std::string(SPACE) + std::string(RTSP_END) + std::string(CRLF);
-  return ret + Message::to_string();
+void Teardown::write_start_line(std::string& out) const {
+  write_request_line(MethodName::TEARDOWN, out);
 }
 
 } /* namespace WFD */
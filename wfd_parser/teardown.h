@@ -31,7 +31,9 @@ class Teardown : public Message {
  public:
     explicit Teardown(const std::string& request_uri);
     virtual ~Teardown();
-    virtual std::string to_string();
+
+  protected:
+    virtual void write_start_line(std::string& out) const;
 };
 
 } // namespace WFD
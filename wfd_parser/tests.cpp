@@ -22,6 +22,7 @@
 
 #include <list>
 #include <algorithm>
+#include <iterator>
 #include "constants.h"
 #include "driver.h"
 #include "reply.h"
@@ -38,9 +39,24 @@
 #include "uibcsetting.h"
 #include "videoformats.h"
 #include "propertyerrors.h"
+#include "capabilitynegotiator.h"
+#include "videomodes.h"
 
 typedef bool (*TestFunc)(void);
 
+// Every header the tests below parse, test_fast_header_parser runs
+// them through both header parsers again.
+static std::vector<std::string> parsed_headers;
+
+class TestDriver : public WFD::Driver {
+ public:
+  using WFD::Driver::parse_header;
+  void parse_header(const std::string& message) {
+    parsed_headers.push_back(message);
+    WFD::Driver::parse_header(message);
+  }
+};
+
 #define ASSERT_EQUAL(value, expected) \
   if ((value) != (expected)) { \
     std::cout << __func__ << " (" << __FILE__ << ":" << __LINE__ << "): " \
@@ -142,7 +158,7 @@ static bool test_h264_codec_3d (WFD::H264Codec3d codec,
 
 static bool test_valid_options ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("OPTIONS * RTSP/1.0\r\n"
                      "CSeq: 0\r\n"
@@ -163,7 +179,7 @@ static bool test_valid_options ()
 
 static bool test_valid_options_reply ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("RTSP/1.0 200 OK\r\n"
                      "CSeq: 1\r\n"
@@ -203,7 +219,7 @@ static bool test_valid_options_reply ()
 
 static bool test_valid_extra_properties ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("RTSP/1.0 200 OK\r\n"
                      "CSeq: 2\r\n"
@@ -224,6 +240,9 @@ static bool test_valid_extra_properties ()
   auto payload = driver.parsed_message()->payload();
   std::shared_ptr<WFD::Property> property;
 
+  ASSERT(payload.has_property(WFD::PropertyType::WFD_AUDIO_CODECS));
+  ASSERT(!payload.has_property(WFD::PropertyType::WFD_VIDEO_FORMATS));
+  ASSERT_EXCEPTION (payload.get_property(WFD::PropertyType::WFD_VIDEO_FORMATS));
   ASSERT_NO_EXCEPTION (property =
       payload.get_property(WFD::PropertyType::WFD_AUDIO_CODECS));
   ASSERT(property->is_none());
@@ -235,12 +254,21 @@ static bool test_valid_extra_properties ()
 
   ASSERT_EQUAL(driver.parsed_message()->to_string(), header + message);
 
+  std::string buffer("stale contents");
+  driver.parsed_message()->serialize(buffer);
+  ASSERT_EQUAL(buffer, header + message);
+
+  std::string payload_buffer;
+  driver.parsed_message()->serialize(buffer, payload_buffer);
+  ASSERT_EQUAL(buffer, header);
+  ASSERT_EQUAL(payload_buffer, message);
+
   return true;
 }
 
 static bool test_valid_extra_errors ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("RTSP/1.0 303 OK\r\n"
                      "CSeq: 0\r\n"
@@ -274,7 +302,7 @@ static bool test_valid_extra_errors ()
 
 static bool test_valid_extra_properties_in_get ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("GET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
                      "CSeq: 2\r\n"
@@ -291,6 +319,11 @@ static bool test_valid_extra_properties_in_get ()
   ASSERT_EQUAL(properties[0], "nonstandard_property");
   ASSERT_EQUAL(properties[1], "wfd_audio_codecs");
 
+  auto types = driver.parsed_message()->payload().get_parameter_property_types();
+  ASSERT_EQUAL(types.size(), 2);
+  ASSERT_EQUAL(types[0], WFD::PropertyType::WFD_GENERIC);
+  ASSERT_EQUAL(types[1], WFD::PropertyType::WFD_AUDIO_CODECS);
+
   ASSERT_EQUAL(driver.parsed_message()->to_string(), header + message);
 
   return true;
@@ -298,7 +331,7 @@ static bool test_valid_extra_properties_in_get ()
 
 static bool test_valid_get_parameter ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("GET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
                      "CSeq: 2\r\n"
@@ -346,7 +379,7 @@ static bool test_valid_get_parameter ()
 
 static bool test_valid_get_parameter_reply_with_all_none ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
   std::string header("RTSP/1.0 200 OK\r\n"
                      "CSeq: 2\r\n"
                      "Content-Type: text/parameters\r\n"
@@ -459,7 +492,7 @@ static bool test_valid_get_parameter_reply_with_all_none ()
 
 static bool test_valid_get_parameter_reply ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
   std::string header("RTSP/1.0 200 OK\r\n"
                      "CSeq: 2\r\n"
                      "Content-Type: text/parameters\r\n"
@@ -570,7 +603,7 @@ static bool test_valid_get_parameter_reply ()
 
 static bool test_invalid_property_value ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
   std::string header("RTSP/1.0 200 OK\r\n"
                      "CSeq: 2\r\n"
                      "Content-Type: text/parameters\r\n"
@@ -586,7 +619,7 @@ static bool test_invalid_property_value ()
 
 static bool test_case_insensitivity ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string invalid_header("OptionS * RTSP/1.0\r\n"
                              "CSeq: 0\r\n"
@@ -622,7 +655,7 @@ static bool test_case_insensitivity ()
 
 static bool test_valid_get_parameter_reply_with_errors ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
   std::string header("RTSP/1.0 303 OK\r\n"
                      "CSeq: 2\r\n"
                      "Content-Type: text/parameters\r\n"
@@ -664,7 +697,7 @@ static bool test_valid_get_parameter_reply_with_errors ()
 
 static bool test_valid_set_parameter ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("SET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
                      "CSeq: 3\r\n"
@@ -726,7 +759,7 @@ static bool test_valid_set_parameter ()
 
 static bool test_valid_setup ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string message("SETUP rtsp://10.82.24.140/wfd1.0/streamid=0 RTSP/1.0\r\n"
                       "CSeq: 4\r\n"
@@ -755,7 +788,7 @@ static bool test_valid_setup ()
 
 static bool test_valid_setup_reply ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("RTSP/1.0 200 OK\r\n"
                      "CSeq: 4\r\n"
@@ -788,7 +821,7 @@ static bool test_valid_setup_reply ()
 
 static bool test_valid_play ()
 {
-  WFD::Driver driver;
+  TestDriver driver;
 
   std::string header("PLAY rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
                      "CSeq: 5\r\n"
@@ -810,6 +843,233 @@ static bool test_valid_play ()
   return true;
 }
 
+static bool test_arena_messages ()
+{
+  TestDriver driver;
+  driver.set_use_arena(true);
+  ASSERT(driver.use_arena());
+
+  std::string header("RTSP/1.0 200 OK\r\n"
+                     "CSeq: 3\r\n"
+                     "Content-Type: text/parameters\r\n"
+                     "Content-Length: 146\r\n\r\n");
+  std::string message("wfd_audio_codecs: LPCM 00000003 00, AAC 00000001 00\r\n"
+                      "wfd_client_rtp_ports: RTP/AVP/UDP;unicast 1028 0 mode=play\r\n"
+                      "wfd_trigger_method: SETUP\r\n");
+  ASSERT_NO_EXCEPTION (driver.parse_header(header));
+  ASSERT_NO_EXCEPTION (driver.parse_payload(message));
+
+  // The first message keeps its arena alive while the driver moves on.
+  std::shared_ptr<WFD::Message> first(driver.parsed_message());
+  ASSERT(first != NULL);
+
+  std::string next_header("GET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+                          "CSeq: 4\r\n"
+                          "Session: 6B8B4567\r\n\r\n");
+  ASSERT_NO_EXCEPTION (driver.parse_header(next_header));
+  ASSERT_EQUAL(driver.parsed_message()->header().cseq(), 4);
+
+  ASSERT_EQUAL(first->header().cseq(), 3);
+  auto codecs = std::static_pointer_cast<WFD::AudioCodecs>(
+      first->payload().get_property(WFD::PropertyType::WFD_AUDIO_CODECS));
+  ASSERT_EQUAL(codecs->audio_codecs().size(), 2);
+  ASSERT_EQUAL(first->to_string(), header + message);
+
+  // A property outlives the message it was taken from.
+  first.reset();
+  ASSERT_NO_EXCEPTION (driver.parse_header(header));
+  ASSERT_NO_EXCEPTION (driver.parse_payload(message));
+  ASSERT_NO_EXCEPTION (driver.parse_header(next_header));
+  ASSERT_EQUAL(codecs->audio_codecs().size(), 2);
+  ASSERT_EQUAL(codecs->to_string(),
+               "wfd_audio_codecs: LPCM 00000003 00, AAC 00000001 00");
+
+  return true;
+}
+
+static bool test_fast_header_parser ()
+{
+  // Headers in the forms the fast path accepts, and some it leaves to
+  // the flex path, on top of the ones parsed by the other tests. Both
+  // paths must fail or produce the same message for each of them.
+  const char* headers[] = {
+    "OPTIONS * RTSP/1.0\r\n"
+    "CSeq: 1\r\n"
+    "Require: org.wfa.wfd1.0\r\n\r\n",
+    "RTSP/1.0 200 OK\r\n"
+    "cseq:\t2\r\n"
+    "Public: org.wfa.wfd1.0, SET_PARAMETER,GET_PARAMETER\r\n\r\n",
+    "SETUP rtsp://10.82.24.140/wfd1.0/streamid=0 RTSP/1.0\r\n"
+    "CSeq: 4\r\n"
+    "Transport: RTP/AVP/UDP;unicast;client_port=1028-1029;server_port=5000\r\n"
+    "Session: 6B8B4567;timeout=30\r\n"
+    "User-Agent:  wysiwidi 0.1 \r\n\r\n",
+    "SET_PARAMETER rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+    "CSeq: 11\r\n"
+    "Content-Type: text/parameters\r\n"
+    "Content-Length: 27\r\n\r\n",
+    "RTSP/1.0 200 OK\r\n"
+    "CSeq: 5\r\n"
+    "Session:\t0123;timeout=60\r\n"
+    "transport: RTP/AVP/UDP;unicast;client_port=1028\r\n\r\n",
+    "RTSP/1.0 303 Not Modified\r\n"
+    "CSeq: 6\r\n"
+    "Public: OPTIONS , PLAY\r\n\r\n",
+    "PLAY rtsp://localhost/wfd1.0/streamid=0 RTSP/1.0\r\n"
+    "CSeq: 12345678901\r\n\r\n",
+    "OPTIONS * RTSP/1.0\r\n"
+    "CSeq: 7\r\n",
+    "PLAY * RTSP/1.0\r\n"
+    "CSeq: 8\r\n\r\n",
+    "PAUSE rtsp://localhost/wfd1.0 RTSP/1.0\r\n"
+    "Public: options\r\n\r\n",
+  };
+
+  std::vector<std::string> all_headers(parsed_headers);
+  all_headers.insert(all_headers.end(), std::begin(headers), std::end(headers));
+  ASSERT(all_headers.size() > sizeof(headers) / sizeof(headers[0]));
+
+  WFD::Driver fast_driver;
+  fast_driver.set_use_fast_header_parser(true);
+  ASSERT(fast_driver.use_fast_header_parser());
+  WFD::Driver flex_driver;
+
+  for (const auto& header : all_headers) {
+    bool fast_failed = false;
+    bool flex_failed = false;
+    try { fast_driver.parse_header(header); } catch (...) { fast_failed = true; }
+    try { flex_driver.parse_header(header); } catch (...) { flex_failed = true; }
+    if (fast_failed != flex_failed)
+      std::cout << "header parsers disagree on:" << std::endl << header;
+    ASSERT_EQUAL(fast_failed, flex_failed);
+    if (!flex_failed) {
+      ASSERT_EQUAL(fast_driver.parsed_message()->to_string(),
+                   flex_driver.parsed_message()->to_string());
+    }
+  }
+
+  return true;
+}
+
+static bool test_lazy_payloads ()
+{
+  std::string header("RTSP/1.0 200 OK\r\n"
+                     "CSeq: 2\r\n"
+                     "Content-Type: text/parameters\r\n"
+                     "Content-Length: 270\r\n\r\n");
+  std::string message("wfd_audio_codecs: LPCM 00000003 00, AAC 00000001 00\r\n"
+                      "wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0 mode=play\r\n"
+                      "wfd_UIBC_capability: none\r\n"
+                      "my_property: value\r\n"
+                      "wfd_display_edid: none\r\n"
+                      "wfd_video_formats: 40 00 02 04 0001DEFF 053C7FFF 00000FFF 00 0000 0000 11 none none\r\n");
+
+  TestDriver lazy_driver;
+  lazy_driver.set_use_lazy_payloads(true);
+  ASSERT(lazy_driver.use_lazy_payloads());
+  ASSERT_NO_EXCEPTION (lazy_driver.parse_header(header));
+  ASSERT_NO_EXCEPTION (lazy_driver.parse_payload(message));
+  std::shared_ptr<WFD::Message> lazy_message(lazy_driver.parsed_message());
+
+  TestDriver driver;
+  ASSERT_NO_EXCEPTION (driver.parse_header(header));
+  ASSERT_NO_EXCEPTION (driver.parse_payload(message));
+
+  auto& payload = lazy_message->payload();
+  ASSERT(payload.has_property(WFD::PropertyType::WFD_CLIENT_RTP_PORTS));
+  ASSERT(!payload.has_property(WFD::PropertyType::WFD_ROUTE));
+  auto ports = std::static_pointer_cast<WFD::ClientRtpPorts>(
+      payload.get_property(WFD::PropertyType::WFD_CLIENT_RTP_PORTS));
+  ASSERT_EQUAL(ports->rtp_port_0(), 19000);
+  ASSERT(payload.get_property(WFD::PropertyType::WFD_UIBC_CAPABILITY)->is_none());
+  ASSERT_EQUAL(lazy_message->to_string(), driver.parsed_message()->to_string());
+
+  // Errors in a lazily decoded property only show up on lookup.
+  std::string invalid("wfd_display_edid: none\r\n"
+                      "wfd_uibc_capability: none and something completely different\r\n");
+  ASSERT_NO_EXCEPTION (lazy_driver.parse_header(header));
+  ASSERT_NO_EXCEPTION (lazy_driver.parse_payload(invalid));
+  auto& invalid_payload = lazy_driver.parsed_message()->payload();
+  ASSERT_NO_EXCEPTION (invalid_payload.get_property(WFD::PropertyType::WFD_DISPLAY_EDID));
+  ASSERT_EXCEPTION (invalid_payload.get_property(WFD::PropertyType::WFD_UIBC_CAPABILITY));
+
+  return true;
+}
+
+static bool test_capability_negotiation ()
+{
+  WFD::H264Codecs local_codecs;
+  local_codecs.push_back(WFD::H264Codec(WFD::CBP | WFD::CHP, 0x1f, 0x1ffff,
+                                        0x1fffffff, 0xfff, 0, 0, 0, 0, -1, -1));
+  std::vector<WFD::AudioCodec> local_audio;
+  local_audio.push_back(WFD::AudioCodec(WFD::AudioFormat::AAC,
+                                        WFD::AudioFormat::Modes(1), 0));
+  local_audio.push_back(WFD::AudioCodec(WFD::AudioFormat::LPCM,
+                                        WFD::AudioFormat::Modes(3), 0));
+  WFD::CapabilityNegotiator negotiator(local_codecs, local_audio);
+
+  // Sink of the Windows 8 capture, without 1080p60.
+  WFD::H264Codecs sink_codecs;
+  sink_codecs.push_back(WFD::H264Codec(0x01, 0x10, 0x0001DEFF, 0x053C7FFF,
+                                       0x00000FFF, 0, 0, 0, 0x11, -1, -1));
+  WFD::VideoFormats sink_formats(0x40, 0, sink_codecs);
+
+  ASSERT_EQUAL(WFD::best_video_mode(WFD::CEA, WFD::all_video_modes(WFD::CEA)), 8);
+  ASSERT_EQUAL(WFD::best_video_mode(WFD::CEA, 0x0001DEFF, 4000), 5);
+  ASSERT_EQUAL(WFD::best_video_mode(WFD::HH, 0), -1);
+  ASSERT_EQUAL(WFD::max_pixel_rate(WFD::VESA, 0x053C7FFF), 1600u * 900 * 60);
+
+  // 1600x900p60 needs level 4.2.
+  auto video = negotiator.select_video_format(sink_formats);
+  ASSERT(video != NULL);
+  ASSERT_EQUAL(video->to_string(), "wfd_video_formats: A9 00 01 10 00000000 00200000 00000000 00 0000 0000 00 none none");
+
+  negotiator.set_max_bitrate(8000);
+  video = negotiator.select_video_format(sink_formats);
+  ASSERT(video != NULL);
+  ASSERT_EQUAL(video->native_resolution(), WFD::native_resolution(WFD::VESA, 19));
+
+  std::vector<WFD::AudioCodec> sink_audio;
+  sink_audio.push_back(WFD::AudioCodec(WFD::AudioFormat::LPCM,
+                                       WFD::AudioFormat::Modes(3), 0));
+  auto audio = negotiator.select_audio_codec(WFD::AudioCodecs(sink_audio));
+  ASSERT(audio != NULL);
+  ASSERT_EQUAL(audio->to_string(), "wfd_audio_codecs: LPCM 00000002 00");
+
+  // 1080p24 has the macroblock rate of level 3.2 but frames only
+  // level 4 can hold.
+  WFD::H264Codecs film_codecs;
+  film_codecs.push_back(WFD::H264Codec(0x01, 0x1f, 0x00010000, 0, 0,
+                                       0, 0, 0, 0, -1, -1));
+  video = negotiator.select_video_format(
+      WFD::VideoFormats(0x80, 0, film_codecs));
+  ASSERT(video != NULL);
+  ASSERT_EQUAL(video->to_string(), "wfd_video_formats: 80 00 01 04 00010000 00000000 00000000 00 0000 0000 00 none none");
+  film_codecs[0].level_ = 0x03;
+  ASSERT(negotiator.select_video_format(
+      WFD::VideoFormats(0x80, 0, film_codecs)) == NULL);
+
+  // No level holds 1920x1200 frames, 1600x1200p30 is next best.
+  WFD::H264Codecs vesa_codecs;
+  vesa_codecs.push_back(WFD::H264Codec(0x01, 0x1f, 0, 0x10400000, 0,
+                                       0, 0, 0, 0, -1, -1));
+  video = negotiator.select_video_format(
+      WFD::VideoFormats(0xe1, 0, vesa_codecs));
+  ASSERT(video != NULL);
+  ASSERT_EQUAL(video->to_string(), "wfd_video_formats: B1 00 01 04 00000000 00400000 00000000 00 0000 0000 00 none none");
+  vesa_codecs[0].vesa_support_ = 0x10000000;
+  ASSERT(negotiator.select_video_format(
+      WFD::VideoFormats(0xe1, 0, vesa_codecs)) == NULL);
+
+  // Nothing fits a 1 ms latency budget.
+  negotiator.set_max_latency(1);
+  sink_codecs[0].latency_ = 2;
+  ASSERT(negotiator.select_video_format(
+      WFD::VideoFormats(0x40, 0, sink_codecs)) == NULL);
+
+  return true;
+}
+
 int main(const int argc, const char **argv)
 {
   std::list<TestFunc> tests;
@@ -831,6 +1091,11 @@ int main(const int argc, const char **argv)
   tests.push_back(test_valid_extra_properties);
   tests.push_back(test_valid_extra_errors);
   tests.push_back(test_valid_extra_properties_in_get);
+  tests.push_back(test_arena_messages);
+  tests.push_back(test_lazy_payloads);
+  tests.push_back(test_capability_negotiation);
+  // Last, it replays the headers of all the tests above.
+  tests.push_back(test_fast_header_parser);
 
   // Run tests
   for (std::list<TestFunc>::iterator it=tests.begin(); it!=tests.end(); ++it) {
@@ -22,6 +22,7 @@
 
 #include "transportheader.h"
 #include "constants.h"
+#include "macros.h"
 
 namespace WFD {
 
@@ -75,21 +76,30 @@ void TransportHeader::set_server_supports_rtcp(bool server_supports_rtcp) {
 
 std::string TransportHeader::to_string() const {
   std::string ret;
+  write(ret);
+  return ret;
+}
 
+void TransportHeader::write(std::string& out) const {
   if (client_port_ > 0) {
-    ret += kTransport + std::to_string(client_port_);
-    if (client_supports_rtcp_)
-      ret += "-" + std::to_string(client_port_ + 1);
+    out += kTransport;
+    append_decimal(out, client_port_);
+    if (client_supports_rtcp_) {
+      out += "-";
+      append_decimal(out, client_port_ + 1);
+    }
 
     if (server_port_ > 0) {
-      ret += kServerPort + std::to_string(server_port_);
-      if (server_supports_rtcp_)
-        ret += "-" + std::to_string(server_port_ + 1);
+      out += kServerPort;
+      append_decimal(out, server_port_);
+      if (server_supports_rtcp_) {
+        out += "-";
+        append_decimal(out, server_port_ + 1);
+      }
     }
 
-    ret += WFD::CRLF;
+    out += WFD::CRLF;
   }
-  return ret;
 }
 
 } // namespace WFD
@@ -45,6 +45,7 @@ class TransportHeader {
     void set_server_supports_rtcp(bool server_supports_rtcp);
 
     virtual std::string to_string() const;
+    void write(std::string& out) const;
 
  private:
     unsigned int client_port_;
@@ -38,10 +38,16 @@ TriggerMethod::~TriggerMethod() {
 }
 
 std::string TriggerMethod::to_string() const {
-  std::string ret =
-      PropertyName::wfd_trigger_method + std::string(SEMICOLON)
-    + std::string(SPACE) + name[method()];
+  std::string ret;
+  write(ret);
   return ret;
 }
 
+void TriggerMethod::write(std::string& out) const {
+  out += PropertyName::wfd_trigger_method;
+  out += SEMICOLON;
+  out += SPACE;
+  out += name[method()];
+}
+
 }  // namespace WFD
@@ -42,6 +42,7 @@ class TriggerMethod : public Property {
 
   TriggerMethod::Method method() const { return method_; }
   virtual std::string to_string() const;
+  virtual void write(std::string& out) const;
 
  private:
   TriggerMethod::Method method_;
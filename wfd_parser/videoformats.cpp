@@ -43,69 +43,68 @@ VideoFormats::~VideoFormats() {
 
 std::string H264Codec::to_string() const {
   std::string ret;
-  MAKE_HEX_STRING_2(profile, profile_);
-  MAKE_HEX_STRING_2(level, level_);
-  MAKE_HEX_STRING_8(cea_support, cea_support_);
-  MAKE_HEX_STRING_8(vesa_support, vesa_support_);
-  MAKE_HEX_STRING_8(hh_support, hh_support_);
-  MAKE_HEX_STRING_2(latency,latency_);
-  MAKE_HEX_STRING_4(min_slice_size, min_slice_size_);
-  MAKE_HEX_STRING_4(slice_enc_params, slice_enc_params_);
-  MAKE_HEX_STRING_2(frame_rate_control_support, frame_rate_control_support_);
-
-  ret = profile + std::string(SPACE)
-      + level + std::string(SPACE)
-      + cea_support + std::string(SPACE)
-      + vesa_support + std::string(SPACE)
-      + hh_support + std::string(SPACE)
-      + latency + std::string(SPACE)
-      + min_slice_size + std::string(SPACE)
-      + slice_enc_params + std::string(SPACE)
-      + frame_rate_control_support + std::string(SPACE);
-
-  if (max_hres_ >= 0) {
-    MAKE_HEX_STRING_4(max_hres, max_hres_);
-    ret += max_hres;
-  } else {
-    ret += NONE;
-  }
-  ret += std::string(SPACE);
-
-  if (max_vres_ >= 0) {
-    MAKE_HEX_STRING_4(max_vres, max_vres_);
-    ret += max_vres;
-  } else {
-    ret += NONE;
-  }
-
+  write(ret);
   return ret;
 }
 
+void H264Codec::write(std::string& out) const {
+  append_hex(out, profile_, 2);
+  out += SPACE;
+  append_hex(out, level_, 2);
+  out += SPACE;
+  append_hex(out, cea_support_, 8);
+  out += SPACE;
+  append_hex(out, vesa_support_, 8);
+  out += SPACE;
+  append_hex(out, hh_support_, 8);
+  out += SPACE;
+  append_hex(out, latency_, 2);
+  out += SPACE;
+  append_hex(out, min_slice_size_, 4);
+  out += SPACE;
+  append_hex(out, slice_enc_params_, 4);
+  out += SPACE;
+  append_hex(out, frame_rate_control_support_, 2);
+  out += SPACE;
+  if (max_hres_ >= 0)
+    append_hex(out, max_hres_, 4);
+  else
+    out += NONE;
+  out += SPACE;
+  if (max_vres_ >= 0)
+    append_hex(out, max_vres_, 4);
+  else
+    out += NONE;
+}
+
 std::string VideoFormats::to_string() const {
   std::string ret;
+  write(ret);
+  return ret;
+}
 
-  ret = PropertyName::wfd_video_formats
-      + std::string(SEMICOLON)+ std::string(SPACE);
-
-  if (is_none())
-    return ret + WFD::NONE;
-
-  MAKE_HEX_STRING_2(native, native_);
-  MAKE_HEX_STRING_2(preferred_display_mode, preferred_display_mode_);
+void VideoFormats::write(std::string& out) const {
+  out += PropertyName::wfd_video_formats;
+  out += SEMICOLON;
+  out += SPACE;
+  if (is_none()) {
+    out += WFD::NONE;
+    return;
+  }
 
-  ret += native + std::string(SPACE)
-      + preferred_display_mode + std::string(SPACE);
+  append_hex(out, native_, 2);
+  out += SPACE;
+  append_hex(out, preferred_display_mode_, 2);
+  out += SPACE;
 
   auto it = h264_codecs_.begin();
   auto end = h264_codecs_.end();
   while(it != end) {
-    ret += (*it).to_string();
+    (*it).write(out);
     ++it;
     if (it != end)
-      ret += ", ";
+      out += ", ";
   }
-
-  return ret;
 }
 
 }  // namespace WFD
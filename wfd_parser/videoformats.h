@@ -50,6 +50,7 @@ struct H264Codec {
       max_vres_(max_vres) {}
 
   std::string to_string() const;
+  void write(std::string& out) const;
 
   unsigned char profile_;
   unsigned char level_;
@@ -80,6 +81,7 @@ public:
   const H264Codecs& h264_codecs() const { return h264_codecs_; }
 
   virtual std::string to_string() const;
+  virtual void write(std::string& out) const;
 
  private:
   unsigned char native_;
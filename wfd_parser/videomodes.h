@@ -0,0 +1,251 @@
+/*
+ * This file is part of wysiwidi
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+
+#ifndef VIDEOMODES_H_
+#define VIDEOMODES_H_
+
+namespace WFD {
+
+// The resolution tables of wfd_video_formats.
+enum ResolutionType {
+  CEA,
+  VESA,
+  HH
+};
+
+struct VideoMode {
+  unsigned short width;
+  unsigned short height;
+  // Fields per second for interlaced modes.
+  unsigned char frame_rate;
+  bool interlaced;
+};
+
+// Bit i of the CEA, VESA and HH support masks stands for entry i of
+// the matching table.
+constexpr VideoMode kCeaModes[] = {
+  {  640,  480, 60, false },
+  {  720,  480, 60, false },
+  {  720,  480, 60, true },
+  {  720,  576, 50, false },
+  {  720,  576, 50, true },
+  { 1280,  720, 30, false },
+  { 1280,  720, 60, false },
+  { 1920, 1080, 30, false },
+  { 1920, 1080, 60, false },
+  { 1920, 1080, 60, true },
+  { 1280,  720, 25, false },
+  { 1280,  720, 50, false },
+  { 1920, 1080, 25, false },
+  { 1920, 1080, 50, false },
+  { 1920, 1080, 50, true },
+  { 1280,  720, 24, false },
+  { 1920, 1080, 24, false }
+};
+
+constexpr VideoMode kVesaModes[] = {
+  {  800,  600, 30, false },
+  {  800,  600, 60, false },
+  { 1024,  768, 30, false },
+  { 1024,  768, 60, false },
+  { 1152,  864, 30, false },
+  { 1152,  864, 60, false },
+  { 1280,  768, 30, false },
+  { 1280,  768, 60, false },
+  { 1280,  800, 30, false },
+  { 1280,  800, 60, false },
+  { 1360,  768, 30, false },
+  { 1360,  768, 60, false },
+  { 1366,  768, 30, false },
+  { 1366,  768, 60, false },
+  { 1280, 1024, 30, false },
+  { 1280, 1024, 60, false },
+  { 1400, 1050, 30, false },
+  { 1400, 1050, 60, false },
+  { 1440,  900, 30, false },
+  { 1440,  900, 60, false },
+  { 1600,  900, 30, false },
+  { 1600,  900, 60, false },
+  { 1600, 1200, 30, false },
+  { 1600, 1200, 60, false },
+  { 1680, 1024, 30, false },
+  { 1680, 1024, 60, false },
+  { 1680, 1050, 30, false },
+  { 1680, 1050, 60, false },
+  { 1920, 1200, 30, false }
+};
+
+constexpr VideoMode kHhModes[] = {
+  {  800,  480, 30, false },
+  {  800,  480, 60, false },
+  {  854,  480, 30, false },
+  {  854,  480, 60, false },
+  {  864,  480, 30, false },
+  {  864,  480, 60, false },
+  {  640,  360, 30, false },
+  {  640,  360, 60, false },
+  {  960,  540, 30, false },
+  {  960,  540, 60, false },
+  {  848,  480, 30, false },
+  {  848,  480, 60, false }
+};
+
+constexpr const VideoMode* kVideoModes[] = { kCeaModes, kVesaModes, kHhModes };
+
+constexpr unsigned int kVideoModeCount[] = {
+  sizeof(kCeaModes) / sizeof(kCeaModes[0]),
+  sizeof(kVesaModes) / sizeof(kVesaModes[0]),
+  sizeof(kHhModes) / sizeof(kHhModes[0])
+};
+
+// Bit indices of each table, highest pixel rate first. Progressive
+// modes come first when an interlaced one has the same rate.
+constexpr unsigned char kCeaByPixelRate[] = {
+  8, 13, 7, 9, 6, 12, 14, 16, 11, 5, 10, 15, 1, 3, 0, 2, 4
+};
+
+constexpr unsigned char kVesaByPixelRate[] = {
+  23, 27, 25, 17, 21, 15, 19, 28, 13, 11, 9, 5, 7, 22, 26,
+  24, 3, 16, 20, 14, 18, 12, 10, 8, 4, 6, 1, 2, 0
+};
+
+constexpr unsigned char kHhByPixelRate[] = {
+  9, 5, 3, 11, 1, 8, 7, 4, 2, 10, 0, 6
+};
+
+constexpr const unsigned char* kVideoModesByPixelRate[] = {
+  kCeaByPixelRate, kVesaByPixelRate, kHhByPixelRate
+};
+
+// Full frames per second times pixels per frame.
+constexpr unsigned int pixel_rate(const VideoMode& mode) {
+  return mode.width * mode.height * mode.frame_rate / (mode.interlaced ? 2 : 1);
+}
+
+// Macroblocks per frame, for interlaced modes both fields together.
+constexpr unsigned int frame_size(const VideoMode& mode) {
+  return ((mode.width + 15) / 16) * ((mode.height + 15) / 16);
+}
+
+constexpr unsigned int macroblock_rate(const VideoMode& mode) {
+  return frame_size(mode) * mode.frame_rate / (mode.interlaced ? 2 : 1);
+}
+
+// The native resolution byte of wfd_video_formats: table index in the
+// low 3 bits, entry in the high 5 bits.
+constexpr unsigned char native_resolution(ResolutionType type,
+                                          unsigned int index) {
+  return static_cast<unsigned char>((index << 3) | type);
+}
+
+// Rough H.264 bitrate for desktop content in kbit/s, 0.1 bit per pixel.
+constexpr unsigned int estimated_bitrate(const VideoMode& mode) {
+  return pixel_rate(mode) / 10000;
+}
+
+// Every mode bit defined in the table of |type|.
+constexpr unsigned int all_video_modes(ResolutionType type) {
+  return (1u << kVideoModeCount[type]) - 1;
+}
+
+// The bit of |mask| with the highest pixel rate among the modes that
+// need at most |max_bitrate| kbit/s, 0 for no limit. Returns -1 if no
+// bit of |mask| qualifies.
+inline int best_video_mode(ResolutionType type, unsigned int mask,
+                           unsigned int max_bitrate = 0) {
+  for (unsigned int i = 0; i < kVideoModeCount[type]; ++i) {
+    unsigned int index = kVideoModesByPixelRate[type][i];
+    if ((mask & (1u << index)) &&
+        (!max_bitrate ||
+         estimated_bitrate(kVideoModes[type][index]) <= max_bitrate))
+      return index;
+  }
+  return -1;
+}
+
+// The highest pixel rate of the modes in |mask|, 0 if it is empty.
+inline unsigned int max_pixel_rate(ResolutionType type, unsigned int mask) {
+  int index = best_video_mode(type, mask);
+  return index < 0 ? 0 : pixel_rate(kVideoModes[type][index]);
+}
+
+namespace internal {
+
+constexpr bool sorted_by_pixel_rate(const VideoMode* modes,
+                                    const unsigned char* order,
+                                    unsigned int count) {
+  return count < 2 ||
+      (pixel_rate(modes[order[0]]) >= pixel_rate(modes[order[1]]) &&
+       sorted_by_pixel_rate(modes, order + 1, count - 1));
+}
+
+constexpr unsigned int order_mask(const unsigned char* order,
+                                  unsigned int count) {
+  return count ? (1u << order[0]) | order_mask(order + 1, count - 1) : 0;
+}
+
+}  // namespace internal
+
+static_assert(internal::sorted_by_pixel_rate(kCeaModes, kCeaByPixelRate,
+                                             kVideoModeCount[CEA]) &&
+              internal::sorted_by_pixel_rate(kVesaModes, kVesaByPixelRate,
+                                             kVideoModeCount[VESA]) &&
+              internal::sorted_by_pixel_rate(kHhModes, kHhByPixelRate,
+                                             kVideoModeCount[HH]),
+              "mode orders must follow the pixel rate");
+static_assert(internal::order_mask(kCeaByPixelRate, sizeof(kCeaByPixelRate)) ==
+                  all_video_modes(CEA) &&
+              internal::order_mask(kVesaByPixelRate, sizeof(kVesaByPixelRate)) ==
+                  all_video_modes(VESA) &&
+              internal::order_mask(kHhByPixelRate, sizeof(kHhByPixelRate)) ==
+                  all_video_modes(HH),
+              "mode orders must list every mode once");
+
+enum H264Profile {
+  CBP = 1 << 0,
+  CHP = 1 << 1
+};
+
+struct H264Level {
+  // Bit of the level in the wfd_video_formats level mask.
+  unsigned char level;
+  unsigned int max_macroblock_rate;
+  // In macroblocks.
+  unsigned int max_frame_size;
+  // In kbit/s for the constrained baseline profile, high profile
+  // allows 25% more.
+  unsigned int max_bitrate;
+};
+
+// Levels 3.1, 3.2, 4, 4.1 and 4.2 in the order of the level mask.
+constexpr H264Level kH264Levels[] = {
+  { 1 << 0, 108000, 3600, 14000 },
+  { 1 << 1, 216000, 5120, 20000 },
+  { 1 << 2, 245760, 8192, 20000 },
+  { 1 << 3, 245760, 8192, 50000 },
+  { 1 << 4, 522240, 8704, 50000 }
+};
+
+}  // namespace WFD
+
+#endif  // VIDEOMODES_H_